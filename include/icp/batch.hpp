@@ -0,0 +1,208 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_BATCH_HPP
+#define ICP_BATCH_HPP
+
+#include <Eigen/Core>
+#include <vector>
+#include <icp/icp.hpp>
+#include <icp/result.hpp>
+
+#define DEFINE_ICP_BATCH_TYPES(Scalar, Suffix) \
+  typedef IcpBatch_<Scalar, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointXYZ> IcpBatchPointToPoint##Suffix; \
+  typedef IcpBatch_<Scalar, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointSO3XYZ> IcpBatchPointToPointSO3##Suffix; \
+  typedef IcpBatch_<Scalar, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPointXYZRGB> IcpBatchPointToPointXYZRGB##Suffix; \
+  typedef IcpBatch_<Scalar, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointXYZSim3> IcpBatchPointToPointSim3##Suffix; \
+  typedef IcpBatch_<Scalar, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPointXYZRGBSim3> IcpBatchPointToPointXYZRGBSim3##Suffix; \
+  typedef IcpBatch_<Scalar, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlaneNormal> IcpBatchPointToPlane##Suffix; \
+  typedef IcpBatch_<Scalar, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlaneSim3Normal> IcpBatchPointToPlaneSim3##Suffix; \
+  typedef IcpBatch_<Scalar, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPoint2DXYZ, ImplicitKdTree2D<pcl::PointXYZ>> IcpBatchPointToPoint2D##Suffix; \
+  typedef IcpBatch_<Scalar, pcl::PointNormal, pcl::PointNormal, ErrorPointToLine2DNormal, ImplicitKdTree2D<pcl::PointNormal>> IcpBatchPointToLine2D##Suffix; \
+  typedef IcpHypothesesParameters_<Scalar> IcpHypothesesParameters##Suffix;
+
+namespace icp
+{
+
+/**
+ * @brief Parameters of the multi-hypothesis registration of \c IcpBatch_
+ */
+template<typename Dtype>
+struct IcpHypothesesParameters_ {
+  //! Number of iterations run by every hypothesis before pruning
+  unsigned int prune_after;
+  //! A hypothesis is dropped when its inlier ratio is below
+  //! min_inlier_fraction times the best one: a pose matching a small part of
+  //! the cloud can have a low RMSE
+  Dtype min_inlier_fraction;
+  //! Among the others, a hypothesis is dropped when its RMSE is above
+  //! prune_ratio times the best one
+  Dtype prune_ratio;
+  //! Hypotheses closer than this rotation angle (radians) and translation
+  //! are merged, only the best one goes on
+  Dtype merge_rotation;
+  Dtype merge_translation;
+
+  IcpHypothesesParameters_() : prune_after(5), min_inlier_fraction(0.8), prune_ratio(2), merge_rotation(0.02),
+    merge_translation(0.01) {
+  }
+};
+
+/**
+ * @brief Registers many current clouds against the same reference cloud
+ *
+ * The reference cloud is indexed once (with the reference levels of the
+ * pyramid, if any). Registrations are then spread over a pool of worker
+ * threads: each worker owns a copy of an \c Icp_ instance, sharing the
+ * reference index, and reuses its buffers from one registration to the next.
+ *
+ * Example:
+ * \code
+ * icp::IcpBatchPointToPoint batch;
+ * batch.setParameters(param);
+ * batch.setInputReference(scan);
+ * std::vector<icp::IcpResults> results = batch.run(objects, initial_guesses);
+ * \endcode
+ *
+ * The same pool can also register a single cloud from several initial
+ * guesses, see \c runHypotheses().
+ */
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_,
+         typename Search_ = KdTreeFLANNSearch<PointReference>>
+class IcpBatch_ {
+  public:
+    typedef Icp_<Dtype, PointReference, PointCurrent, Error_, Search_> Icp;
+    typedef IcpParameters_<Dtype> IcpParameters;
+    typedef IcpResults_<Dtype> IcpResults;
+    typedef IcpHypothesesParameters_<Dtype> IcpHypothesesParameters;
+    typedef typename Icp::ReferenceModelConstPtr ReferenceModelConstPtr;
+    typedef typename pcl::PointCloud<PointReference>::Ptr PrPtr;
+    typedef typename pcl::PointCloud<PointCurrent>::Ptr PcPtr;
+    typedef std::vector<Eigen::Matrix<Dtype, 4, 4>, Eigen::aligned_allocator<Eigen::Matrix<Dtype, 4, 4>>>
+        TransformationVector;
+
+  protected:
+    //! Instance holding the reference index, copied by each worker
+    Icp prototype_;
+    IcpParameters param_;
+    IcpHypothesesParameters hypotheses_param_;
+    unsigned int num_threads_;
+
+    /**
+     * @brief Runs job(icp, i) for i in [0, n) on the worker pool, each worker
+     * with its own copy of \c prototype_
+     */
+    template<typename Job>
+    void forEach(unsigned int n, const Job &job);
+
+    /**
+     * @brief Drops the hypotheses dominated by a better one, or too close to
+     * a better one
+     */
+    void pruneHypotheses(const std::vector<IcpResults> &results, std::vector<unsigned int> &alive) const;
+
+  public:
+    IcpBatch_() : num_threads_(0) {
+    }
+
+    /**
+     * @brief Sets the parameters shared by all the registrations
+     *
+     * The initial guess is replaced by the one of each current cloud. Each
+     * registration already runs on its own worker, param.num_threads = 1 is
+     * usually the best choice.
+     */
+    void setParameters(const IcpParameters &param) {
+      param_ = param;
+      prototype_.setParameters(param_);
+    }
+
+    IcpParameters getParameters() const {
+      return param_;
+    }
+
+    /**
+     * @brief Sets and indexes the reference cloud, once for all the
+     * registrations
+     */
+    void setInputReference(const PrPtr &in) {
+      prototype_.setInputReference(in);
+    }
+
+    /**
+     * @brief Registers against an already indexed reference cloud, possibly
+     * shared with other batches or \c Icp_ instances
+     */
+    void setReferenceModel(const ReferenceModelConstPtr &model) {
+      prototype_.setReferenceModel(model);
+    }
+
+    /**
+     * @brief Number of worker threads, 0 (default) uses all the hardware
+     * threads available
+     */
+    void setNumThreads(unsigned int num_threads) {
+      num_threads_ = num_threads;
+    }
+
+    /**
+     * @brief Registers each current cloud against the reference cloud
+     *
+     * @param currents
+     *  Current clouds
+     * @param initial_guesses
+     *  Initial guess of each current cloud. When empty, the initial guess of
+     *  the parameters is used for all of them.
+     *
+     * @return The results of each registration, in the order of \c currents
+     */
+    std::vector<IcpResults> run(const std::vector<PcPtr> &currents,
+                                const TransformationVector &initial_guesses = TransformationVector());
+
+    void setHypothesesParameters(const IcpHypothesesParameters &param) {
+      hypotheses_param_ = param;
+    }
+
+    IcpHypothesesParameters getHypothesesParameters() const {
+      return hypotheses_param_;
+    }
+
+    /**
+     * @brief Registers one current cloud from several initial guesses in
+     * parallel, and keeps the best registration
+     *
+     * Every hypothesis first runs \c prune_after iterations (after the
+     * pyramid, if any). Hypotheses matching clearly fewer current points
+     * than the best one, or whose RMSE is clearly worse, are then dropped, as
+     * well as those that reached the pose of a better one, which is common
+     * with symmetric objects. The remaining ones go on at full resolution up
+     * to \c max_iter iterations in total.
+     *
+     * @param current
+     *  Current cloud
+     * @param initial_guesses
+     *  Candidate initial guesses
+     * @param hypotheses
+     *  If not null, receives the results of each hypothesis, as far as it went
+     *
+     * @return The results of the hypothesis with the lowest RMSE among those
+     * matching enough current points. The
+     * registration error holds the iterations of both stages.
+     */
+    IcpResults runHypotheses(const PcPtr &current, const TransformationVector &initial_guesses,
+                             std::vector<IcpResults> *hypotheses = 0);
+};
+
+DEFINE_ICP_BATCH_TYPES(float, );
+DEFINE_ICP_BATCH_TYPES(float, f);
+DEFINE_ICP_BATCH_TYPES(double, d);
+
+}  // namespace icp
+
+#endif /* ICP_BATCH_HPP */
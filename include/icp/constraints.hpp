@@ -21,18 +21,21 @@
 namespace icp
 {
 
-class FixTranslationConstraint
+/**
+ * @brief Axes (x, y, z) left out of the optimisation
+ */
+class FixAxesConstraint
 {
   protected:
    typedef boost::array<bool, 3> FixedAxes;
    FixedAxes fixedAxes_;
 
   public:
-    FixTranslationConstraint() {
+    FixAxesConstraint() {
       setFixedAxes(false, false, false);
     }
 
-    FixTranslationConstraint(bool x, bool y, bool z)
+    FixAxesConstraint(bool x, bool y, bool z)
     {
       setFixedAxes(x, y, z);
     }
@@ -49,62 +52,163 @@ class FixTranslationConstraint
     }
 };
 
+/**
+ * @brief Translation axes left out of the optimisation
+ */
+class FixTranslationConstraint : public FixAxesConstraint
+{
+  public:
+    FixTranslationConstraint() {
+    }
+
+    FixTranslationConstraint(bool x, bool y, bool z) : FixAxesConstraint(x, y, z) {
+    }
+};
+
+/**
+ * @brief Rotation axes left out of the optimisation
+ */
+class FixRotationConstraint : public FixAxesConstraint
+{
+  public:
+    FixRotationConstraint() {
+    }
+
+    FixRotationConstraint(bool x, bool y, bool z) : FixAxesConstraint(x, y, z) {
+    }
+};
+
+/**
+ * @brief Constraints on the pose parameters, applied as a reduced
+ * parameterisation
+ *
+ * The twist holds the translation, the rotation and the scale, if these are
+ * optimised: (tx, ty, tz, rx, ry, rz[, s]) in SE3 and Sim3, (rx, ry, rz) in
+ * SO3. The solver only works on the free parameters: the normal equations
+ * are reduced to them, solved, and the fixed parameters of the twist are
+ * exactly 0. The reduced system is stored on the stack, a constrained solve
+ * is cheaper than a full one and does not allocate.
+ */
 template <typename Scalar, unsigned int DegreesOfFreedom>
 class Constraints_
 {
+  public:
     typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> JacobianMatrix;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> VectorX;
     typedef typename Eigen::Matrix<Scalar, DegreesOfFreedom, 1> Twist;
+    typedef Eigen::Matrix<Scalar, DegreesOfFreedom, DegreesOfFreedom> Hessian;
+    //! Normal equations restricted to the free parameters, without heap storage
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1, 0, DegreesOfFreedom, 1> ReducedTwist;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, 0, DegreesOfFreedom, DegreesOfFreedom> ReducedHessian;
 
   protected:
     FixTranslationConstraint translationConstraint_;
+    FixRotationConstraint rotationConstraint_;
+    bool scaleFixed_;
+
+    //! Whether each parameter of the twist is fixed
+    boost::array<bool, DegreesOfFreedom> fixed_;
+    //! Index in the twist of each free parameter
+    boost::array<unsigned int, DegreesOfFreedom> free_;
+    unsigned int numFree_;
 
+    /**
+     * @brief Updates \c fixed_ and \c free_ from the constraints
+     */
+    void updateParameters();
 
   public:
-    Constraints_ () {
+    Constraints_ () : scaleFixed_(false) {
+      updateParameters();
     }
 
-    virtual void setTranslationConstraint(const FixTranslationConstraint &translationConstraint) {
-      LOG(INFO) << translationConstraint.getFixedAxes()[0] << ", " << translationConstraint.getFixedAxes()[1] << ", " <<
-                translationConstraint.getFixedAxes()[2];
+    virtual ~Constraints_() {
+    }
+
+    /**
+     * @brief Fixes translation axes. Ignored in SO3, which has no translation.
+     */
+    void setTranslationConstraint(const FixTranslationConstraint &translationConstraint) {
       translationConstraint_ = translationConstraint;
-      LOG(INFO) << translationConstraint_.getFixedAxes()[0] << ", " << translationConstraint_.getFixedAxes()[1] << ", " <<
-                translationConstraint_.getFixedAxes()[2];
+      updateParameters();
     }
 
     FixTranslationConstraint getTranslationConstraint() const {
       return translationConstraint_;
     }
 
-    bool hasConstraints() const {
-      return translationConstraint_.numFixedAxes() != 0;
+    void setRotationConstraint(const FixRotationConstraint &rotationConstraint) {
+      rotationConstraint_ = rotationConstraint;
+      updateParameters();
+    }
+
+    FixRotationConstraint getRotationConstraint() const {
+      return rotationConstraint_;
     }
 
-    virtual void processJacobian(const JacobianMatrix &J, JacobianMatrix &Jconstrained) {
-      Jconstrained = J;
+    /**
+     * @brief Fixes the scale. Only meaningful in Sim3.
+     */
+    void setScaleFixed(bool fixed) {
+      scaleFixed_ = fixed;
+      updateParameters();
     }
 
+    bool isScaleFixed() const {
+      return scaleFixed_;
+    }
+
+    bool hasConstraints() const {
+      return numFree_ != DegreesOfFreedom;
+    }
 
-    virtual Twist getTwist(const Eigen::Matrix<Scalar, Eigen::Dynamic, 1> &twist) {
-      return twist;
+    bool isFixed(unsigned int parameter) const {
+      return fixed_[parameter];
     }
+
+    unsigned int numFreeParameters() const {
+      return numFree_;
+    }
+
+    /**
+     * @brief Reduced Jacobian: the columns of the free parameters of J
+     */
+    void processJacobian(const JacobianMatrix &J, JacobianMatrix &Jconstrained) const;
+
+    /**
+     * @brief Sets the columns of the fixed parameters of J to 0, in place
+     */
+    void cancelFixedColumns(JacobianMatrix &J) const;
+
+    /**
+     * @brief Full twist from the twist of the free parameters, the fixed ones
+     * being 0
+     */
+    Twist getTwist(const VectorX &twist) const;
+
+    /**
+     * @brief Solves the normal equations \f$ A x = b \f$ for the free
+     * parameters only
+     *
+     * @return The full twist, the fixed parameters being exactly 0
+     */
+    Twist solve(const Hessian &A, const Twist &b) const;
 };
 
+/**
+ * @brief Kept for compatibility, see \c Constraints_
+ */
 template <typename Scalar, unsigned int DegreesOfFreedom>
 class JacobianConstraints : public Constraints_<Scalar, DegreesOfFreedom>
 {
-  protected:
-    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> JacobianMatrix;
-    typedef typename Eigen::Matrix<Scalar, DegreesOfFreedom, 1> Twist;
-    using Constraints_<Scalar, DegreesOfFreedom>::translationConstraint_;
-
-  public:
-    void processJacobian(const JacobianMatrix &J, JacobianMatrix &Jconstrained);
 };
 
 DEFINE_CONSTRAINT_TYPES(float, 6, );
 DEFINE_CONSTRAINT_TYPES(float, 6, f);
 DEFINE_CONSTRAINT_TYPES(float, 7, );
 DEFINE_CONSTRAINT_TYPES(float, 7, f);
+DEFINE_CONSTRAINT_TYPES(float, 3, );
+DEFINE_CONSTRAINT_TYPES(float, 3, f);
 
 
 }  // namespace icp
@@ -11,6 +11,7 @@
 #define EIGEN_TOOLS_H
 
 #include <algorithm>
+#include <cmath>
 #include <Eigen/Geometry>
 #include <Eigen/Dense>
 #include <Eigen/SVD>
@@ -46,6 +47,22 @@ Eigen::Matrix<T, 4, 4> createTransformationMatrix(T tx, T ty, T tz,
 }
 
 
+/**
+ * \brief Angle of the rotation part of a transformation matrix
+ *
+ * A scale factor (similarity) is removed before measuring the angle.
+ *
+ * \returns
+ * The angle in radian, in [0, pi]
+ */
+template<typename T>
+T rotationAngle(const Eigen::Matrix<T, 4, 4> &transformation) {
+  Eigen::Matrix<T, 3, 3> R = transformation.template topLeftCorner<3, 3>();
+  R /= std::cbrt(R.determinant());
+  const T cos_angle = (R.trace() - 1) / 2;
+  return std::acos(std::max(T(-1), std::min(T(1), cos_angle)));
+}
+
 /*
  * \brief Computes the  (Moore-Penrose) pseudo inverse
  */
@@ -73,6 +90,29 @@ void sort(Eigen::MatrixBase<Scalar> &M) {
   std::sort(M.derived().data(), M.derived().data() + M.derived().size());
 }
 
+/**
+ * @brief Computes the median of an array in place, the array is reordered
+ *
+ * @param data
+ * The array
+ * @param len
+ * Its length, must not be null
+ *
+ * @return
+ * Median of the array, the average of the two central values for even
+ * lengths. A single std::nth_element pass: the lower central value is then
+ * the largest one of the lower half.
+ */
+template<typename Scalar>
+Scalar medianInPlace(Scalar *data, int len) {
+  Scalar *middle = data + len / 2;
+  std::nth_element(data, middle, data + len);
+  if (len % 2 == 1) {
+    return *middle;
+  }
+  return (*std::max_element(data, middle) + *middle) / Scalar(2);
+}
+
 /**
  * @brief Computes median of eigen vector
  *
@@ -80,34 +120,14 @@ void sort(Eigen::MatrixBase<Scalar> &M) {
  * The vector
  *
  * @return
- * Median of vector (element len/2 of the sorted array). Uses std::nth_element
- * to sort only half of the array.
+ * Median of vector, see \c medianInPlace(). Works on a copy, use
+ * \c medianInPlace() on a reusable buffer to avoid the allocation.
  */
 template<typename Scalar>
 Scalar median(const Eigen::Matrix<Scalar, Eigen::Dynamic, 1> &M) {
   // Work on a copy
   Eigen::Matrix<Scalar, Eigen::Dynamic, 1> copy = M;
-  const int len = copy.derived().size();
-  if (len % 2 == 0) {
-    // Even number of elements,
-    // the median is the average of the two central values
-    // Sort half the elements
-    std::nth_element( copy.data(),
-                      copy.data() + len / 2 - 1,
-                      copy.data() + len);
-    const Scalar n1 = copy(len / 2 - 1);
-    std::nth_element( copy.data(),
-                      copy.data() + len / 2,
-                      copy.data() + len);
-    const Scalar n2 = copy(len / 2);
-    return (n1 + n2) / Scalar(2);
-  } else {
-    std::nth_element( copy.data(),
-                      copy.data() + len / 2,
-                      copy.data() + len);
-    // midpoint is the median
-    return copy(len / 2 );
-  }
+  return medianInPlace(copy.data(), copy.size());
 }
 
 template<typename Scalar>
@@ -14,6 +14,7 @@
 #include <pcl/point_types.h>
 #include <boost/shared_ptr.hpp>
 #include <icp/constraints.hpp>
+#include <icp/mestimator.hpp>
 
 namespace icp
 {
@@ -30,29 +31,164 @@ class Error {
     typedef typename pcl::PointCloud<PointCurrent> Pcs;
     typedef typename pcl::PointCloud<PointReference> Pcr;
     typedef typename Pcs::Ptr PcsPtr;
-    typedef typename Pcr::Ptr PcrPtr;
+    typedef typename Pcr::ConstPtr PcrPtr;
     typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> VectorX;
     typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> MatrixX;
     typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> JacobianMatrix;
+    typedef Eigen::Matrix<Scalar, DegreesOfFreedom, DegreesOfFreedom> Hessian;
+    typedef Eigen::Matrix<Scalar, DegreesOfFreedom, 1> Gradient;
+    typedef Eigen::Matrix<Scalar, 3, 1> Vector3;
+    typedef Eigen::Matrix<Scalar, 3, 3> Matrix3;
     typedef Constraints_<Scalar, DegreesOfFreedom> Constraints;
 
   protected:
     PcsPtr current_;
     PcrPtr reference_;
 
+    //! Correspondences between the current and reference clouds
+    /*! The i-th correspondence matches the current point
+     * (*indicesCurrent_)[i] with the reference point (*indicesReference_)[i].
+     * When they are not set, the i-th current point is matched with the i-th
+     * reference point. */
+    const std::vector<int> *indicesCurrent_;
+    const std::vector<int> *indicesReference_;
+    //! Number of correspondences
+    unsigned int n_;
+
+    //! Transformation applied on the fly to the current points (R_ may contain a
+    //! scale factor), and the pure rotation applied to their normals
+    Matrix3 R_;
+    Vector3 t_;
+    Matrix3 normalRotation_;
+
+    //! Transformation applied on the fly to the reference points
+    /*! Lets the reference cloud be expressed in the frame of the initial
+     * guess without transforming it */
+    Matrix3 referenceR_;
+    Vector3 referenceT_;
+
     //! Vector containing the error for each point
+    /*! The storage only grows, so that it can be reused from one iteration
+     * to the next without allocating. Only the first \c rows_ entries are
+     * meaningful. */
     VectorX errorVector_;
     VectorX weightsVector_;
+    unsigned int rows_;
+    //! Whether \c weightsVector_ holds M-estimator weights, unit weights otherwise
+    bool weighted_;
 
     //! Corresponding Jacobian
+    /*! Only filled by \c computeJacobian(), the solver does not need it */
     JacobianMatrix J_;
 
+    //! Normal equations \f$ J^T W J \f$ and \f$ J^T W e \f$
+    /*! Accumulated one correspondence at a time by \c computeNormalEquations() */
+    Hessian JtWJ_;
+    Gradient JtWe_;
+
+    //! Weighted sums over the correspondences of the closed form updates
+    /*! Accumulated in double precision, the cross-covariance is obtained by
+     * subtracting the product of the centroids */
+    double closedFormWeight_;
+    Eigen::Vector3d sumCurrent_;
+    Eigen::Vector3d sumReference_;
+    //! \f$ \sum w q p^T \f$, q reference and p current point
+    Eigen::Matrix3d sumCross_;
+    double sumSquaredCurrent_;
+
     //! Constraints
     boost::shared_ptr<Constraints> constraints_;
 
+    //! M-estimator used by \c computeWeights()
+    MEstimatorType mestimatorType_;
+    //! Tuning constant of the kernel, 0 for its default one
+    Scalar mestimatorTuning_;
+    ScaleEstimator scaleEstimator_;
+    //! Scale used by SCALE_FIXED
+    Scalar fixedScale_;
+    //! Computes the scale, with its own buffers
+    RobustScale_<Scalar> scale_;
+
+    /**
+     * @brief Sets the number of rows of the error and weight vectors. Their
+     * storage is only reallocated when it is too small, weights are reset to unit weights
+     */
+    void resizeBuffers(unsigned int rows);
+
+    /**
+     * @brief Number of rows of the error vector per correspondence (3 for a
+     * point to point error, 1 for a point to plane error)
+     */
+    virtual unsigned int rowsPerCorrespondence() const {
+      return 3;
+    }
+
+    /**
+     * @brief Solves \f$ A x = b \f$ for the free parameters, the fixed ones
+     * are 0
+     */
+    virtual Gradient solve(const Hessian &A, const Gradient &b) const;
+
+    //! Transformation of the twist x, \f$ e^x \f$
+    virtual Eigen::Matrix<Scalar, 4, 4> expTwist(const Gradient &x) const;
+
+    const PointCurrent &current(unsigned int i) const {
+      return (*current_)[indicesCurrent_ ? (*indicesCurrent_)[i] : i];
+    }
+    const PointReference &reference(unsigned int i) const {
+      return (*reference_)[indicesReference_ ? (*indicesReference_)[i] : i];
+    }
+    //! Current point of the i-th correspondence, transformed on the fly
+    Vector3 currentPoint(unsigned int i) const {
+      return R_ * current(i).getVector3fMap().template cast<Scalar>() + t_;
+    }
+    //! Reference point of the i-th correspondence, transformed on the fly
+    Vector3 referencePoint(unsigned int i) const {
+      return referenceR_ * reference(i).getVector3fMap().template cast<Scalar>() + referenceT_;
+    }
+
+    void resetClosedForm() {
+      closedFormWeight_ = 0;
+      sumCurrent_.setZero();
+      sumReference_.setZero();
+      sumCross_.setZero();
+      sumSquaredCurrent_ = 0;
+    }
+    //! Adds the current point p matched with the reference point q
+    void accumulateClosedForm(const Vector3 &p, const Vector3 &q, Scalar w) {
+      const Eigen::Vector3d pd = p.template cast<double>();
+      const Eigen::Vector3d qd = q.template cast<double>();
+      closedFormWeight_ += w;
+      sumCurrent_ += w * pd;
+      sumReference_ += w * qd;
+      sumCross_.noalias() += (w * qd) * pd.transpose();
+      sumSquaredCurrent_ += w * pd.squaredNorm();
+    }
+    /**
+     * @brief Transformation minimizing \f$ \sum w |q - (s R p + t)|^2 \f$
+     * over the accumulated correspondences (Umeyama)
+     *
+     * @param translation
+     *  If false, t = 0 and the rotation is about the origin
+     * @param scale
+     *  If false, s = 1
+     */
+    Eigen::Matrix<Scalar, 4, 4> closedFormTransformation(bool translation, bool scale) const;
+
   public:
-    Error() : constraints_(new Constraints())
-    {}
+    Error() : indicesCurrent_(0), indicesReference_(0), n_(0), rows_(0), weighted_(false),
+      constraints_(new Constraints()), mestimatorType_(MESTIMATOR_HUBER), mestimatorTuning_(0),
+      scaleEstimator_(SCALE_MAD), fixedScale_(1)
+    {
+      R_.setIdentity();
+      t_.setZero();
+      normalRotation_.setIdentity();
+      referenceR_.setIdentity();
+      referenceT_.setZero();
+      JtWJ_.setZero();
+      JtWe_.setZero();
+      resetClosedForm();
+    }
 
     /**
      * @brief Computes an error vector from data
@@ -60,24 +196,110 @@ class Error {
     virtual void computeError() = 0;
 
     /**
-     * @brief Compute mestimation
+     * @brief Fused kernel: computes the error vector and the unweighted normal
+     * equations in a single pass over the correspondences
+     *
+     * Each correspondence is read through the indices, its current point is
+     * transformed, and both its residual and its Jacobian contribution are
+     * accumulated at once. Equivalent to \c computeError() followed by
+     * \c computeNormalEquations() without M-estimator weights.
+     */
+    virtual void computeErrorAndNormalEquations() = 0;
+
+    /**
+     * @brief Computes the M-estimator weight of each row of the error vector
      */
     virtual void computeWeights();
 
+    /**
+     * @brief Sets the M-estimator used by \c computeWeights()
+     *
+     * @param type Robust kernel
+     * @param tuning Tuning constant of the kernel, 0 for its default one
+     * @param scale_estimator How the scale of the residuals is estimated
+     * @param fixed_scale Scale used by SCALE_FIXED
+     * @param scale_tolerance Relative error allowed on the medians of the
+     * scale estimators, 0 for exact ones
+     */
+    void setMEstimator(MEstimatorType type, Scalar tuning, ScaleEstimator scale_estimator, Scalar fixed_scale,
+                       Scalar scale_tolerance = 0) {
+      mestimatorType_ = type;
+      mestimatorTuning_ = tuning;
+      scaleEstimator_ = scale_estimator;
+      fixedScale_ = fixed_scale;
+      scale_.setTolerance(scale_tolerance);
+    }
+
     /**
      * @brief Computes the Jacobian of the error vector with respect to
      * the optimisation parameters (typically the pose twist)
      */
     virtual void computeJacobian() = 0;
 
+    /**
+     * @brief Accumulates the normal equations \f$ J^T W J \f$ and \f$ J^T W e \f$
+     *
+     * The Jacobian block of each correspondence is computed on the fly and
+     * added straight into the DoF x DoF system, so that neither the dense
+     * Jacobian nor the weight matrix are ever built. Requires \c computeError()
+     * (and \c computeWeights() if used) to have been called first.
+     */
+    virtual void computeNormalEquations() = 0;
+
     /**
      * @brief Computes by default the gauss newton update, based on the
-     * previously computed error and jacobian value. The required error and
-     * jacobians aren't automatically computed for now, so please call
-     * \c computeError() and \c computeJacobian() as needed.
+     * previously accumulated normal equations. They aren't automatically
+     * computed for now, so please call \c computeError() and
+     * \c computeNormalEquations() as needed.
      */
     virtual Eigen::Matrix<Scalar, 4, 4> update();
 
+    /**
+     * @brief Computes a Levenberg-Marquardt update, based on the previously
+     * accumulated normal equations
+     *
+     * Solves \f$ (J^T W J + \lambda D) x = -J^T W e \f$, where D is the
+     * diagonal of \f$ J^T W J \f$. The normal equations are left untouched, so
+     * that the step can be solved again with another damping if it is rejected.
+     *
+     * @param damping
+     *  \f$ \lambda \f$, a null damping gives the Gauss-Newton step
+     * @param predicted_decrease
+     *  Decrease of \c getCost() predicted by the linearized error
+     */
+    virtual Eigen::Matrix<Scalar, 4, 4> update(Scalar damping, Scalar &predicted_decrease);
+
+    /**
+     * @brief Accumulates the weighted centroids and cross-covariance of the
+     * correspondences, from which \c closedFormUpdate() computes the optimal
+     * transformation. Requires \c computeError() (and \c computeWeights() if
+     * used) to have been called first.
+     *
+     * Errors without a closed form solution accumulate their normal
+     * equations instead, and \c closedFormUpdate() is their Gauss-Newton
+     * step.
+     */
+    virtual void computeClosedForm() {
+      computeNormalEquations();
+    }
+
+    /**
+     * @brief Fused kernel: computes the error vector and the unweighted sums
+     * of \c computeClosedForm() in a single pass
+     */
+    virtual void computeErrorAndClosedForm() {
+      computeErrorAndNormalEquations();
+    }
+
+    /**
+     * @brief Optimal transformation for the current correspondences, based on
+     * the sums accumulated by \c computeClosedForm(). Unlike \c update(), it
+     * does not need to be iterated when the correspondences are fixed.
+     */
+    virtual Eigen::Matrix<Scalar, 4, 4> closedFormUpdate() {
+      return update();
+    }
+
     /**
      * @brief Returns the jacobian matrix. call \c computeJacobian() first.
      *
@@ -91,6 +313,13 @@ class Error {
     virtual JacobianMatrix getJacobian() const {
       return J_;
     }
+    Hessian getJtWJ() const {
+      return JtWJ_;
+    }
+    Gradient getJtWe() const {
+      return JtWe_;
+    }
+
     /**
      * @brief Returns the error vector for the specific error function
      *
@@ -98,14 +327,41 @@ class Error {
      * and the pointclouds are set, an empty vector otherwise
      */
     virtual VectorX getErrorVector() const {
-      return errorVector_;
+      return errorVector_.head(rows_);
+    }
+
+    /**
+     * @brief Whether \c computeWeights() set M-estimator weights, unit weights
+     * are used otherwise
+     */
+    bool isWeighted() const {
+      return weighted_;
+    }
+
+    /**
+     * @brief M-estimator weights of the rows of the error vector, only
+     * meaningful when \c isWeighted()
+     */
+    Eigen::VectorBlock<const VectorX> getWeights() const {
+      return weightsVector_.head(rows_);
     }
 
     /**
      * Return the norm of the error vector.
      **/
     virtual Scalar getErrorNorm() const {
-      return errorVector_.norm();
+      return errorVector_.head(rows_).norm();
+    }
+
+    /**
+     * @brief Cost minimized by the solver: squared error, weighted the same
+     * way as in the normal equations
+     */
+    Scalar getCost() const {
+      if (weighted_) {
+        return errorVector_.head(rows_).cwiseAbs2().dot(weightsVector_.head(rows_));
+      }
+      return errorVector_.head(rows_).squaredNorm();
     }
 
     /**
@@ -122,6 +378,33 @@ class Error {
      */
     virtual void setInputReference(const PcrPtr &in);
 
+    /**
+     * @brief Restricts the computations to a set of correspondences, without
+     * copying any point
+     *
+     * The vectors are not copied and must outlive the computations.
+     *
+     * @param indices_current Index of the current point of each correspondence
+     * @param indices_reference Index of the matching reference point
+     */
+    void setCorrespondences(const std::vector<int> &indices_current,
+                            const std::vector<int> &indices_reference);
+
+    /**
+     * @brief Sets the transformation applied on the fly to the current points
+     * (identity by default)
+     */
+    void setTransformation(const Eigen::Matrix<Scalar, 4, 4> &T);
+
+    /**
+     * @brief Sets the transformation applied on the fly to the reference
+     * points (identity by default)
+     */
+    void setReferenceTransformation(const Eigen::Matrix<Scalar, 4, 4> &T) {
+      referenceR_ = T.template block<3, 3>(0, 0);
+      referenceT_ = T.template block<3, 1>(0, 3);
+    }
+
     /**
      * @brief Sets the constraints to be used
      * Does not trigger any recomputation of current errors, so this should
@@ -131,8 +414,6 @@ class Error {
      */
     void setConstraints(const boost::shared_ptr<Constraints> constraints) {
       constraints_ = constraints;
-      FixTranslationConstraint translationConstraint = constraints_->getTranslationConstraint();
-      LOG(INFO) << translationConstraint.getFixedAxes()[0] << ", " << translationConstraint.getFixedAxes()[1] << ", " << translationConstraint.getFixedAxes()[2];
     }
 };
 
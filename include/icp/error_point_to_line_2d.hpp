@@ -0,0 +1,105 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_ERROR_POINT_TO_LINE_2D_HPP
+#define ICP_ERROR_POINT_TO_LINE_2D_HPP
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include "error_se2.hpp"
+
+#define DEFINE_ERROR_POINT_TO_LINE_2D_TYPES(Scalar, Suffix) \
+  typedef ErrorPointToLine2D<Scalar, pcl::PointNormal, pcl::PointNormal> ErrorPointToLine2DNormal##Suffix;
+
+namespace icp {
+
+/**
+ * @brief Planar point to line error
+ *
+ * \f[ e = n_{xy} \cdot (P_{xy} - P^*_{xy}) \f]
+ *
+ * Where \f$ P^* \f$ is the reference point cloud, \f$ P \f$ the transformed
+ * point cloud and \f$ n \f$ the normal of the current point, rotated with it.
+ * The normals of a planar scan are the normals of its lines, in the (x, y)
+ * plane.
+ */
+template<typename Scalar, typename PointReference, typename PointCurrent>
+class ErrorPointToLine2D : public ErrorSE2<Scalar, PointReference, PointCurrent> {
+  public:
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> ErrorVector;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> JacobianMatrix;
+    using Error<Scalar, 3, PointReference, PointCurrent>::errorVector_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::J_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::weightsVector_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::rows_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::weighted_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::n_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::normalRotation_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::current;
+    using Error<Scalar, 3, PointReference, PointCurrent>::currentPoint;
+    using Error<Scalar, 3, PointReference, PointCurrent>::referencePoint;
+    using Error<Scalar, 3, PointReference, PointCurrent>::JtWJ_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::JtWe_;
+    typedef typename ErrorSE2<Scalar, PointReference, PointCurrent>::Vector2 Vector2;
+    typedef Eigen::Matrix<Scalar, 1, 3> JacobianBlock;
+
+  protected:
+    //! Jacobian of a single correspondence (one row of \f$ J \f$)
+    static void computeJacobianBlock(const Vector2 &p, const Vector2 &n, JacobianBlock &J);
+
+    //! Normal of the current point of the i-th correspondence, rotated on the fly
+    Vector2 currentNormal(unsigned int i) const {
+      return (normalRotation_ * current(i).getNormalVector3fMap().template cast<Scalar>()).template head<2>();
+    }
+
+    virtual unsigned int rowsPerCorrespondence() const {
+      return 1;
+    }
+
+  public:
+
+    //! Compute the error
+    /*! \f[ e = n_{xy} \cdot (P_{xy} - P^*_{xy}) \f]
+     *
+     *  Stack the error in vectors of form
+     *
+     * \f[ eg = [e_0; e_1; ...; e_n] \in {R}^{n\times1}; \f]
+       */
+    virtual void computeError();
+
+    //! Jacobian of \f$ e(x) \f$, eg \f[ J = \frac{de}{dx} \f]
+    /*!
+        For a point of coordinates \f$ (X, Y) \f$ and normal
+        \f$ (n_x, n_y) \f$, the jacobian is
+        \f[ \left( \begin{array}{ccc}
+         n_x  &  n_y  &  X n_y - Y n_x
+          \end{array} \right)
+        \f]
+        */
+    virtual void computeJacobian();
+
+    /**
+     * @brief Streams \f$ w_i J_i^T J_i \f$ and \f$ w_i J_i^T e_i \f$ of each
+     * correspondence into the 3x3 normal equations
+     */
+    virtual void computeNormalEquations();
+
+    /**
+     * @brief Fused kernel, transforms each current point, computes its residual
+     * and accumulates its Jacobian terms in a single pass
+     */
+    virtual void computeErrorAndNormalEquations();
+};
+
+DEFINE_ERROR_POINT_TO_LINE_2D_TYPES(float, )
+DEFINE_ERROR_POINT_TO_LINE_2D_TYPES(float, f)
+
+}  // namespace icp
+
+#endif /* ICP_ERROR_POINT_TO_LINE_2D_HPP */
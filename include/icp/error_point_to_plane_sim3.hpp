@@ -45,6 +45,32 @@ class ErrorPointToPlaneSim3 : public Error<Scalar, 7, PointReference, PointSourc
     using Error<Scalar, 7, PointReference, PointSource>::current_;
     using Error<Scalar, 7, PointReference, PointSource>::reference_;
     using Error<Scalar, 7, PointReference, PointSource>::weightsVector_;
+    using Error<Scalar, 7, PointReference, PointSource>::rows_;
+    using Error<Scalar, 7, PointReference, PointSource>::weighted_;
+    using Error<Scalar, 7, PointReference, PointSource>::n_;
+    using Error<Scalar, 7, PointReference, PointSource>::normalRotation_;
+    using Error<Scalar, 7, PointReference, PointSource>::current;
+    using Error<Scalar, 7, PointReference, PointSource>::currentPoint;
+    using Error<Scalar, 7, PointReference, PointSource>::referencePoint;
+    typedef typename Error<Scalar, 7, PointReference, PointSource>::Vector3 Vector3;
+    using Error<Scalar, 7, PointReference, PointSource>::JtWJ_;
+    using Error<Scalar, 7, PointReference, PointSource>::JtWe_;
+    typedef Eigen::Matrix<Scalar, 1, 7> JacobianBlock;
+
+  protected:
+    //! Jacobian of a single correspondence (one row of \f$ J \f$)
+    static void computeJacobianBlock(const Vector3 &p, const Vector3 &n, JacobianBlock &J);
+
+    //! Normal of the current point of the i-th correspondence, rotated on the fly
+    Vector3 currentNormal(unsigned int i) const {
+      return normalRotation_ * current(i).getNormalVector3fMap().template cast<Scalar>();
+    }
+
+    virtual unsigned int rowsPerCorrespondence() const {
+      return 1;
+    }
+
+  public:
 
     //! Compute the error
     /*! \f[ e = P^* - P \f]
@@ -67,15 +93,25 @@ class ErrorPointToPlaneSim3 : public Error<Scalar, 7, PointReference, PointSourc
     */
     virtual void computeJacobian();
 
+    /**
+     * @brief Streams \f$ w_i J_i^T J_i \f$ and \f$ w_i J_i^T e_i \f$ of each
+     * correspondence into the 7x7 normal equations
+     */
+    virtual void computeNormalEquations();
+
+    /**
+     * @brief Fused kernel, transforms each current point, computes its residual
+     * and accumulates its Jacobian terms in a single pass
+     */
+    virtual void computeErrorAndNormalEquations();
+
     virtual JacobianMatrix getJacobian() const {
       return J_;
     }
     virtual ErrorVector getErrorVector() const {
-      return errorVector_;
+      return errorVector_.head(rows_);
     }
 
-    virtual void setInputReference(const PrPtr& in);
-    virtual void setInputCurrent(const PcPtr& in);
 };
 
 DEFINE_ERROR_POINT_TO_PLANE_SIM3_TYPES(float, );
@@ -30,21 +30,47 @@ namespace icp {
  * transformed point cloud (the one we want to register).
  */
 template<typename Scalar, typename PointReference, typename PointCurrent>
-class ErrorPointToPlaneSO3 : public Error<Scalar, 6, PointReference, PointCurrent> {
+class ErrorPointToPlaneSO3 : public Error<Scalar, 3, PointReference, PointCurrent> {
   public:
     typedef typename pcl::PointCloud<PointCurrent> Pcs;
     typedef typename pcl::PointCloud<PointReference> Pcr;
     typedef typename Pcs::Ptr PcsPtr;
-    typedef typename Pcr::Ptr PcrPtr;
+    typedef typename Pcr::ConstPtr PcrPtr;
     typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> ErrorVector;
-    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 6> JacobianMatrix;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 3> JacobianMatrix;
     typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> VectorX;
     typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> MatrixX;
-    using Error<Scalar, 6, PointReference, PointCurrent>::errorVector_;
-    using Error<Scalar, 6, PointReference, PointCurrent>::J_;
-    using Error<Scalar, 6, PointReference, PointCurrent>::current_;
-    using Error<Scalar, 6, PointReference, PointCurrent>::reference_;
-    using Error<Scalar, 6, PointReference, PointCurrent>::weightsVector_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::errorVector_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::J_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::current_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::reference_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::weightsVector_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::rows_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::weighted_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::n_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::normalRotation_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::current;
+    using Error<Scalar, 3, PointReference, PointCurrent>::currentPoint;
+    using Error<Scalar, 3, PointReference, PointCurrent>::referencePoint;
+    typedef typename Error<Scalar, 3, PointReference, PointCurrent>::Vector3 Vector3;
+    using Error<Scalar, 3, PointReference, PointCurrent>::JtWJ_;
+    using Error<Scalar, 3, PointReference, PointCurrent>::JtWe_;
+    typedef Eigen::Matrix<Scalar, 1, 3> JacobianBlock;
+
+  protected:
+    //! Jacobian of a single correspondence (one row of \f$ J \f$)
+    static void computeJacobianBlock(const Vector3 &p, const Vector3 &n, JacobianBlock &J);
+
+    //! Normal of the current point of the i-th correspondence, rotated on the fly
+    Vector3 currentNormal(unsigned int i) const {
+      return normalRotation_ * current(i).getNormalVector3fMap().template cast<Scalar>();
+    }
+
+    virtual unsigned int rowsPerCorrespondence() const {
+      return 1;
+    }
+
+  public:
 
     //! Compute the error
     /*! \f[ e(x) = n(P-T(x)\hat{T}P^* \f]
@@ -82,10 +108,18 @@ class ErrorPointToPlaneSO3 : public Error<Scalar, 6, PointReference, PointCurren
         */
     virtual void computeJacobian();
 
-    virtual void setInputReference(const PcrPtr& in);
-    virtual void setInputCurrent(const PcsPtr& in);
+    /**
+     * @brief Streams \f$ w_i J_i^T J_i \f$ and \f$ w_i J_i^T e_i \f$ of each
+     * correspondence into the 3x3 normal equations
+     */
+    virtual void computeNormalEquations();
+
+    /**
+     * @brief Fused kernel, transforms each current point, computes its residual
+     * and accumulates its Jacobian terms in a single pass
+     */
+    virtual void computeErrorAndNormalEquations();
 
-    virtual Eigen::Matrix<Scalar, 4, 4> update();
 };
 
 DEFINE_ERROR_POINT_TO_PLANE_SO3_TYPES(float, )
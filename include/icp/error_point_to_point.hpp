@@ -44,7 +44,25 @@ class ErrorPointToPoint : public Error<Scalar, 6, PointReference, PointSource> {
     using Error<Scalar, 6, PointReference, PointSource>::current_;
     using Error<Scalar, 6, PointReference, PointSource>::reference_;
     using Error<Scalar, 6, PointReference, PointSource>::weightsVector_;
+    using Error<Scalar, 6, PointReference, PointSource>::rows_;
+    using Error<Scalar, 6, PointReference, PointSource>::weighted_;
+    using Error<Scalar, 6, PointReference, PointSource>::n_;
+    using Error<Scalar, 6, PointReference, PointSource>::currentPoint;
+    using Error<Scalar, 6, PointReference, PointSource>::referencePoint;
+    typedef typename Error<Scalar, 6, PointReference, PointSource>::Vector3 Vector3;
     using Error<Scalar, 6, PointReference, PointSource>::constraints_;
+    using Error<Scalar, 6, PointReference, PointSource>::JtWJ_;
+    using Error<Scalar, 6, PointReference, PointSource>::JtWe_;
+    using Error<Scalar, 6, PointReference, PointSource>::resetClosedForm;
+    using Error<Scalar, 6, PointReference, PointSource>::accumulateClosedForm;
+    using Error<Scalar, 6, PointReference, PointSource>::closedFormTransformation;
+    typedef Eigen::Matrix<Scalar, 3, 6> JacobianBlock;
+
+  protected:
+    //! Jacobian of a single correspondence (3 rows of \f$ J \f$)
+    static void computeJacobianBlock(const Vector3 &p, JacobianBlock &J);
+
+  public:
 
     //! Compute the error
     /*! \f[ e = P^* - P \f]
@@ -82,11 +100,39 @@ class ErrorPointToPoint : public Error<Scalar, 6, PointReference, PointSource> {
         */
     virtual void computeJacobian();
 
+    /**
+     * @brief Streams \f$ J_i^T W_i J_i \f$ and \f$ J_i^T W_i e_i \f$ of each
+     * correspondence into the 6x6 normal equations
+     */
+    virtual void computeNormalEquations();
+
+    /**
+     * @brief Fused kernel, transforms each current point, computes its residual
+     * and accumulates its Jacobian terms in a single pass
+     */
+    virtual void computeErrorAndNormalEquations();
+
+    /**
+     * @brief Streams the weighted centroids and cross-covariance of the
+     * correspondences. A correspondence is weighted by the smallest weight
+     * of its three rows, an outlying coordinate is enough to reject it.
+     */
+    virtual void computeClosedForm();
+
+    //! Fused kernel, residuals and unweighted sums in a single pass
+    virtual void computeErrorAndClosedForm();
+
+    /**
+     * @brief Optimal a rotation and a translation for the current correspondences (Umeyama).
+     * Constrained errors fall back to the Gauss-Newton step.
+     */
+    virtual Eigen::Matrix<Scalar, 4, 4> closedFormUpdate();
+
     virtual JacobianMatrix getJacobian() const {
       return J_;
     }
     virtual ErrorVector getErrorVector() const {
-      return errorVector_;
+      return errorVector_.head(rows_);
     }
 };
 
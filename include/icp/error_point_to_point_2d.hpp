@@ -0,0 +1,134 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_ERROR_POINT_TO_POINT_2D_HPP
+#define ICP_ERROR_POINT_TO_POINT_2D_HPP
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include "error_se2.hpp"
+
+#define DEFINE_ERROR_POINT_TO_POINT_2D_TYPES(Scalar, Suffix) \
+  typedef ErrorPointToPoint2D<Scalar, pcl::PointXYZ, pcl::PointXYZ> ErrorPointToPoint2DXYZ##Suffix; \
+  typedef ErrorPointToPoint2D<Scalar, pcl::PointNormal, pcl::PointNormal> ErrorPointToPoint2DNormal##Suffix;
+
+namespace icp {
+
+/**
+ * @brief Planar point to point error
+ *
+ * \f[ e = P^*_{xy} - P_{xy} \f]
+ *
+ * Where \f$ P^* \f$ is the reference point cloud and \f$ P \f$ is the
+ * transformed point cloud, both projected on the (x, y) plane. There are two
+ * rows per correspondence.
+ */
+template<typename Scalar, typename PointReference, typename PointSource>
+class ErrorPointToPoint2D : public ErrorSE2<Scalar, PointReference, PointSource> {
+  public:
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> ErrorVector;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> JacobianMatrix;
+    using Error<Scalar, 3, PointReference, PointSource>::errorVector_;
+    using Error<Scalar, 3, PointReference, PointSource>::J_;
+    using Error<Scalar, 3, PointReference, PointSource>::weightsVector_;
+    using Error<Scalar, 3, PointReference, PointSource>::rows_;
+    using Error<Scalar, 3, PointReference, PointSource>::weighted_;
+    using Error<Scalar, 3, PointReference, PointSource>::n_;
+    using Error<Scalar, 3, PointReference, PointSource>::currentPoint;
+    using Error<Scalar, 3, PointReference, PointSource>::referencePoint;
+    using Error<Scalar, 3, PointReference, PointSource>::JtWJ_;
+    using Error<Scalar, 3, PointReference, PointSource>::JtWe_;
+    using Error<Scalar, 3, PointReference, PointSource>::closedFormWeight_;
+    using Error<Scalar, 3, PointReference, PointSource>::sumCurrent_;
+    using Error<Scalar, 3, PointReference, PointSource>::sumReference_;
+    using Error<Scalar, 3, PointReference, PointSource>::sumCross_;
+    using Error<Scalar, 3, PointReference, PointSource>::resetClosedForm;
+    using Error<Scalar, 3, PointReference, PointSource>::accumulateClosedForm;
+    typedef typename Error<Scalar, 3, PointReference, PointSource>::Vector3 Vector3;
+    typedef typename ErrorSE2<Scalar, PointReference, PointSource>::Vector2 Vector2;
+    typedef Eigen::Matrix<Scalar, 2, 3> JacobianBlock;
+
+  protected:
+    //! Jacobian of a single correspondence (2 rows of \f$ J \f$)
+    static void computeJacobianBlock(const Vector2 &p, JacobianBlock &J);
+
+    virtual unsigned int rowsPerCorrespondence() const {
+      return 2;
+    }
+
+  public:
+
+    //! Compute the error
+    /*! \f[ e = P^*_{xy} - P_{xy} \f]
+     *
+     *  Stack the error in vectors of form
+     *
+     * \f[ eg = [ex_0; ey_0; ex_1; ey_1; ...; ex_n; ey_n]; \f]
+       */
+    virtual void computeError();
+
+    //! Jacobian of \f$ e(x) \f$, eg \f[ J = \frac{de}{dx} \f]
+    /*!
+        For a point of coordinates \f$ (X, Y) \f$, the jacobian is
+        \f[ \left( \begin{array}{ccc}
+         -1  &  0  &  Y \\
+          0  & -1  & -X \\
+          \end{array} \right)
+        \f]
+        As for the 3D errors, it is evaluated at the reference point.
+        */
+    virtual void computeJacobian();
+
+    /**
+     * @brief Streams \f$ J_i^T W_i J_i \f$ and \f$ J_i^T W_i e_i \f$ of each
+     * correspondence into the 3x3 normal equations
+     */
+    virtual void computeNormalEquations();
+
+    /**
+     * @brief Fused kernel, transforms each current point, computes its residual
+     * and accumulates its Jacobian terms in a single pass
+     */
+    virtual void computeErrorAndNormalEquations();
+
+    /**
+     * @brief Streams the weighted centroids and cross-covariance of the
+     * correspondences projected on the plane. A correspondence is weighted by
+     * the smallest weight of its two rows.
+     */
+    virtual void computeClosedForm();
+
+    //! Fused kernel, residuals and unweighted sums in a single pass
+    virtual void computeErrorAndClosedForm();
+
+    /**
+     * @brief Optimal planar rotation and translation for the current
+     * correspondences
+     *
+     * With \f$ H \f$ the weighted 2x2 cross-covariance of the centered
+     * reference and current points,
+     * \f$ \theta = atan2(H_{10} - H_{01}, H_{00} + H_{11}) \f$ and the
+     * translation maps the current centroid onto the reference one.
+     */
+    virtual Eigen::Matrix<Scalar, 4, 4> closedFormUpdate();
+
+    virtual JacobianMatrix getJacobian() const {
+      return J_;
+    }
+    virtual ErrorVector getErrorVector() const {
+      return errorVector_.head(rows_);
+    }
+};
+
+DEFINE_ERROR_POINT_TO_POINT_2D_TYPES(float, )
+DEFINE_ERROR_POINT_TO_POINT_2D_TYPES(float, f)
+
+}  // namespace icp
+
+#endif /* ICP_ERROR_POINT_TO_POINT_2D_HPP */
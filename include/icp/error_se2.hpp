@@ -0,0 +1,53 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_ERROR_SE2_HPP
+#define ICP_ERROR_SE2_HPP
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include "error.hpp"
+
+namespace icp {
+
+/**
+ * @brief Base of the planar errors, whose parameters are the SE(2) twist
+ * \f$ x = (\rho_x, \rho_y, \theta) \f$
+ *
+ * The clouds are registered in the (x, y) plane: the increments are rotations
+ * about z and translations in the plane, z is left untouched. The normal
+ * equations are 3x3 and are inverted directly. The point to point error also
+ * has an exact closed form update, see \c ErrorPointToPoint2D::closedFormUpdate().
+ *
+ * The constraints of the 3D errors do not apply: for DoF 3 they describe a
+ * rotation only. There is nothing left to fix in a planar registration
+ * anyway, use the 3D errors to constrain one axis.
+ */
+template<typename Scalar, typename PointReference, typename PointCurrent>
+class ErrorSE2 : public Error<Scalar, 3, PointReference, PointCurrent> {
+  public:
+    typedef typename Error<Scalar, 3, PointReference, PointCurrent>::Hessian Hessian;
+    typedef typename Error<Scalar, 3, PointReference, PointCurrent>::Gradient Gradient;
+    typedef Eigen::Matrix<Scalar, 2, 1> Vector2;
+
+  protected:
+    /**
+     * @brief Inverts the 3x3 normal equations of a Gauss-Newton step. Degenerate
+     * scenes (a single wall) fall back to a factorization, which leaves the
+     * unobservable direction at 0.
+     */
+    virtual Gradient solve(const Hessian &A, const Gradient &b) const;
+
+    //! Rotation of \f$ \theta \f$ about z and translation in the plane
+    virtual Eigen::Matrix<Scalar, 4, 4> expTwist(const Gradient &x) const;
+};
+
+}  // namespace icp
+
+#endif /* ICP_ERROR_SE2_HPP */
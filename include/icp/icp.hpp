@@ -16,17 +16,30 @@
 #include <pcl/common/transforms.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
-#include <pcl/kdtree/kdtree_flann.h>
 
+#include <boost/shared_ptr.hpp>
+
+#include <icp/kdtree.hpp>
+#include <icp/mestimator.hpp>
+#include <icp/reference_model.hpp>
 #include <icp/result.hpp>
+#include <icp/sampling.hpp>
+#include <icp/worker_pool.hpp>
+#include <icp/trace.hpp>
 #include <icp/error_point_to_point.hpp>
 #include <icp/error_point_to_point_sim3.hpp>
 #include <icp/error_point_to_plane.hpp>
 #include <icp/error_point_to_plane_sim3.hpp>
 #include <icp/error_point_to_point_so3.hpp>
 #include <icp/error_point_to_plane_so3.hpp>
+#include <icp/error_point_to_point_2d.hpp>
+#include <icp/error_point_to_line_2d.hpp>
 
+#include <chrono>
+#include <cmath>
 #include <fstream>
+#include <string>
+#include <vector>
 
 #define DEFINE_ICP_TYPES(Scalar, Suffix) \
   typedef Icp_<Scalar, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointXYZ> IcpPointToPoint##Suffix; \
@@ -36,11 +49,69 @@
   typedef Icp_<Scalar, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPointXYZRGBSim3> IcpPointToPointXYZRGBSim3##Suffix; \
   typedef Icp_<Scalar, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlaneNormal> IcpPointToPlane##Suffix; \
   typedef Icp_<Scalar, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlaneSim3Normal> IcpPointToPlaneSim3##Suffix; \
-  typedef IcpParameters_<Scalar> IcpParameters##Suffix;
+  typedef Icp_<Scalar, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPoint2DXYZ, ImplicitKdTree2D<pcl::PointXYZ>> IcpPointToPoint2D##Suffix; \
+  typedef Icp_<Scalar, pcl::PointNormal, pcl::PointNormal, ErrorPointToLine2DNormal, ImplicitKdTree2D<pcl::PointNormal>> IcpPointToLine2D##Suffix; \
+  typedef IcpParameters_<Scalar> IcpParameters##Suffix; \
+  typedef IcpPyramidLevel_<Scalar> IcpPyramidLevel##Suffix;
 
 
 namespace icp {
 
+/**
+ * @brief Level of the coarse to fine pyramid
+ */
+template<typename Dtype>
+struct IcpPyramidLevel_ {
+  //! Size of the voxels both clouds are downsampled to
+  Dtype resolution;
+  //! Maximum number of iterations at this level
+  unsigned int max_iter;
+  //! Maximum search distance for correspondances at this level
+  Dtype max_correspondance_distance;
+
+  IcpPyramidLevel_(Dtype resolution_ = 0, unsigned int max_iter_ = 5,
+                   Dtype max_correspondance_distance_ = std::numeric_limits<Dtype>::max()) :
+    resolution(resolution_), max_iter(max_iter_),
+    max_correspondance_distance(max_correspondance_distance_) {
+  }
+};
+
+/**
+ * @brief How the convergence criteria of \c IcpParameters_ are combined
+ */
+enum ConvergencePolicy {
+  //! Stop as soon as one of the enabled criteria is met
+  CONVERGENCE_ANY,
+  //! Stop once all the enabled criteria are met together
+  CONVERGENCE_ALL
+};
+
+/**
+ * @brief Solver computing the pose update from the current correspondences
+ */
+enum SolverType {
+  //! One Gauss-Newton step per iteration
+  SOLVER_GAUSS_NEWTON,
+  //! Damped steps, only accepted when they decrease the error
+  SOLVER_LEVENBERG_MARQUARDT,
+  //! Optimal transformation for each correspondence set, from the weighted
+  //! centroids and cross-covariance of the matches (point to point errors,
+  //! the other ones take a Gauss-Newton step)
+  SOLVER_CLOSED_FORM
+};
+
+inline const char *toString(SolverType solver) {
+  switch (solver) {
+    case SOLVER_GAUSS_NEWTON:
+      return "Gauss-Newton";
+    case SOLVER_LEVENBERG_MARQUARDT:
+      return "Levenberg-Marquardt";
+    case SOLVER_CLOSED_FORM:
+      return "closed form";
+  }
+  return "unknown";
+}
+
 /**
  * @brief Optimisation parameters for ICP
  */
@@ -48,33 +119,132 @@ template<typename Dtype>
 struct IcpParameters_ {
   //! Maximum number of allowed iterations
   unsigned int max_iter;
-  //! Stopping condition
-  /*! ICP stops when the error variation between two iteration is under
-    min_variation.
-    TODO: Add better convergence criteria */
+  // Stopping conditions: each criterion below is disabled when its threshold
+  // is 0, and they are combined according to convergence_policy. Whatever
+  // the policy, ICP also stops when the error does not decrease anymore.
+
+  //! Absolute decrease of the error norm between two iterations
+  /*! The error norm grows with the number of correspondences, prefer the
+    relative or RMSE criteria on large clouds */
   Dtype min_variation;
+  //! Decrease of the error norm relative to its previous value
+  Dtype min_relative_variation;
+  //! Rotation angle (radians) of the pose increment
+  Dtype min_rotation_increment;
+  //! Translation norm of the pose increment
+  Dtype min_translation_increment;
+  //! Root mean square error per correspondence
+  Dtype max_rmse;
+  //! How the enabled criteria are combined
+  ConvergencePolicy convergence_policy;
   //! Maximum search distance for correspondances
   /*! Do not look further than this for the kdtree search */
   Dtype max_correspondance_distance;
 
   //! Initial guess for the registration
-  Eigen::MatrixXf initial_guess;
+  Eigen::Matrix<Dtype, 4, 4> initial_guess;
 
   //! Use MEstimators?
   bool mestimator;
-
-  IcpParameters_() : max_iter(10), min_variation(10e-5),
-    max_correspondance_distance(std::numeric_limits<Dtype>::max()), mestimator(false) {
+  //! Robust kernel of the M-estimator
+  MEstimatorType mestimator_type;
+  //! Tuning constant of the kernel, relative to the scale of the residuals.
+  //! 0 uses the default one of the kernel
+  Dtype mestimator_tuning;
+  //! Estimation of the scale of the residuals
+  ScaleEstimator mestimator_scale;
+  //! Scale of the residuals when mestimator_scale is SCALE_FIXED
+  Dtype mestimator_fixed_scale;
+  //! Relative error allowed on the medians of the scale estimation
+  /*! 0 computes them exactly. Otherwise they are approximated with a
+    histogram, without copying the residuals, which is faster on large
+    clouds. 0.01 is usually plenty */
+  Dtype mestimator_scale_tolerance;
+
+  //! Solver of the pose update
+  SolverType solver;
+  //! Initial damping of the Levenberg-Marquardt solver, relative to the
+  //! diagonal of the normal equations
+  /*! The damping then adapts itself from one iteration to the next, and is
+    reset at each run */
+  Dtype lm_initial_damping;
+  //! Maximum number of rejected Levenberg-Marquardt steps per iteration
+  /*! The pose is left unchanged when no step decreases the error */
+  unsigned int lm_max_trials;
+
+  //! Maximum number of solver iterations per correspondence search
+  /*! Near convergence the correspondences barely change, several updates
+    can be computed from the same set, residuals and Jacobians being
+    evaluated again at each updated pose. 1 searches before every update */
+  unsigned int inner_iterations;
+  //! The inner iterations stop once an update moves the matched current
+  //! points by less than this distance
+  Dtype inner_min_displacement;
+  //! A new search is forced once the matched current points moved further
+  //! than this distance since the last one
+  /*! Typically a fraction of the spacing between reference points */
+  Dtype inner_max_displacement;
+
+  //! Number of threads used for the correspondence search
+  /*! The current cloud is split in as many contiguous chunks, searched by
+    threads started once per instance. Clouds too small to be worth it are
+    searched on the calling thread. 0 uses all the hardware threads
+    available */
+  unsigned int num_threads;
+
+  //! Coarse to fine pyramid, from the coarsest level to the finest one
+  /*! Each level runs on voxel-downsampled clouds and hands its estimate to
+    the next one. The full resolution optimisation, governed by max_iter and
+    max_correspondance_distance, always runs last. Empty by default: only
+    the full resolution is used */
+  std::vector<IcpPyramidLevel_<Dtype>> pyramid;
+
+  //! Selection of the current points used by each iteration
+  SamplingMethod sampling;
+  //! Number of current points kept by the sampling
+  unsigned int sample_size;
+  //! A new sample is drawn every sampling_period iterations
+  /*! 0 draws a single sample per run (and per pyramid level) */
+  unsigned int sampling_period;
+  //! Seed of the random samplings, reset at each run
+  unsigned int sampling_seed;
+
+  IcpParameters_() : max_iter(10), min_variation(10e-5), min_relative_variation(0),
+    min_rotation_increment(0), min_translation_increment(0), max_rmse(0),
+    convergence_policy(CONVERGENCE_ANY),
+    max_correspondance_distance(std::numeric_limits<Dtype>::max()), mestimator(false),
+    mestimator_type(MESTIMATOR_HUBER), mestimator_tuning(0), mestimator_scale(SCALE_MAD),
+    mestimator_fixed_scale(1), mestimator_scale_tolerance(0),
+    solver(SOLVER_GAUSS_NEWTON), lm_initial_damping(1e-4), lm_max_trials(10),
+    inner_iterations(1), inner_min_displacement(0),
+    inner_max_displacement(std::numeric_limits<Dtype>::max()), num_threads(1),
+    sampling(SAMPLING_NONE), sample_size(1000), sampling_period(1), sampling_seed(0) {
     initial_guess = Eigen::Matrix<Dtype, 4, 4>::Identity();
   }
 };
 
 template<typename Dtype>
 std::ostream &operator<<(std::ostream &s, const IcpParameters_<Dtype> &p) {
-  s << "MEstimator: " << std::boolalpha << p.mestimator
+  s << "MEstimator: " << std::boolalpha << p.mestimator << " (" << toString(p.mestimator_type)
+    << ", tuning " << p.mestimator_tuning << ", scale " << toString(p.mestimator_scale) << " within " << p.mestimator_scale_tolerance << ")"
     << "\nMax iterations: " << p.max_iter
     << "\nMin variation: " << p.min_variation
-    << "\nInitial guess (twist):\n" << p.initial_guess;
+    << "\nMin relative variation: " << p.min_relative_variation
+    << "\nMin increment: " << p.min_rotation_increment << " rad, " << p.min_translation_increment
+    << "\nMax RMSE: " << p.max_rmse
+    << "\nConvergence policy: " << (p.convergence_policy == CONVERGENCE_ANY ? "any" : "all")
+    << "\nSolver: " << toString(p.solver)
+    << " (initial damping " << p.lm_initial_damping << ", " << p.lm_max_trials << " trials)"
+    << "\nInner iterations: " << p.inner_iterations << " (displacement " << p.inner_min_displacement
+    << " to " << p.inner_max_displacement << ")"
+    << "\nThreads: " << p.num_threads
+    << "\nSampling: " << toString(p.sampling) << " (" << p.sample_size << " points, every "
+    << p.sampling_period << " iterations)"
+    << "\nPyramid:";
+  for (const IcpPyramidLevel_<Dtype> &level : p.pyramid) {
+    s << " [resolution " << level.resolution << ", " << level.max_iter << " iterations]";
+  }
+  s << "\nInitial guess (twist):\n" << p.initial_guess;
   return s;
 }
 
@@ -82,8 +252,17 @@ std::ostream &operator<<(std::ostream &s, const IcpParameters_<Dtype> &p) {
 
 /**
  * @brief Iterative Closest Point Algorithm
+ *
+ * The nearest neighbor search is selected by the \c Search_ policy, see
+ * \c KdTreeFLANNSearch for its interface. \c ImplicitKdTree is a faster
+ * alternative dedicated to ICP queries.
+ *
+ * The reference cloud and its index live in a \c ReferenceModel_, which is
+ * only read. An instance only holds the state of its own registrations, so
+ * that several instances sharing a model can run concurrently.
  */
-template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_>
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_,
+         typename Search_ = KdTreeFLANNSearch<PointReference>>
 class Icp_ {
   public:
     typedef typename pcl::PointCloud<PointReference> Pr;
@@ -92,17 +271,24 @@ class Icp_ {
     typedef typename Pr::Ptr PrPtr;
     typedef IcpParameters_<Dtype> IcpParameters;
     typedef IcpResults_<Dtype> IcpResults;
+    typedef ReferenceModel_<Dtype, PointReference, Search_> ReferenceModel;
+    typedef typename ReferenceModel::ConstPtr ReferenceModelConstPtr;
 
     typedef typename Eigen::Matrix<Dtype, Eigen::Dynamic, Eigen::Dynamic> MatrixX;
 
   protected:
     // Reference (model) point cloud. This is the cloud that we want to register
     PcPtr P_current_;
-    // kd-tree of the model point cloud
-    pcl::KdTreeFLANN<PointReference> kdtree_;
-    // Reference cloud, upon which others will be registered
-    PrPtr P_ref_;
-    PrPtr P_ref_init_inv;
+    // Reference cloud, upon which others will be registered, and its index.
+    // It is indexed once in its own frame, the initial guess is applied to the
+    // current cloud. Shared with the copies of this instance.
+    ReferenceModelConstPtr reference_;
+    // Inverse of the initial guess, brings the reference points in the frame
+    // where T_ is estimated
+    Eigen::Matrix<Dtype, 4, 4> initial_guess_inv_;
+    // Scale of the initial guess, correspondence distances are measured in the
+    // reference frame
+    Dtype initial_guess_scale_;
 
     // Instance of an error kernel used to compute the error vector, Jacobian...
     Error_ err_;
@@ -115,6 +301,68 @@ class Icp_ {
 
     unsigned int iter_;
     Eigen::Matrix<Dtype, 4, 4> T_;
+    //! Rotation angle and translation norm of the last pose increment
+    Dtype rotation_increment_;
+    Dtype translation_increment_;
+    //! Current damping of the Levenberg-Marquardt solver, and its growth
+    //! factor on rejection
+    Dtype damping_;
+    Dtype damping_growth_;
+
+    /**
+     * @brief Per-thread buffers of the correspondence search
+     */
+    struct SearchBuffer {
+      std::vector<int> indices_src;
+      std::vector<int> indices_target;
+      std::vector<Dtype> distances;
+    };
+    std::vector<SearchBuffer> search_buffers_;
+    //! Threads of the correspondence search, started by the first search and
+    //! again only when num_threads changes
+    WorkerPool search_workers_;
+
+    /**
+     * @brief Buffers reused by every \c step() and every \c run()
+     *
+     * They are sized for the current cloud when it is set, so that once warmed
+     * up an iteration does not allocate anything, whatever the M-estimator,
+     * solver, sampling and number of threads. Only recording a trace does.
+     * No intermediate point cloud is needed, the error reads the points
+     * through the correspondences.
+     */
+    struct Workspace {
+      //! Index of the current point of each correspondence
+      std::vector<int> indices_current;
+      //! Index of the matching reference point
+      std::vector<int> indices_reference;
+      std::vector<Dtype> distances;
+      //! Current points selected by the sampling
+      std::vector<int> samples;
+
+      void reserve(unsigned int n) {
+        samples.reserve(n);
+        indices_current.reserve(n);
+        indices_reference.reserve(n);
+        distances.reserve(n);
+      }
+    };
+    Workspace workspace_;
+
+    //! Reference level of each pyramid level, borrowed from the model
+    std::vector<typename ReferenceModel::LevelConstPtr> reference_pyramid_;
+    //! Downsampled current cloud of each pyramid level
+    std::vector<PcPtr> current_pyramid_;
+    //! Pyramid level used by \c step(), -1 for the full resolution
+    int level_;
+
+    //! Sampling of the current points
+    Sampler<PointCurrent> sampler_;
+    //! Cloud the sampler was last set up for
+    const Pc *sampled_cloud_;
+
+    //! Trace of the iterations, none when null
+    IcpTraceWriter::Ptr trace_;
 
   protected:
     void initialize(const PcPtr &model, const PrPtr &data,
@@ -125,20 +373,96 @@ class Icp_ {
      * @brief Finds the nearest neighbors between the current cloud (src) and the kdtree
      * (buit from the reference cloud)
      *
+     * @param search
+     *  Index of the reference cloud
      * @param src
      *  The current cloud
+     * @param samples
+     *  Indices of the current points to match, all of them when null
+     * @param T
+     *  Transformation applied on the fly to the current points
      * @param max_correspondance_distance
      *  Max distance in which closest point has to be looked for (in meters)
      * @param indices_src
      * @param indices_target
      * @param distances
      */
-    void findNearestNeighbors(const pcl::PointCloud<pcl::PointXYZ>::Ptr &src,
+    void findNearestNeighbors(const Search_ &search,
+                              const PcPtr &src,
+                              const std::vector<int> *samples,
+                              const Eigen::Matrix<Dtype, 4, 4> &T,
                               const Dtype max_correspondance_distance,
                               std::vector<int> &indices_src,
                               std::vector<int> &indices_target,
                               std::vector<Dtype> &distances);
 
+    /**
+     * @brief Nearest neighbors of the points [begin, end[ of src (or of
+     * samples), appended to the given buffer in increasing point order
+     */
+    void findNearestNeighbors(const Search_ &search,
+                              const PcPtr &src,
+                              const std::vector<int> *samples,
+                              const Eigen::Matrix<Dtype, 4, 4> &T,
+                              const Dtype max_correspondance_distance,
+                              unsigned int begin, unsigned int end,
+                              SearchBuffer &buffer) const;
+
+    /**
+     * @brief Downsamples the clouds for every level of the pyramid. The
+     * reference levels are only rebuilt when needed.
+     */
+    void buildPyramid();
+
+    /**
+     * @brief Iterates at the current level until convergence
+     *
+     * @return Why the iterations stopped
+     */
+    StopReason runLevel(unsigned int max_iter);
+
+    /**
+     * @brief Checks the convergence criteria after an iteration
+     *
+     * @param previous_error
+     *  Error of the previous iteration of the level, if any
+     *
+     * @return The criterion that was met, STOP_NONE to keep iterating
+     */
+    StopReason checkConvergence(const boost::optional<Dtype> &previous_error) const;
+
+    /**
+     * @brief Computes the error and the normal equations (or the sums of the
+     * closed form solver) at the pose set in the error, with M-estimator
+     * weights if enabled
+     */
+    void linearize();
+
+    /**
+     * @brief Upper bound of the distance a point within \c radius of the
+     * origin is moved by \c increment
+     */
+    static Dtype displacementBound(const Eigen::Matrix<Dtype, 4, 4> &increment, Dtype radius);
+
+    /**
+     * @brief Levenberg-Marquardt update from the accumulated normal equations
+     *
+     * Each candidate step is checked by re-evaluating the error at the
+     * candidate pose with the same correspondences. The damping decreases
+     * after an accepted step and increases after a rejected one.
+     *
+     * @return The accepted increment, the identity if none decreased the error
+     */
+    Eigen::Matrix<Dtype, 4, 4> levenbergMarquardtUpdate();
+
+    /**
+     * @brief Records the iteration that just ended in the trace
+     *
+     * @param num_queries Current points looked up by the iteration
+     * @param start Start of the iteration
+     */
+    void traceIteration(unsigned int num_queries, const std::chrono::steady_clock::time_point &start);
+
     void convergenceFailed() {
       r_.has_converged = false;
       r_.transformation = Eigen::Matrix<Dtype, 4, 4>::Identity();
@@ -146,14 +470,25 @@ class Icp_ {
     }
 
   public:
-    Icp_() : P_current_(new Pc()), P_ref_(new Pr()), P_ref_init_inv(new Pr()), T_(Eigen::Matrix<Dtype, 4, 4>::Identity()) {
+    Icp_() : P_current_(new Pc()), reference_(new ReferenceModel()),
+      initial_guess_inv_(Eigen::Matrix<Dtype, 4, 4>::Identity()), initial_guess_scale_(1),
+      T_(Eigen::Matrix<Dtype, 4, 4>::Identity()), rotation_increment_(0), translation_increment_(0),
+      damping_(0), damping_growth_(2), level_(-1), sampled_cloud_(0) {
+    }
+
+    /**
+     * @brief Registers against a reference model shared with other instances
+     */
+    explicit Icp_(const ReferenceModelConstPtr &model) : Icp_() {
+      setReferenceModel(model);
     }
 
     /**
      * \brief Runs the ICP algorithm with given parameters.
      *
      * Runs the ICP according to the templated \c Error_ function,
-     * and optimisation parameters \c IcpParameters_
+     * and optimisation parameters \c IcpParameters_. The levels of the
+     * pyramid, if any, are run first.
      *
      * \retval void You can get a structure containing the results of the ICP (error, registered point cloud...)
      * by using \c getResults()
@@ -161,7 +496,7 @@ class Icp_ {
     void run();
 
     /**
-     * @brief Run the next iteration of the ICP optimization
+     * @brief Run the next iteration of the ICP optimization, at full resolution
      */
     bool step();
 
@@ -175,13 +510,10 @@ class Icp_ {
      */
     void setParameters(const IcpParameters &param) {
       param_ = param;
-      //T_ = param_.initial_guess;
-      // XXX Suboptimal, to fix problem with initial transformation
-      if (P_ref_->size() != 0) {
-        Eigen::Matrix<Dtype, 4, 4> init_T_inv = param_.initial_guess.inverse();
-        pcl::transformPointCloud(*P_ref_, *P_ref_init_inv, init_T_inv);
-        kdtree_.setInputCloud(P_ref_init_inv);
-      }
+      // The reference cloud and its index are left untouched, the initial
+      // guess is only applied on the fly
+      initial_guess_inv_ = param_.initial_guess.inverse();
+      initial_guess_scale_ = std::cbrt(param_.initial_guess.template block<3, 3>(0, 0).determinant());
     }
 
     IcpParameters getParameters() const {
@@ -195,6 +527,8 @@ class Icp_ {
         LOG(WARNING) << "You are using an empty source cloud!";
       }
       P_current_ = in;
+      sampled_cloud_ = 0;
+      workspace_.reserve(in->size());
     }
     /**
      * @brief Provide a pointer to the input source (e.g., the target pointcloud
@@ -207,13 +541,45 @@ class Icp_ {
         LOG(WARNING) << "You are using an empty reference cloud!";
       }
       if (in->size() != 0) {
-        P_ref_ = in;
-        Eigen::Matrix<Dtype, 4, 4> init_T_inv = param_.initial_guess.inverse();
-        pcl::transformPointCloud(*in, *P_ref_init_inv, init_T_inv);
-        kdtree_.setInputCloud(P_ref_init_inv);
+        setReferenceModel(ReferenceModelConstPtr(new ReferenceModel(in)));
       }
     }
 
+    /**
+     * @brief Registers against an already indexed reference cloud
+     *
+     * The model is only read, it can be shared by instances running
+     * concurrently.
+     */
+    void setReferenceModel(const ReferenceModelConstPtr &model) {
+      reference_ = model;
+      reference_pyramid_.clear();
+    }
+
+    ReferenceModelConstPtr getReferenceModel() const {
+      return reference_;
+    }
+
+    /**
+     * @brief Gets the reference levels of the pyramid of the current
+     * parameters from the model
+     *
+     * Done by \c run(). The model builds each level once, whichever instance
+     * asks first.
+     */
+    void buildReferencePyramid();
+
+    /**
+     * @brief Records the iterations of the next runs and steps in a trace,
+     * see \c IcpTraceWriter. A null writer stops the recording.
+     *
+     * Copies of this instance share the writer, each instance running
+     * concurrently needs its own.
+     */
+    void setTrace(const IcpTraceWriter::Ptr &trace) {
+      trace_ = trace;
+    }
+
     void setError(Error_ err) {
       err_ = err;
     }
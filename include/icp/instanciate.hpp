@@ -25,6 +25,15 @@
 #define INSTANCIATE_ERROR_POINT_TO_PLANE_SIM3_FUN(Scalar, Src, Dst) \
   template class icp::ErrorPointToPlaneSim3<Scalar, Src, Dst>;
 
+#define INSTANCIATE_ERROR_SE2_FUN(Scalar, Src, Dst) \
+  template class icp::ErrorSE2<Scalar, Src, Dst>;
+
+#define INSTANCIATE_ERROR_POINT_TO_POINT_2D_FUN(Scalar, Src, Dst) \
+  template class icp::ErrorPointToPoint2D<Scalar, Src, Dst>;
+
+#define INSTANCIATE_ERROR_POINT_TO_LINE_2D_FUN(Scalar, Src, Dst) \
+  template class icp::ErrorPointToLine2D<Scalar, Src, Dst>;
+
 #define INSTANCIATE_CONSTRAINTS_FUN(Scalar, DegreesOfFreedom)  \
   template class icp::Constraints_<Scalar, DegreesOfFreedom>; \
   template class icp::JacobianConstraints<Scalar, DegreesOfFreedom>;
@@ -67,6 +76,17 @@
     INSTANCIATE_ERROR_POINT_TO_PLANE_SIM3_FUN(float, pcl::PointNormal, pcl::PointNormal); \
     INSTANCIATE_ERROR_POINT_TO_PLANE_SIM3_FUN(float, pcl::PointXYZ, pcl::PointNormal);
 
+#define INSTANCIATE_ERROR_SE2 \
+    INSTANCIATE_ERROR_SE2_FUN(float, pcl::PointXYZ, pcl::PointXYZ) \
+    INSTANCIATE_ERROR_SE2_FUN(float, pcl::PointNormal, pcl::PointNormal)
+
+#define INSTANCIATE_ERROR_POINT_TO_POINT_2D \
+    INSTANCIATE_ERROR_POINT_TO_POINT_2D_FUN(float, pcl::PointXYZ, pcl::PointXYZ) \
+    INSTANCIATE_ERROR_POINT_TO_POINT_2D_FUN(float, pcl::PointNormal, pcl::PointNormal)
+
+#define INSTANCIATE_ERROR_POINT_TO_LINE_2D \
+    INSTANCIATE_ERROR_POINT_TO_LINE_2D_FUN(float, pcl::PointNormal, pcl::PointNormal)
+
 #define INSTANCIATE_MAD \
   INSTANCIATE_MAD_FUN(float); \
   INSTANCIATE_MAD_VECTOR_FUN(float, pcl::PointXYZ, pcl::PointXYZ); \
@@ -85,23 +105,94 @@
     INSTANCIATE_MESTIMATOR_HUBERT_FUN(float, pcl::PointXYZ, pcl::PointNormal) \
     //INSTANCIATE_MESTIMATOR_HUBERT_FUN(double, pcl::PointXYZ)
 
+#define INSTANCIATE_MESTIMATOR_FUN(Scalar) \
+  template class icp::RobustScale_<Scalar>; \
+  template Scalar icp::defaultTuning<Scalar>(icp::MEstimatorType); \
+  template Scalar icp::robustScale<Scalar>(icp::ScaleEstimator, const Eigen::Ref<const icp::VectorX<Scalar>> &, Scalar); \
+  template void icp::robustWeights<Scalar>(icp::MEstimatorType, Scalar, const Eigen::Ref<const icp::VectorX<Scalar>> &, \
+                                           Scalar, Eigen::Ref<icp::VectorX<Scalar>>);
+
+#define INSTANCIATE_MESTIMATOR \
+  INSTANCIATE_MESTIMATOR_FUN(float) \
+  INSTANCIATE_MESTIMATOR_FUN(double)
+
 #define INSTANCIATE_CONSTRAINTS  \
+  INSTANCIATE_CONSTRAINTS_FUN(float, 3) \
   INSTANCIATE_CONSTRAINTS_FUN(float, 6) \
   INSTANCIATE_CONSTRAINTS_FUN(float, 7)
 
+#define INSTANCIATE_KDTREE_FUN(Point) \
+  template class icp::KdTreeFLANNSearch<Point>; \
+  template class icp::ImplicitKdTree<Point>; \
+  template class icp::ImplicitKdTree<Point, 2>;
+
+#define INSTANCIATE_KDTREE \
+  INSTANCIATE_KDTREE_FUN(pcl::PointXYZ) \
+  INSTANCIATE_KDTREE_FUN(pcl::PointXYZRGB) \
+  INSTANCIATE_KDTREE_FUN(pcl::PointNormal)
+
+#define INSTANCIATE_SAMPLER \
+  template class icp::Sampler<pcl::PointXYZ>; \
+  template class icp::Sampler<pcl::PointXYZRGB>; \
+  template class icp::Sampler<pcl::PointNormal>;
+
+#define INSTANCIATE_REFERENCE_MODEL_FUN(Scalar, Point) \
+  template class icp::ReferenceModel_<Scalar, Point, icp::KdTreeFLANNSearch<Point>>; \
+  template class icp::ReferenceModel_<Scalar, Point, icp::ImplicitKdTree<Point>>; \
+  template class icp::ReferenceModel_<Scalar, Point, icp::ImplicitKdTree<Point, 2>>;
+
+#define INSTANCIATE_REFERENCE_MODEL \
+  INSTANCIATE_REFERENCE_MODEL_FUN(float, pcl::PointXYZ) \
+  INSTANCIATE_REFERENCE_MODEL_FUN(float, pcl::PointXYZRGB) \
+  INSTANCIATE_REFERENCE_MODEL_FUN(float, pcl::PointNormal)
+
+#define INSTANCIATE_ICP_FUN(Scalar, Src, Dst, Error) \
+  template class icp::Icp_<Scalar, Src, Dst, Error<Scalar, Src, Dst>, icp::KdTreeFLANNSearch<Src>>; \
+  template class icp::Icp_<Scalar, Src, Dst, Error<Scalar, Src, Dst>, icp::ImplicitKdTree<Src>>;
+
+//! The planar errors come with the 2D index
+#define INSTANCIATE_ICP_2D_FUN(Scalar, Src, Dst, Error) \
+  template class icp::Icp_<Scalar, Src, Dst, Error<Scalar, Src, Dst>, icp::ImplicitKdTree<Src, 2>>;
+
 #define INSTANCIATE_ICP \
-  template class icp::Icp_<float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPoint<float, pcl::PointXYZ, pcl::PointXYZ>>; \
-  template class icp::Icp_<float, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPoint<float, pcl::PointXYZRGB, pcl::PointXYZRGB>>; \
-  template class icp::Icp_<float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointSO3<float, pcl::PointXYZ, pcl::PointXYZ>>; \
-  template class icp::Icp_<float, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPointSO3<float, pcl::PointXYZRGB, pcl::PointXYZRGB>>; \
-  template class icp::Icp_<float, pcl::PointXYZ, pcl::PointNormal, ErrorPointToPlaneSO3<float, pcl::PointXYZ, pcl::PointNormal>>; \
-  template class icp::Icp_<float, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlaneSO3<float, pcl::PointNormal, pcl::PointNormal>>; \
-  template class icp::Icp_<float, pcl::PointXYZ, pcl::PointNormal, ErrorPointToPlane<float, pcl::PointXYZ, pcl::PointNormal>>; \
-  template class icp::Icp_<float, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlane<float, pcl::PointNormal, pcl::PointNormal>>; \
-  template class icp::Icp_<float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointSim3<float, pcl::PointXYZ, pcl::PointXYZ>>; \
-  template class icp::Icp_<float, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPointSim3<float, pcl::PointXYZRGB, pcl::PointXYZRGB>>; \
-  template class icp::Icp_<float, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlaneSim3<float, pcl::PointNormal, pcl::PointNormal>>;\
-  template class icp::Icp_<float, pcl::PointXYZ, pcl::PointNormal, ErrorPointToPlaneSim3<float, pcl::PointXYZ, pcl::PointNormal>>;
+  INSTANCIATE_ICP_FUN(float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPoint) \
+  INSTANCIATE_ICP_FUN(float, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPoint) \
+  INSTANCIATE_ICP_FUN(float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointSO3) \
+  INSTANCIATE_ICP_FUN(float, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPointSO3) \
+  INSTANCIATE_ICP_FUN(float, pcl::PointXYZ, pcl::PointNormal, ErrorPointToPlaneSO3) \
+  INSTANCIATE_ICP_FUN(float, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlaneSO3) \
+  INSTANCIATE_ICP_FUN(float, pcl::PointXYZ, pcl::PointNormal, ErrorPointToPlane) \
+  INSTANCIATE_ICP_FUN(float, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlane) \
+  INSTANCIATE_ICP_FUN(float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointSim3) \
+  INSTANCIATE_ICP_FUN(float, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPointSim3) \
+  INSTANCIATE_ICP_FUN(float, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlaneSim3) \
+  INSTANCIATE_ICP_FUN(float, pcl::PointXYZ, pcl::PointNormal, ErrorPointToPlaneSim3) \
+  INSTANCIATE_ICP_2D_FUN(float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPoint2D) \
+  INSTANCIATE_ICP_2D_FUN(float, pcl::PointNormal, pcl::PointNormal, ErrorPointToPoint2D) \
+  INSTANCIATE_ICP_2D_FUN(float, pcl::PointNormal, pcl::PointNormal, ErrorPointToLine2D)
+
+#define INSTANCIATE_ICP_BATCH_FUN(Scalar, Src, Dst, Error) \
+  template class icp::IcpBatch_<Scalar, Src, Dst, Error<Scalar, Src, Dst>, icp::KdTreeFLANNSearch<Src>>; \
+  template class icp::IcpBatch_<Scalar, Src, Dst, Error<Scalar, Src, Dst>, icp::ImplicitKdTree<Src>>;
+
+#define INSTANCIATE_ICP_BATCH_2D_FUN(Scalar, Src, Dst, Error) \
+  template class icp::IcpBatch_<Scalar, Src, Dst, Error<Scalar, Src, Dst>, icp::ImplicitKdTree<Src, 2>>;
+
+#define INSTANCIATE_ICP_BATCH \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPoint) \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPoint) \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointSO3) \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPointSO3) \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointXYZ, pcl::PointNormal, ErrorPointToPlaneSO3) \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlaneSO3) \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointXYZ, pcl::PointNormal, ErrorPointToPlane) \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlane) \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointSim3) \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointXYZRGB, pcl::PointXYZRGB, ErrorPointToPointSim3) \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointNormal, pcl::PointNormal, ErrorPointToPlaneSim3) \
+  INSTANCIATE_ICP_BATCH_FUN(float, pcl::PointXYZ, pcl::PointNormal, ErrorPointToPlaneSim3) \
+  INSTANCIATE_ICP_BATCH_2D_FUN(float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPoint2D) \
+  INSTANCIATE_ICP_BATCH_2D_FUN(float, pcl::PointNormal, pcl::PointNormal, ErrorPointToLine2D)
 
 
 
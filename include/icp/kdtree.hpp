@@ -0,0 +1,138 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_KDTREE_HPP
+#define ICP_KDTREE_HPP
+
+#include <Eigen/Core>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/kdtree/kdtree_flann.h>
+#include <vector>
+
+namespace icp
+{
+
+/**
+ * @brief Nearest neighbor search policy of \c Icp_, backed by
+ * pcl::KdTreeFLANN.
+ *
+ * A search policy provides:
+ * - setInputCloud(cloud): builds the index on the reference cloud
+ * - nearest(query, max_sqr_distance, index, sqr_distance): looks for the
+ *   single nearest neighbor of query no further than sqr(max_sqr_distance).
+ *   It must be safe to call concurrently from several threads.
+ */
+template<typename PointT>
+class KdTreeFLANNSearch
+{
+  public:
+    typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+
+  protected:
+    pcl::KdTreeFLANN<PointT> kdtree_;
+
+  public:
+    void setInputCloud(const PointCloudConstPtr &cloud) {
+      kdtree_.setInputCloud(cloud);
+    }
+
+    /**
+     * @brief Looks for the nearest neighbor of query
+     *
+     * @param query
+     *  Point to look for
+     * @param max_sqr_distance
+     *  Squared distance beyond which neighbors are ignored
+     * @param index
+     *  Index of the nearest neighbor in the input cloud
+     * @param sqr_distance
+     *  Its squared distance to query
+     *
+     * @return True if a neighbor was found within max_sqr_distance
+     */
+    bool nearest(const Eigen::Vector3f &query, float max_sqr_distance,
+                 int &index, float &sqr_distance) const;
+};
+
+/**
+ * @brief Pointer-free kd-tree specialised for ICP queries
+ *
+ * The tree is implicit: the points are reordered so that each subtree is a
+ * contiguous range whose median element is the splitting node. Only the
+ * coordinates and the original indices are stored, contiguously, and small
+ * ranges are scanned linearly as leaves.
+ *
+ * Queries look for the single nearest neighbor and are bounded by the
+ * maximum correspondence distance from the start, which prunes the search
+ * instead of filtering its result. They do not allocate.
+ *
+ * Only the first Dimensions coordinates are indexed: with Dimensions = 2 the
+ * points and the queries are projected on the (x, y) plane, as planar scans
+ * are.
+ */
+template<typename PointT, int Dimensions = 3>
+class ImplicitKdTree
+{
+  public:
+    typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+    typedef Eigen::Matrix<float, Dimensions, 1> Vector;
+
+  protected:
+    //! Coordinates of the points, in tree order
+    std::vector<Vector, Eigen::aligned_allocator<Vector>> points_;
+    //! Index in the input cloud of each point of points_
+    std::vector<int> indices_;
+    //! Splitting axis of the node stored at the same position
+    std::vector<unsigned char> axes_;
+    //! Ranges of at most leaf_size_ points are not split further
+    unsigned int leaf_size_;
+
+    struct Entry {
+      Vector point;
+      int index;
+    };
+    //! Recursively splits entries[begin, end[ around its median
+    void build(std::vector<Entry> &entries, unsigned int begin, unsigned int end);
+
+  public:
+    ImplicitKdTree(unsigned int leaf_size = 8) : leaf_size_(leaf_size) {
+    }
+
+    void setInputCloud(const PointCloudConstPtr &cloud);
+
+    /**
+     * @brief Looks for the nearest neighbor of query
+     *
+     * @param query
+     *  Point to look for
+     * @param max_sqr_distance
+     *  Squared distance beyond which neighbors are ignored
+     * @param index
+     *  Index of the nearest neighbor in the input cloud
+     * @param sqr_distance
+     *  Its squared distance to query
+     *
+     * @return True if a neighbor was found within max_sqr_distance
+     */
+    bool nearest(const Eigen::Vector3f &query, float max_sqr_distance,
+                 int &index, float &sqr_distance) const;
+
+    unsigned int size() const {
+      return points_.size();
+    }
+};
+
+//! Kd-tree over the (x, y) coordinates, for planar registrations
+template<typename PointT>
+using ImplicitKdTree2D = ImplicitKdTree<PointT, 2>;
+
+}  // namespace icp
+
+#endif /* ICP_KDTREE_HPP */
@@ -24,6 +24,7 @@ template<class T> Eigen::Matrix<T, 4, 4> skew(const Eigen::Matrix<T, 6, 1> x);
 template<class T> Eigen::Matrix<T, 3, 3> expSO3(const Eigen::Matrix<T, 3, 1> vector);
 template<class T> Eigen::Matrix<T, 3, 1> lnSO3(const Eigen::Matrix<T, 3, 3> matrix);
 template<class T> Eigen::Matrix<T, 4, 4> expSE3(const Eigen::Matrix<T, 6, 1> x);
+template<class T> Eigen::Matrix<T, 4, 4> expSE2(const Eigen::Matrix<T, 3, 1> &x);
 template<class T> Eigen::Matrix<T, 4, 4> expSIM3(const Eigen::Matrix<T, 7, 1> vector);
 // SE3
 template<typename T> Eigen::Matrix<T, 4, 4> expLie(const Eigen::Matrix<T, 6, 1>& x);
@@ -299,6 +300,38 @@ inline Eigen::Matrix<T, 4, 4> expSE3(const Eigen::Matrix<T, 6, 1> x) {
   return P;
 }
 
+/**
+ * @brief Exponential of the planar twist \f$ (\rho_x, \rho_y, \theta) \f$,
+ * as a 3D transformation: a rotation of \f$ \theta \f$ about z and a
+ * translation in the (x, y) plane
+ */
+template<class T>
+inline Eigen::Matrix<T, 4, 4> expSE2(const Eigen::Matrix<T, 3, 1> &x) {
+  using std::sin;
+  using std::cos;
+  const T theta = x(2);
+  const T s = sin(theta);
+  const T c = cos(theta);
+  // V = [A -B; B A], with A = sin(t) / t and B = (1 - cos(t)) / t
+  T A, B;
+  if (theta * theta < 1e-8) {
+    A = 1 - theta * theta / 6;
+    B = theta / 2;
+  } else {
+    A = s / theta;
+    B = (1 - c) / theta;
+  }
+
+  Eigen::Matrix<T, 4, 4> P = Eigen::Matrix<T, 4, 4>::Identity();
+  P(0, 0) = c;
+  P(0, 1) = -s;
+  P(1, 0) = s;
+  P(1, 1) = c;
+  P(0, 3) = A * x(0) - B * x(1);
+  P(1, 3) = B * x(0) + A * x(1);
+  return P;
+}
+
 template<class T>
 inline Eigen::Matrix<T, 4, 4> expSIM3(const Eigen::Matrix<T, 7, 1> x) {
   Eigen::Matrix<T, 4, 4> P = Eigen::Matrix<T, 4, 4>::Identity();
@@ -13,59 +13,166 @@
 #include <pcl/point_types.h>
 #include <icp/types.hpp>
 #include <icp/eigentools.hpp>
+#include <icp/mestimator_hubert.hpp>
+#include <vector>
 
 namespace icp {
 
 template <typename Scalar>
 Scalar median_absolute_deviation(const VectorX<Scalar>& v)
 {
-  typedef typename Eigen::Matrix<Scalar, Eigen::Dynamic, 1> VectorX;
-  Scalar median_ = eigentools::median(v);
-  // Median centered residual error
-  VectorX r = (v - median_).cwiseAbs();
+  // A single copy, reused for the median centered residual error
+  VectorX<Scalar> buffer = v;
+  Scalar median_ = eigentools::medianInPlace(buffer.data(), buffer.size());
+  buffer = (v.array() - median_).abs().matrix();
 
   // median absolute deviation deviation (MAD)
-  Scalar mad = eigentools::median(r);
-  return mad;
+  return eigentools::medianInPlace(buffer.data(), buffer.size());
 }
 
 /**
- * @brief Computes huber weight for the scaled value z
+ * @brief Robust kernel of the M-estimator
  *
- * @param z Scaled residual
- * @param c
- *
- * @return hubert weight
+ * The weight of a residual r is computed from u = r / (c * scale), c being
+ * the tuning constant of the kernel.
  */
-template <typename Scalar>
-Scalar hubert_weight(const Scalar z, const Scalar c = 1.345)
-{
-  Scalar abs_z = std::abs(z);
-  if(abs_z < c)
-  {
-    return 1;
+enum MEstimatorType {
+  //! w = min(1, 1 / |u|)
+  MESTIMATOR_HUBER,
+  //! Tukey biweight, w = (1 - u^2)^2 for |u| < 1, 0 beyond
+  MESTIMATOR_TUKEY,
+  //! w = 1 / (1 + u^2)
+  MESTIMATOR_CAUCHY,
+  //! w = 1 / (1 + u^2)^2
+  MESTIMATOR_GEMAN_MCCLURE,
+  //! w = exp(-u^2)
+  MESTIMATOR_WELSCH
+};
+
+/**
+ * @brief Estimation of the scale of the residuals
+ */
+enum ScaleEstimator {
+  //! Median absolute deviation around the median of the residuals, / 0.6745
+  SCALE_MAD,
+  //! Median of the absolute residuals, / 0.6745. Residuals of a registered
+  //! cloud are centered on 0, this one is not biased by an offset.
+  SCALE_MEDIAN,
+  //! Scale given by the user, typically the sensor noise
+  SCALE_FIXED
+};
+
+inline const char *toString(MEstimatorType type) {
+  switch (type) {
+    case MESTIMATOR_HUBER:
+      return "Huber";
+    case MESTIMATOR_TUKEY:
+      return "Tukey";
+    case MESTIMATOR_CAUCHY:
+      return "Cauchy";
+    case MESTIMATOR_GEMAN_MCCLURE:
+      return "Geman-McClure";
+    case MESTIMATOR_WELSCH:
+      return "Welsch";
   }
-  else
-  {
-    return c/abs_z;
+  return "unknown";
+}
+
+inline const char *toString(ScaleEstimator estimator) {
+  switch (estimator) {
+    case SCALE_MAD:
+      return "MAD";
+    case SCALE_MEDIAN:
+      return "median";
+    case SCALE_FIXED:
+      return "fixed";
   }
+  return "unknown";
 }
 
 /**
- * @brief Compute the huber weights for the residual vector
+ * @brief Computes the scale of residual vectors, reusing its buffers from
+ * one call to the next
  *
+ * Exact medians are computed by selection in place, in a buffer that is only
+ * reallocated when it is too small. Approximate medians do not copy the
+ * residuals at all: they are counted in a histogram of geometric bins (the
+ * exponent and the first mantissa bits of each value), two passes per
+ * median. The relative error of each approximate median is below the
+ * tolerance, magnitudes more than 2^40 times smaller than the largest one
+ * being counted as 0. When the histogram would have more bins than there are
+ * values, or below a tolerance of 2^-21, the exact median is selected in the
+ * buffer instead.
+ */
+template <typename Scalar>
+class RobustScale_ {
+  protected:
+    //! Relative error allowed on the medians, 0 for exact ones
+    Scalar tolerance_;
+    std::vector<Scalar> buffer_;
+    std::vector<unsigned int> histogram_;
+
+    /**
+     * @brief Approximate median of value(0) ... value(n - 1)
+     */
+    template <typename Value>
+    Scalar approximateMedian(unsigned int n, const Value &value);
+
+  public:
+    RobustScale_() : tolerance_(0) {
+    }
+
+    void setTolerance(Scalar tolerance) {
+      tolerance_ = tolerance;
+    }
+
+    Scalar getTolerance() const {
+      return tolerance_;
+    }
+
+    /**
+     * @brief Computes the scale of the residuals
+     *
+     * @param estimator Scale estimator
+     * @param r Residual vector
+     * @param fixed_scale Scale returned by SCALE_FIXED
+     */
+    Scalar operator()(ScaleEstimator estimator, const Eigen::Ref<const VectorX<Scalar>> &r, Scalar fixed_scale);
+};
+
+/**
+ * @brief Tuning constant giving the kernel 95% efficiency on gaussian
+ * residuals (1 for Geman-McClure)
+ */
+template <typename Scalar>
+Scalar defaultTuning(MEstimatorType type);
+
+/**
+ * @brief Computes the scale of the residuals, exactly. Allocates a buffer at
+ * each call, see \c RobustScale_ to reuse it.
+ *
+ * @param estimator Scale estimator
  * @param r Residual vector
- * @param result Computed hubert weight results; should have the same size as r
- * @param scale Scale factor. Should be tau = med|r_i-med(r_i)|/0.6745
- * @param c Hubert parameter
+ * @param fixed_scale Scale returned by SCALE_FIXED
  */
 template <typename Scalar>
-void hubert_weight(const VectorX<Scalar>& r, VectorX<Scalar>& result, Scalar scale, Scalar c = 1.345)
-{
-  assert(r.size() == result.size());
-  for (int i = 0; i < r.size(); ++i) {
-    result[i] = hubert_weight(r[i] / scale, c);
-  }
-}
+Scalar robustScale(ScaleEstimator estimator, const Eigen::Ref<const VectorX<Scalar>> &r, Scalar fixed_scale);
+
+/**
+ * @brief Computes the weights of the residual vector
+ *
+ * The kernels are written as Eigen array expressions, without any branch,
+ * so that the whole vector is evaluated with SIMD instructions. When the
+ * scale is null (perfect fit) all the weights are 1.
+ *
+ * @param type Robust kernel
+ * @param tuning Tuning constant of the kernel, see \c defaultTuning()
+ * @param r Residual vector
+ * @param scale Scale of the residuals, see \c robustScale()
+ * @param w Computed weights, same size as r
+ */
+template <typename Scalar>
+void robustWeights(MEstimatorType type, Scalar tuning, const Eigen::Ref<const VectorX<Scalar>> &r,
+                   Scalar scale, Eigen::Ref<VectorX<Scalar>> w);
 
 }  // namespace icp
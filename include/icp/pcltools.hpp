@@ -1,7 +1,15 @@
 #ifndef PCLTOOLS_HPP
 #define PCLTOOLS_HPP
 
+#include <Eigen/Core>
 #include <pcl/point_cloud.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
 
 namespace pcltools
 {
@@ -68,6 +76,142 @@ void subPointCloud(const typename pcl::PointCloud<PointT>::Ptr &src,
   }
 }
 
+namespace detail
+{
+
+/**
+ * @brief Keeps, for each group of equal keys, the point closest to the
+ * centroid of the group
+ */
+template<typename PointT, typename Key>
+void keepVoxelRepresentatives(const pcl::PointCloud<PointT> &src,
+                              std::vector<std::pair<Key, unsigned int>> &keys,
+                              pcl::PointCloud<PointT> &dst) {
+  std::sort(keys.begin(), keys.end());
+
+  dst.clear();
+  for (unsigned int begin = 0; begin < keys.size();) {
+    unsigned int end = begin + 1;
+    while (end < keys.size() && keys[end].first == keys[begin].first) {
+      ++end;
+    }
+    Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+    for (unsigned int i = begin; i < end; ++i) {
+      centroid += src[keys[i].second].getVector3fMap();
+    }
+    centroid /= static_cast<float>(end - begin);
+    unsigned int closest = keys[begin].second;
+    float closest_distance = std::numeric_limits<float>::max();
+    for (unsigned int i = begin; i < end; ++i) {
+      const float d = (src[keys[i].second].getVector3fMap() - centroid).squaredNorm();
+      if (d < closest_distance) {
+        closest_distance = d;
+        closest = keys[i].second;
+      }
+    }
+    dst.push_back(src[closest]);
+    begin = end;
+  }
+}
+
+//! Number of bits needed to write v
+inline int bitWidth(uint64_t v) {
+  int bits = 0;
+  while (bits < 64 && (v >> bits) != 0) {
+    ++bits;
+  }
+  return bits;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Downsamples a point cloud on a regular voxel grid
+ *
+ * Unlike pcl::VoxelGrid, which averages every field, each occupied voxel is
+ * represented by the original point closest to its centroid, so that normals
+ * and colors remain valid. Invalid points are dropped.
+ *
+ * @param src
+ *  Cloud to downsample
+ * @param leaf_size
+ *  Size of the voxels. When not positive, every valid point is kept.
+ * @param dst
+ *  Downsampled cloud, in increasing voxel order
+ */
+template<typename PointT>
+void voxelDownsample(const typename pcl::PointCloud<PointT>::ConstPtr &src,
+                     const float leaf_size,
+                     typename pcl::PointCloud<PointT>::Ptr &dst) {
+  typedef Eigen::Matrix<int64_t, 3, 1> Voxel;
+  auto valid = [](const PointT &p) {
+    return std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+  };
+  auto voxel = [leaf_size](const PointT &p) {
+    return Voxel(static_cast<int64_t>(std::floor(p.x / leaf_size)),
+                 static_cast<int64_t>(std::floor(p.y / leaf_size)),
+                 static_cast<int64_t>(std::floor(p.z / leaf_size)));
+  };
+
+  if (leaf_size <= 0) {
+    std::vector<std::pair<uint64_t, unsigned int>> keys;
+    keys.reserve(src->size());
+    for (unsigned int i = 0; i < src->size(); i++) {
+      if (valid((*src)[i])) {
+        keys.push_back(std::make_pair(static_cast<uint64_t>(i), i));
+      }
+    }
+    detail::keepVoxelRepresentatives(*src, keys, *dst);
+    return;
+  }
+
+  // Voxel coordinates relative to the lowest ones of the cloud
+  Voxel min_voxel = Voxel::Constant(std::numeric_limits<int64_t>::max());
+  Voxel max_voxel = Voxel::Constant(std::numeric_limits<int64_t>::min());
+  for (unsigned int i = 0; i < src->size(); i++) {
+    if (valid((*src)[i])) {
+      const Voxel v = voxel((*src)[i]);
+      min_voxel = min_voxel.cwiseMin(v);
+      max_voxel = max_voxel.cwiseMax(v);
+    }
+  }
+  int bits[3] = {0, 0, 0};
+  for (int k = 0; k < 3 && min_voxel[k] <= max_voxel[k]; ++k) {
+    bits[k] = detail::bitWidth(static_cast<uint64_t>(max_voxel[k]) - static_cast<uint64_t>(min_voxel[k]));
+  }
+
+  if (bits[0] + bits[1] + bits[2] <= 64) {
+    // Packed into a single key, each axis on as many bits as its extent needs
+    std::vector<std::pair<uint64_t, unsigned int>> keys;
+    keys.reserve(src->size());
+    for (unsigned int i = 0; i < src->size(); i++) {
+      if (!valid((*src)[i])) {
+        continue;
+      }
+      const Voxel v = voxel((*src)[i]);
+      uint64_t key = 0;
+      for (int k = 0; k < 3; ++k) {
+        const uint64_t offset = static_cast<uint64_t>(v[k]) - static_cast<uint64_t>(min_voxel[k]);
+        key = bits[k] < 64 ? (key << bits[k]) | offset : offset;
+      }
+      keys.push_back(std::make_pair(key, i));
+    }
+    detail::keepVoxelRepresentatives(*src, keys, *dst);
+  } else {
+    // Too many voxels for a single key, sorted on the three coordinates
+    std::vector<std::pair<std::array<int64_t, 3>, unsigned int>> keys;
+    keys.reserve(src->size());
+    for (unsigned int i = 0; i < src->size(); i++) {
+      if (valid((*src)[i])) {
+        const Voxel v = voxel((*src)[i]);
+        const std::array<int64_t, 3> key = {{v[0], v[1], v[2]}};
+        keys.push_back(std::make_pair(key, i));
+      }
+    }
+    detail::keepVoxelRepresentatives(*src, keys, *dst);
+  }
+}
+
 template<typename Scalar, typename PointT>
 void getColumn(const typename pcl::PointCloud<PointT>::Ptr pc, Eigen::Matrix<Scalar, Eigen::Dynamic, 1> &result,
                unsigned int col) {
@@ -0,0 +1,161 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_PROFILING_HPP
+#define ICP_PROFILING_HPP
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+/**
+ * Per-stage timings and counters of the registrations, recorded when the
+ * library is built with ICP_PROFILING defined (cmake -DENABLE_PROFILING=ON).
+ * Otherwise the instrumentation compiles out and the profiles stay empty.
+ */
+#ifdef ICP_PROFILING
+  #define ICP_PROFILING_ENABLED 1
+#else
+  #define ICP_PROFILING_ENABLED 0
+#endif
+
+#define ICP_PROFILING_CONCAT_(a, b) a##b
+#define ICP_PROFILING_CONCAT(a, b) ICP_PROFILING_CONCAT_(a, b)
+
+#if ICP_PROFILING_ENABLED
+  //! Adds the wall time until the end of the enclosing scope to milliseconds
+  #define ICP_PROFILE_SCOPE(milliseconds) \
+    icp::ScopedTimer ICP_PROFILING_CONCAT(icp_scoped_timer_, __LINE__)(milliseconds)
+  //! Statement only compiled in when profiling
+  #define ICP_PROFILE(statement) statement
+#else
+  #define ICP_PROFILE_SCOPE(milliseconds)
+  #define ICP_PROFILE(statement)
+#endif
+
+namespace icp
+{
+
+/**
+ * @brief Adds the time elapsed between its construction and its destruction
+ * to a counter, in milliseconds
+ */
+class ScopedTimer {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit ScopedTimer(double &milliseconds) : milliseconds_(milliseconds), start_(Clock::now()) {
+    }
+    ~ScopedTimer() {
+      milliseconds_ += std::chrono::duration<double, std::milli>(Clock::now() - start_).count();
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+  private:
+    double &milliseconds_;
+    Clock::time_point start_;
+};
+
+/**
+ * @brief Wall time (ms) spent by each stage of one iteration, and its
+ * correspondences
+ *
+ * The current points are transformed on the fly, by the search and by the
+ * error, their transformation is part of these stages. The inner iterations
+ * add up in the iteration that searched their correspondences.
+ */
+struct IcpIterationProfile {
+  //! Pyramid level of the iteration, -1 at full resolution
+  int level;
+  //! Selection of the current points
+  double sampling_time;
+  //! Nearest neighbor search
+  double search_time;
+  //! Residuals and normal equations (Jacobians), or closed form sums
+  double error_time;
+  //! M-estimator scale and weights
+  double weights_time;
+  //! Update of the pose from the normal equations
+  double solve_time;
+  //! Current points looked up in the reference index
+  unsigned int num_queries;
+  //! Queries matched within max_correspondance_distance
+  unsigned int num_correspondences;
+  //! Queries without a reference point within max_correspondance_distance
+  unsigned int num_rejected;
+
+  IcpIterationProfile() : level(-1), sampling_time(0), search_time(0), error_time(0), weights_time(0),
+    solve_time(0), num_queries(0), num_correspondences(0), num_rejected(0) {
+  }
+
+  double totalTime() const {
+    return sampling_time + search_time + error_time + weights_time + solve_time;
+  }
+};
+
+/**
+ * @brief Profile of one run
+ */
+struct IcpProfile {
+  //! Time spent building the reference indices used by the run: the full
+  //! resolution one and those of the pyramid levels. A model shared by
+  //! several registrations is built once, this is its cost, not the cost of
+  //! this run.
+  double index_build_time;
+  //! Time spent preparing the pyramid levels in this run (downsampling, and
+  //! building the reference levels requested for the first time)
+  double pyramid_time;
+  std::vector<IcpIterationProfile> iterations;
+
+  IcpProfile() : index_build_time(0), pyramid_time(0) {
+  }
+
+  void clear() {
+    index_build_time = 0;
+    pyramid_time = 0;
+    iterations.clear();
+  }
+
+  bool empty() const {
+    return iterations.empty();
+  }
+
+  //! Sum over the iterations
+  IcpIterationProfile total() const {
+    IcpIterationProfile t;
+    for (const IcpIterationProfile &it : iterations) {
+      t.sampling_time += it.sampling_time;
+      t.search_time += it.search_time;
+      t.error_time += it.error_time;
+      t.weights_time += it.weights_time;
+      t.solve_time += it.solve_time;
+      t.num_queries += it.num_queries;
+      t.num_correspondences += it.num_correspondences;
+      t.num_rejected += it.num_rejected;
+    }
+    return t;
+  }
+};
+
+inline std::ostream &operator<<(std::ostream &s, const IcpProfile &p) {
+  const IcpIterationProfile t = p.total();
+  s << "Index build: " << p.index_build_time << " ms, pyramid: " << p.pyramid_time << " ms"
+    << "\n" << p.iterations.size() << " iterations: sampling " << t.sampling_time << " ms, search "
+    << t.search_time << " ms, error " << t.error_time << " ms, weights " << t.weights_time
+    << " ms, solve " << t.solve_time << " ms"
+    << "\nCorrespondences: " << t.num_correspondences << " of " << t.num_queries << " queries, "
+    << t.num_rejected << " rejected";
+  return s;
+}
+
+}  // namespace icp
+
+#endif /* ICP_PROFILING_HPP */
@@ -0,0 +1,129 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_REFERENCE_MODEL_HPP
+#define ICP_REFERENCE_MODEL_HPP
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <boost/shared_ptr.hpp>
+#include <mutex>
+#include <vector>
+#include <icp/kdtree.hpp>
+#include <icp/profiling.hpp>
+
+namespace icp
+{
+
+/**
+ * @brief Reference cloud and its nearest neighbor index, shared by any
+ * number of registrations
+ *
+ * The model is immutable once built: the cloud and its index are only read
+ * by \c Icp_, so one model can be used by several solvers running at the
+ * same time, in different threads, without copying it. Normals, when the
+ * point type has them (pcl::PointNormal), come with the cloud.
+ *
+ * The downsampled levels needed by coarse to fine pyramids are built on
+ * first request, once per resolution, and then shared the same way.
+ *
+ * Example:
+ * \code
+ * icp::IcpPointToPlane::ReferenceModelConstPtr model(new icp::IcpPointToPlane::ReferenceModel(scan));
+ * // In each thread
+ * icp::IcpPointToPlane icp(model);
+ * icp.setParameters(param);
+ * icp.setInputCurrent(object);
+ * icp.run();
+ * \endcode
+ */
+template<typename Dtype, typename PointReference, typename Search_ = KdTreeFLANNSearch<PointReference>>
+class ReferenceModel_ {
+  public:
+    typedef pcl::PointCloud<PointReference> Pr;
+    typedef typename Pr::ConstPtr PrConstPtr;
+    typedef boost::shared_ptr<const ReferenceModel_> ConstPtr;
+
+    /**
+     * @brief Reference cloud downsampled to a resolution, and its index
+     */
+    struct Level {
+      Dtype resolution;
+      PrConstPtr cloud;
+      Search_ search;
+      //! Time spent building the index (ms), with ICP_PROFILING
+      double build_time;
+
+      Level() : build_time(0) {
+      }
+    };
+    typedef boost::shared_ptr<const Level> LevelConstPtr;
+
+  protected:
+    PrConstPtr cloud_;
+    Search_ search_;
+    double build_time_;
+
+    //! Levels built so far, the only state modified after construction
+    mutable std::vector<LevelConstPtr> levels_;
+    mutable std::mutex levels_mutex_;
+
+  public:
+    /**
+     * @brief Empty model, nothing can be registered against it
+     */
+    ReferenceModel_() : cloud_(new Pr()), build_time_(0) {
+    }
+
+    /**
+     * @brief Indexes the reference cloud
+     *
+     * The cloud must not be modified afterwards, the model keeps a pointer to
+     * it rather than a copy.
+     */
+    explicit ReferenceModel_(const PrConstPtr &cloud);
+
+    ReferenceModel_(const ReferenceModel_ &) = delete;
+    ReferenceModel_ &operator=(const ReferenceModel_ &) = delete;
+
+    const PrConstPtr &getCloud() const {
+      return cloud_;
+    }
+
+    const Search_ &getSearch() const {
+      return search_;
+    }
+
+    unsigned int size() const {
+      return cloud_->size();
+    }
+
+    bool empty() const {
+      return cloud_->empty();
+    }
+
+    //! Time spent building the full resolution index (ms), only measured
+    //! with ICP_PROFILING
+    double getBuildTime() const {
+      return build_time_;
+    }
+
+    /**
+     * @brief Reference cloud downsampled to the given voxel size, and its
+     * index
+     *
+     * Built on the first request for this resolution, the following ones get
+     * the same level. Safe to call concurrently.
+     */
+    LevelConstPtr getLevel(Dtype resolution) const;
+};
+
+}  // namespace icp
+
+#endif /* ICP_REFERENCE_MODEL_HPP */
@@ -13,6 +13,7 @@
 #include <vector>
 #include <Eigen/Core>
 #include <boost/optional.hpp>
+#include <icp/profiling.hpp>
 
 #define DEFINE_RESULT_TYPES(Scalar, Suffix) \
   typedef IcpResults_<Scalar> IcpResults##Suffix;
@@ -20,6 +21,57 @@
 namespace icp
 {
 
+/**
+ * @brief Why the ICP stopped iterating
+ */
+enum StopReason {
+  //! The ICP has not been run
+  STOP_NONE,
+  //! max_iter iterations were run without meeting the convergence criteria
+  STOP_MAX_ITERATIONS,
+  //! The error did not decrease between two iterations. Only counts as
+  //! converged with the CONVERGENCE_ANY policy
+  STOP_NO_DECREASE,
+  //! The error decrease dropped below min_variation
+  STOP_ABSOLUTE_VARIATION,
+  //! The relative error decrease dropped below min_relative_variation
+  STOP_RELATIVE_VARIATION,
+  //! The pose increment dropped below min_rotation_increment and
+  //! min_translation_increment
+  STOP_INCREMENT,
+  //! The RMSE per correspondence dropped below max_rmse
+  STOP_RMSE,
+  //! Every enabled criterion was met (CONVERGENCE_ALL policy)
+  STOP_ALL_CRITERIA,
+  //! An iteration could not be carried out (no correspondences...), at any
+  //! level of the pyramid
+  STOP_FAILED
+};
+
+inline const char *toString(StopReason reason) {
+  switch (reason) {
+    case STOP_NONE:
+      return "none";
+    case STOP_MAX_ITERATIONS:
+      return "maximum number of iterations";
+    case STOP_NO_DECREASE:
+      return "error did not decrease";
+    case STOP_ABSOLUTE_VARIATION:
+      return "absolute error variation";
+    case STOP_RELATIVE_VARIATION:
+      return "relative error variation";
+    case STOP_INCREMENT:
+      return "pose increment";
+    case STOP_RMSE:
+      return "RMSE";
+    case STOP_ALL_CRITERIA:
+      return "all criteria";
+    case STOP_FAILED:
+      return "failure";
+  }
+  return "unknown";
+}
+
 /**
  * @brief Results for the ICP
  */
@@ -41,10 +93,27 @@ struct IcpResults_ {
   // True if ICP has converged
   bool has_converged;
 
+  //! Why the last run stopped
+  StopReason stop_reason;
+
+  //! Root mean square error per correspondence, at the last iteration
+  Dtype rmse;
+
+  //! Fraction of the current points looked up at the last iteration that
+  //! found a correspondence
+  Dtype inlier_ratio;
+
+  //! Timings and counters per iteration, only filled when the library is
+  //! built with ICP_PROFILING
+  IcpProfile profile;
+
   IcpResults_() : transformation(Eigen::Matrix<Dtype, 4, 4>::Identity()),
     relativeTransformation(Eigen::Matrix<Dtype, 4, 4>::Identity()),
     scale(1.),
-    has_converged(false) {
+    has_converged(false),
+    stop_reason(STOP_NONE),
+    rmse(0),
+    inlier_ratio(0) {
   }
 
   boost::optional<Dtype> getLastErrorVariation() const {
@@ -66,6 +135,10 @@ struct IcpResults_ {
   void clear() {
     registrationError.clear();
     transformation = Eigen::Matrix<Dtype, 4, 4>::Identity();
+    stop_reason = STOP_NONE;
+    rmse = 0;
+    inlier_ratio = 0;
+    profile.clear();
   }
 };
 
@@ -79,10 +152,16 @@ std::ostream &operator<<(std::ostream &s, const IcpResults_<Dtype> &r) {
       << "\nRelative transformation: \n"
       << r.relativeTransformation
       << "\nScale factor: " << r.scale
+      << "\nRMSE: " << r.rmse
+      << "\nInlier ratio: " << r.inlier_ratio
+      << "\nStop reason: " << toString(r.stop_reason)
       << "\nError history: ";
     for (int i = 0; i < r.registrationError.size(); ++i) {
       s << r.registrationError[i]  << ", ";
     }
+    if (!r.profile.empty()) {
+      s << "\n" << r.profile;
+    }
   } else {
     s << "Icp: No Results!";
   }
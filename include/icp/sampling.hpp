@@ -0,0 +1,109 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_SAMPLING_HPP
+#define ICP_SAMPLING_HPP
+
+#include <Eigen/Core>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <random>
+#include <vector>
+
+namespace icp
+{
+
+/**
+ * @brief Strategies used to select the current points taking part in an
+ * iteration
+ */
+enum SamplingMethod {
+  //! Every point is used
+  SAMPLING_NONE,
+  //! Evenly spaced points of the cloud
+  SAMPLING_UNIFORM,
+  //! Random points, drawn again at each resampling
+  SAMPLING_RANDOM,
+  //! Random points spread as evenly as possible over the normal directions.
+  //! Falls back to random sampling for clouds without normals.
+  SAMPLING_NORMAL_SPACE
+};
+
+inline const char *toString(SamplingMethod method) {
+  switch (method) {
+    case SAMPLING_NONE:
+      return "none";
+    case SAMPLING_UNIFORM:
+      return "uniform";
+    case SAMPLING_RANDOM:
+      return "random";
+    case SAMPLING_NORMAL_SPACE:
+      return "normal space";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Selects a fixed number of points of a cloud
+ *
+ * Everything that depends on the whole cloud is computed once in
+ * \c setInputCloud(), so that drawing a sample is linear in the sample size
+ * and not in the cloud size.
+ */
+template<typename PointT>
+class Sampler
+{
+  public:
+    typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+
+  protected:
+    unsigned int size_;
+    //! Permutation of the point indices, partially shuffled by each sample
+    std::vector<int> permutation_;
+    //! Point indices grouped by normal direction
+    std::vector<std::vector<int>> buckets_;
+    //! Points whose normal is not finite or null
+    std::vector<int> invalid_normals_;
+    //! Next unused position in each bucket, during a sample
+    std::vector<unsigned int> cursors_;
+    bool has_normals_;
+    std::mt19937 rng_;
+
+    void sampleUniform(unsigned int sample_size, std::vector<int> &indices) const;
+    void sampleRandom(unsigned int sample_size, std::vector<int> &indices);
+    void sampleNormalSpace(unsigned int sample_size, std::vector<int> &indices);
+
+  public:
+    Sampler() : size_(0), has_normals_(false) {
+    }
+
+    void setInputCloud(const PointCloudConstPtr &cloud);
+
+    //! Resets the random generator, for reproducible samples
+    void seed(unsigned int seed) {
+      rng_.seed(seed);
+    }
+
+    /**
+     * @brief Draws a sample of the input cloud
+     *
+     * @param method
+     *  Sampling strategy
+     * @param sample_size
+     *  Number of points to select. All the points are returned when the cloud
+     *  is not larger.
+     * @param indices
+     *  Indices of the selected points, in increasing order
+     */
+    void sample(SamplingMethod method, unsigned int sample_size, std::vector<int> &indices);
+};
+
+}  // namespace icp
+
+#endif /* ICP_SAMPLING_HPP */
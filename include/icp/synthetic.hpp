@@ -0,0 +1,83 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_SYNTHETIC_HPP
+#define ICP_SYNTHETIC_HPP
+
+#include <Eigen/Core>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace icp
+{
+
+/**
+ * @brief Description of a synthetic scene and of the two scans of it to
+ * register
+ */
+struct SyntheticSceneParameters {
+  //! Number of points of each cloud
+  unsigned int num_points;
+  //! Rectangles, the first one is the floor and the others stand on it
+  unsigned int num_planes;
+  //! Vertical cylinders standing on the floor
+  unsigned int num_cylinders;
+  //! Resampled copies of the model given to the generator, if any
+  unsigned int num_models;
+  //! Side of the floor (m)
+  float size;
+  //! Standard deviation of the gaussian noise added to each coordinate (m)
+  float noise;
+  //! Fraction of the points replaced by points drawn uniformly in the scene
+  float outlier_ratio;
+  //! Fraction of the scene seen by the current cloud, which is cut by a
+  //! vertical plane. 1 for a full overlap.
+  float overlap;
+  //! Ground truth: the registration of the current cloud onto the reference
+  Eigen::Matrix4f transformation;
+  //! Same seed, same scene and same clouds
+  unsigned int seed;
+
+  SyntheticSceneParameters() : num_points(10000), num_planes(4), num_cylinders(3), num_models(2), size(10.f),
+    noise(0.f), outlier_ratio(0.f), overlap(1.f), transformation(Eigen::Matrix4f::Identity()), seed(0) {
+  }
+};
+
+/**
+ * @brief Generates a reference and a current cloud of a synthetic scene,
+ * with their normals
+ *
+ * The shapes of the scene are laid out from the seed, then each cloud samples
+ * them independently, as two scans would: a point of one cloud has no exact
+ * match in the other. The points are spread over the shapes in proportion to
+ * their areas. The current cloud is finally moved by the inverse of the ground
+ * truth, registering it onto the reference gives back
+ * \c param.transformation.
+ *
+ * The random numbers are derived from the raw output of \c std::mt19937, the
+ * clouds are the same on every platform.
+ *
+ * @param param
+ *  Description of the scene
+ * @param model
+ *  Cloud with normals resampled by the model copies (a bundled model for
+ *  instance), scaled to a fifth of the scene. No copy is made without it.
+ * @param reference
+ *  Reference cloud, seeing the whole scene
+ * @param current
+ *  Current cloud, seeing param.overlap of the scene
+ */
+void generateSyntheticScene(const SyntheticSceneParameters &param,
+                            const pcl::PointCloud<pcl::PointNormal>::ConstPtr &model,
+                            pcl::PointCloud<pcl::PointNormal> &reference,
+                            pcl::PointCloud<pcl::PointNormal> &current);
+
+}  // namespace icp
+
+#endif /* ICP_SYNTHETIC_HPP */
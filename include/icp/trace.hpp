@@ -0,0 +1,217 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_TRACE_HPP
+#define ICP_TRACE_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include <boost/shared_ptr.hpp>
+#include <icp/result.hpp>
+
+/**
+ * Binary log of the iterations of the registrations, for offline analysis.
+ *
+ * The log starts with the magic "ICPT" and a uint32 version, followed by
+ * records, each starting with a uint8 type (\c TraceRecordType). Values are
+ * written in the byte order of the machine, poses as the 12 floats of their
+ * first three rows, row by row.
+ * - run begin: initial guess, uint32 number of current points, uint32 number
+ *   of reference points, uint32 max_iter
+ * - iteration: int32 level, uint32 iteration, pose, double error, double
+ *   rmse, float rotation and translation increments, uint32 queries, uint32
+ *   correspondences, float minimum, mean and maximum weight, uint32 weighted
+ *   rows, double time (ms), uint32 number of pairs, then the int32 current and
+ *   reference index of each pair
+ * - run end: uint8 stop reason, transformation, uint32 iterations
+ */
+
+namespace icp
+{
+
+enum TraceRecordType {
+  TRACE_RUN_BEGIN = 1,
+  TRACE_ITERATION = 2,
+  TRACE_RUN_END = 3
+};
+
+/**
+ * @brief Iteration of a registration, as recorded in a trace
+ */
+struct IcpTraceIteration {
+  //! Pyramid level of the iteration, -1 at full resolution
+  int level;
+  //! Number of the iteration within its level, from 1
+  unsigned int iteration;
+  //! Estimate after the iteration, maps the current points to the reference
+  Eigen::Matrix4f transformation;
+  //! Error at the pose of the correspondence search, and RMSE per
+  //! correspondence
+  double error;
+  double rmse;
+  //! Rotation angle (rad) and translation norm of the pose increment
+  float rotation_increment;
+  float translation_increment;
+  //! Current points looked up in the reference index, and those matched
+  unsigned int num_queries;
+  unsigned int num_correspondences;
+  //! Statistics of the M-estimator weights of the error rows, all 1 without
+  //! M-estimator
+  float weight_min;
+  float weight_mean;
+  float weight_max;
+  //! Error rows with a weight below 1
+  unsigned int num_downweighted;
+  //! Wall time of the iteration
+  double time;
+  //! Recorded correspondences (current index, reference index), evenly
+  //! sampled from those of the iteration
+  std::vector<std::pair<int, int>> correspondences;
+
+  IcpTraceIteration() : level(-1), iteration(0), transformation(Eigen::Matrix4f::Identity()), error(0), rmse(0),
+    rotation_increment(0), translation_increment(0), num_queries(0), num_correspondences(0), weight_min(1),
+    weight_mean(1), weight_max(1), num_downweighted(0), time(0) {
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/**
+ * @brief Registration read from a trace
+ */
+struct IcpTraceRun {
+  Eigen::Matrix4f initial_guess;
+  unsigned int num_current;
+  unsigned int num_reference;
+  unsigned int max_iter;
+  std::vector<IcpTraceIteration, Eigen::aligned_allocator<IcpTraceIteration>> iterations;
+  //! Whether the end of the run was recorded. Otherwise the process stopped
+  //! during the run, or \c Icp_::step() was called on its own.
+  bool complete;
+  StopReason stop_reason;
+  Eigen::Matrix4f transformation;
+
+  IcpTraceRun() : initial_guess(Eigen::Matrix4f::Identity()), num_current(0), num_reference(0), max_iter(0),
+    complete(false), stop_reason(STOP_NONE), transformation(Eigen::Matrix4f::Identity()) {
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/**
+ * @brief Writes the trace of the registrations of an \c Icp_ instance
+ *
+ * Each record is serialized in a buffer reused from one record to the next
+ * and written at once, the file stream buffers the writes. A writer must not
+ * be shared by instances running concurrently.
+ */
+class IcpTraceWriter {
+  public:
+    typedef boost::shared_ptr<IcpTraceWriter> Ptr;
+
+    /**
+     * @param path Log file, overwritten
+     * @param max_correspondences Number of correspondences recorded per
+     * iteration, evenly sampled. 0 records none.
+     */
+    explicit IcpTraceWriter(const std::string &path, unsigned int max_correspondences = 0);
+
+    bool isOpen() const {
+      return file_.good();
+    }
+    unsigned int getMaxCorrespondences() const {
+      return max_correspondences_;
+    }
+
+    void beginRun(const Eigen::Matrix4f &initial_guess, unsigned int num_current, unsigned int num_reference,
+                  unsigned int max_iter);
+
+    /**
+     * @brief Records an iteration. The correspondences of \c it are ignored,
+     * they are sampled from the indices.
+     */
+    void writeIteration(const IcpTraceIteration &it, const std::vector<int> &indices_current,
+                        const std::vector<int> &indices_reference);
+
+    void endRun(StopReason stop_reason, const Eigen::Matrix4f &transformation, unsigned int iterations);
+
+    void flush() {
+      file_.flush();
+    }
+
+  private:
+    template<typename T>
+    void put(const T &value) {
+      const char *bytes = reinterpret_cast<const char *>(&value);
+      buffer_.insert(buffer_.end(), bytes, bytes + sizeof(T));
+    }
+    void putPose(const Eigen::Matrix4f &T);
+    void writeRecord();
+
+    std::ofstream file_;
+    unsigned int max_correspondences_;
+    std::vector<char> buffer_;
+};
+
+/**
+ * @brief Reads a trace one registration at a time
+ */
+class IcpTraceReader {
+  public:
+    //! Opens the log and checks its header
+    explicit IcpTraceReader(const std::string &path);
+
+    bool isOpen() const {
+      return valid_;
+    }
+    //! Whether reading stopped on a truncated or corrupted record
+    bool isTruncated() const {
+      return truncated_;
+    }
+
+    /**
+     * @brief Reads the next registration
+     *
+     * Iterations recorded outside of a run are gathered in an incomplete run.
+     *
+     * @return false at the end of the log, or if it is truncated or corrupted
+     */
+    bool read(IcpTraceRun &run);
+
+  private:
+    template<typename T>
+    bool get(T &value) {
+      return static_cast<bool>(file_.read(reinterpret_cast<char *>(&value), sizeof(T)));
+    }
+    bool getPose(Eigen::Matrix4f &T);
+    bool readIteration(IcpTraceIteration &it);
+
+    std::ifstream file_;
+    bool valid_;
+    bool truncated_;
+    //! Size of the file, bounds the counts read from it
+    std::streamoff size_;
+};
+
+/**
+ * @brief Reads all the registrations of a trace
+ *
+ * @return false if the log could not be opened or is truncated, the runs read
+ * until then are kept
+ */
+bool readTrace(const std::string &path, std::vector<IcpTraceRun, Eigen::aligned_allocator<IcpTraceRun>> &runs);
+
+}  // namespace icp
+
+#endif /* ICP_TRACE_HPP */
@@ -0,0 +1,94 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_WORKER_POOL_HPP
+#define ICP_WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace icp
+{
+
+/**
+ * @brief Worker threads started once and woken up for each parallel job
+ *
+ * A job runs job(t) for every t in [0, size()), the calling thread taking
+ * t = 0. Running a job neither starts threads nor allocates, so that it can
+ * be used by every iteration of a registration.
+ *
+ * A copy does not share the threads of the original, it starts its own ones
+ * on its first \c resize().
+ */
+class WorkerPool
+{
+  public:
+    WorkerPool() : generation_(0), pending_(0), stopping_(false), job_(0), invoke_(0) {
+    }
+    WorkerPool(const WorkerPool &) : WorkerPool() {
+    }
+    WorkerPool &operator=(const WorkerPool &) {
+      return *this;
+    }
+    ~WorkerPool();
+
+    //! Number of threads taking part in a job, the calling one included
+    unsigned int size() const {
+      return threads_.size() + 1;
+    }
+
+    /**
+     * @brief Starts or stops workers so that jobs run on num_threads threads,
+     * the calling one included. Nothing happens when the size is unchanged.
+     */
+    void resize(unsigned int num_threads);
+
+    /**
+     * @brief Runs job(t) for t in [0, size()) and waits for all of them. The
+     * first exception thrown by a thread is rethrown.
+     */
+    template<typename Job>
+    void run(const Job &job) {
+      run(&invoke<Job>, &job);
+    }
+
+  private:
+    typedef void (*Invoke)(const void *job, unsigned int t);
+
+    template<typename Job>
+    static void invoke(const void *job, unsigned int t) {
+      (*static_cast<const Job *>(job))(t);
+    }
+
+    void run(Invoke invoke, const void *job);
+    void work(unsigned int t, uint64_t generation);
+    void stop();
+
+    std::vector<std::thread> threads_;
+    //! Exception thrown by each thread during the current job
+    std::vector<std::exception_ptr> exceptions_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    //! Incremented for each job, workers run a job when it changes
+    uint64_t generation_;
+    //! Workers still running the current job
+    unsigned int pending_;
+    bool stopping_;
+    const void *job_;
+    Invoke invoke_;
+};
+
+}  // namespace icp
+
+#endif /* ICP_WORKER_POOL_HPP */
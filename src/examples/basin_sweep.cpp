@@ -0,0 +1,458 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+/**
+ * Measures the convergence basin of each error and solver: the model is
+ * registered onto itself from initial guesses perturbed on a grid of rotation
+ * and translation magnitudes, and each cell of the grid records the success
+ * rate, the number of iterations and the time of the registrations.
+ *
+ * A registration succeeds when it comes back within --tolerance-rotation rad,
+ * --tolerance-translation times the diagonal of the model, and 1% of scale
+ * of the identity. Each cell draws --trials perturbations about random axes and
+ * along random directions, with a fixed seed. The planar variants get planar
+ * perturbations. The rotation-only SO3 error can not recover a translation, so
+ * it is swept over the rotations only, with a single null translation column.
+ * It never meets a requirement with a positive --basin-translation.
+ *
+ * A configuration (error and solver) meets the requirement when every cell up
+ * to --basin-rotation and --basin-translation succeeds at least --success-rate
+ * of the times. The qualifying configurations are ranked by their mean time
+ * over these cells, the first one is the cheapest that meets the requirement.
+ *
+ * The registrations run in parallel, on --threads worker threads (all the
+ * hardware threads by default), each with its own Icp_ instance sharing the
+ * reference model, as IcpBatch_ does. The times are measured with all the
+ * workers busy, use --threads 1 for the times of isolated registrations.
+ *
+ * Writes the cells as JSON, and the tables and the ranking on the standard
+ * error.
+ *
+ * Usage: icp_basin_sweep [--trials N] [--max-iter N] [--threads N]
+ *                        [--rotations a,b,...] [--translations a,b,...]
+ *                        [--success-rate r] [--basin-rotation a]
+ *                        [--basin-translation t] [--tolerance-rotation a]
+ *                        [--tolerance-translation t] [--output file.json]
+ *                        [model.pcd]
+ * Defaults to ../models/valve.pcd
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pcl/common/common.h>
+#include <pcl/io/pcd_io.h>
+#include <icp/eigentools.hpp>
+#include <icp/icp.hpp>
+#include <icp/logging.hpp>
+#include "bench_tools.hpp"
+
+typedef std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> TransformationVector;
+
+struct Options {
+  unsigned int trials;
+  unsigned int max_iter;
+  unsigned int num_threads;
+  //! Perturbation magnitudes of the grid: rotation angles (rad) and
+  //! translations (fractions of the diagonal of the model)
+  std::vector<float> rotations;
+  std::vector<float> translations;
+  //! Distance to the identity below which a registration succeeds
+  float tolerance_rotation;
+  float tolerance_translation;
+  //! Requirement on the configurations
+  float success_rate;
+  float basin_rotation;
+  float basin_translation;
+
+  Options() : trials(10), max_iter(50), num_threads(0), tolerance_rotation(0.01f), tolerance_translation(0.01f),
+    success_rate(0.95f), basin_rotation(0.2f), basin_translation(0.1f) {
+    const float r[] = {0.05f, 0.1f, 0.2f, 0.3f, 0.5f, 0.8f};
+    const float t[] = {0.f, 0.05f, 0.1f, 0.2f, 0.3f};
+    rotations.assign(r, r + 6);
+    translations.assign(t, t + 5);
+  }
+};
+
+/**
+ * @brief Registrations of one perturbation magnitude
+ */
+struct Cell {
+  float rotation;
+  float translation;
+  unsigned int runs;
+  unsigned int successes;
+  unsigned int iterations;
+  double time;
+
+  Cell(float rotation, float translation) : rotation(rotation), translation(translation), runs(0), successes(0),
+    iterations(0), time(0) {
+  }
+
+  double successRate() const {
+    return runs ? static_cast<double>(successes) / runs : 0.;
+  }
+};
+
+/**
+ * @brief An error and a solver, with the cells of its sweep
+ */
+struct Configuration {
+  std::string variant;
+  icp::SolverType solver;
+  //! Rotation-only errors are swept without translations, which they can
+  //! not recover
+  bool rotation_only;
+  //! Translations of the cells, the columns of the grid
+  std::vector<float> translations;
+  std::vector<Cell> cells;
+
+  //! Whether every cell within the required basin meets the success rate,
+  //! and the mean time of their registrations
+  bool meets(const Options &options, double &mean_time) const {
+    // The translations of the basin were not swept
+    bool ok = !rotation_only || options.basin_translation <= 0;
+    unsigned int runs = 0;
+    double time = 0;
+    for (const Cell &c : cells) {
+      if (c.rotation <= options.basin_rotation && c.translation <= options.basin_translation) {
+        ok = ok && c.successRate() >= options.success_rate;
+        runs += c.runs;
+        time += c.time;
+      }
+    }
+    mean_time = runs ? time / runs : 0.;
+    return ok && runs > 0;
+  }
+};
+
+/**
+ * @brief Initial guesses of a cell, drawn from its own seed so that the grid
+ * does not depend on the order of the sweep
+ */
+void makeInitialGuesses(float rotation, float translation, unsigned int cell, unsigned int trials, bool planar,
+                        TransformationVector &guesses) {
+  std::mt19937 rng(1000 + cell);
+  std::normal_distribution<float> normal;
+  for (unsigned int t = 0; t < trials; ++t) {
+    Eigen::Vector3f axis(normal(rng), normal(rng), normal(rng));
+    Eigen::Vector3f direction(normal(rng), normal(rng), normal(rng));
+    if (planar) {
+      axis = Eigen::Vector3f::UnitZ();
+      direction.z() = 0;
+    }
+    axis.normalize();
+    direction.normalize();
+    const Eigen::Affine3f T = Eigen::Translation3f(translation * direction) * Eigen::AngleAxisf(rotation, axis);
+    guesses.push_back(T.matrix());
+  }
+}
+
+/**
+ * @brief Sweeps the grid with one variant and one solver
+ */
+template<typename Icp>
+Configuration sweep(const std::string &variant, icp::SolverType solver,
+                    const typename Icp::ReferenceModelConstPtr &model, const typename Icp::PcPtr &current,
+                    float diagonal, bool planar, bool rotation_only, const Options &options) {
+  Configuration configuration;
+  configuration.variant = variant;
+  configuration.solver = solver;
+  configuration.rotation_only = rotation_only;
+  if (rotation_only) {
+    configuration.translations.push_back(0.f);
+  } else {
+    configuration.translations = options.translations;
+  }
+
+  // Every registration of the sweep, cell by cell
+  TransformationVector guesses;
+  for (float rotation : options.rotations) {
+    for (float translation : configuration.translations) {
+      makeInitialGuesses(rotation, translation * diagonal, configuration.cells.size(), options.trials, planar,
+                         guesses);
+      configuration.cells.push_back(Cell(rotation, translation));
+    }
+  }
+  const unsigned int n = guesses.size();
+  std::vector<unsigned int> iterations(n);
+  std::vector<double> times(n);
+  std::vector<char> successes(n);
+
+  typename Icp::IcpParameters param;
+  param.max_iter = options.max_iter;
+  param.solver = solver;
+  const float tolerance_translation = options.tolerance_translation * diagonal;
+
+  // Each worker takes the next registration until there is none left
+  std::atomic<unsigned int> next(0);
+  auto worker = [&]() {
+    Icp icp(model);
+    icp.setInputCurrent(current);
+    for (unsigned int i = next++; i < n; i = next++) {
+      typename Icp::IcpParameters p = param;
+      p.initial_guess = guesses[i];
+      icp.setParameters(p);
+      Clock::time_point start = Clock::now();
+      icp.run();
+      times[i] = elapsedMs(start);
+      const typename Icp::IcpResults r = icp.getResults();
+      iterations[i] = r.registrationError.size();
+      // The current cloud is the reference, the registration should come back
+      // to the identity
+      const Eigen::Matrix4f &T = r.transformation;
+      const float scale = std::cbrt(T.topLeftCorner<3, 3>().determinant());
+      successes[i] = eigentools::rotationAngle(T) < options.tolerance_rotation
+                     && T.topRightCorner<3, 1>().norm() < tolerance_translation && std::abs(scale - 1) < 0.01f;
+    }
+  };
+  unsigned int num_threads = options.num_threads;
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, n);
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < num_threads; ++t) {
+    threads.push_back(std::thread(worker));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (unsigned int i = 0; i < n; ++i) {
+    Cell &cell = configuration.cells[i / options.trials];
+    ++cell.runs;
+    cell.successes += successes[i];
+    cell.iterations += iterations[i];
+    cell.time += times[i];
+  }
+  return configuration;
+}
+
+/**
+ * @brief Sweeps the grid with one variant and each of its solvers
+ *
+ * The closed form only applies to the point to point errors, the others
+ * would fall back to Gauss-Newton. Rotation-only errors are only swept
+ * along the rotations.
+ */
+template<typename Icp>
+void sweepVariant(const std::string &variant, const typename Icp::PrPtr &cloud, float diagonal, bool planar,
+                  bool closed_form, bool rotation_only, const Options &options,
+                  std::vector<Configuration> &configurations) {
+  std::cerr << "Sweeping " << variant << (rotation_only ? " (rotations only)" : "") << std::endl;
+  const typename Icp::ReferenceModelConstPtr model(new typename Icp::ReferenceModel(cloud));
+  configurations.push_back(sweep<Icp>(variant, icp::SOLVER_GAUSS_NEWTON, model, cloud, diagonal, planar,
+                                      rotation_only, options));
+  configurations.push_back(sweep<Icp>(variant, icp::SOLVER_LEVENBERG_MARQUARDT, model, cloud, diagonal, planar,
+                                      rotation_only, options));
+  if (closed_form) {
+    configurations.push_back(sweep<Icp>(variant, icp::SOLVER_CLOSED_FORM, model, cloud, diagonal, planar,
+                                        rotation_only, options));
+  }
+}
+
+/**
+ * @brief Success rates of a configuration, rotations in rows and translations
+ * in columns
+ */
+void printTable(const Configuration &c, const Options &options, std::ostream &s) {
+  s << "\n" << c.variant << ", " << toString(c.solver) << ": success rate (%)"
+    << (c.rotation_only ? ", rotations only" : "") << "\n"
+    << std::setw(10) << "rot \\ tr";
+  for (float translation : c.translations) {
+    s << std::setw(7) << translation;
+  }
+  s << std::setw(12) << "time (ms)" << "\n";
+  unsigned int i = 0;
+  for (float rotation : options.rotations) {
+    s << std::setw(10) << rotation;
+    unsigned int runs = 0;
+    double time = 0;
+    for (unsigned int j = 0; j < c.translations.size(); ++j, ++i) {
+      const Cell &cell = c.cells[i];
+      s << std::setw(7) << static_cast<int>(std::round(100 * cell.successRate()));
+      runs += cell.runs;
+      time += cell.time;
+    }
+    s << std::setw(12) << std::setprecision(3) << (runs ? time / runs : 0.) << "\n";
+  }
+}
+
+int main(int argc, char *argv[]) {
+#if GLOG_ENABLED
+  google::InitGoogleLogging(argv[0]);
+#endif
+
+  Options options;
+  std::string output;
+  std::string path = "../models/valve.pcd";
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--trials" && i + 1 < argc) {
+      options.trials = std::atoi(argv[++i]);
+    } else if (arg == "--max-iter" && i + 1 < argc) {
+      options.max_iter = std::atoi(argv[++i]);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      options.num_threads = std::atoi(argv[++i]);
+    } else if ((arg == "--rotations" || arg == "--translations") && i + 1 < argc) {
+      std::vector<float> &values = arg == "--rotations" ? options.rotations : options.translations;
+      values.clear();
+      std::istringstream list(argv[++i]);
+      std::string value;
+      while (std::getline(list, value, ',')) {
+        values.push_back(std::atof(value.c_str()));
+      }
+    } else if (arg == "--success-rate" && i + 1 < argc) {
+      options.success_rate = std::atof(argv[++i]);
+    } else if (arg == "--basin-rotation" && i + 1 < argc) {
+      options.basin_rotation = std::atof(argv[++i]);
+    } else if (arg == "--basin-translation" && i + 1 < argc) {
+      options.basin_translation = std::atof(argv[++i]);
+    } else if (arg == "--tolerance-rotation" && i + 1 < argc) {
+      options.tolerance_rotation = std::atof(argv[++i]);
+    } else if (arg == "--tolerance-translation" && i + 1 < argc) {
+      options.tolerance_translation = std::atof(argv[++i]);
+    } else if (arg == "--output" && i + 1 < argc) {
+      output = argv[++i];
+    } else {
+      path = arg;
+    }
+  }
+  if (options.trials == 0 || options.rotations.empty() || options.translations.empty()) {
+    LOG(ERROR) << "The grid is empty";
+    return 1;
+  }
+
+  PointCloudXYZ::Ptr loaded(new PointCloudXYZ());
+  if (pcl::io::loadPCDFile<pcl::PointXYZ>(path.c_str(), *loaded) == -1) {
+    LOG(ERROR) << "Could't read file " << path;
+    return 1;
+  }
+  // Every variant gets the points with a normal
+  PointCloudNormal::Ptr normal = estimateNormals(loaded);
+  PointCloudXYZ::Ptr xyz(new PointCloudXYZ());
+  PointCloudXYZRGB::Ptr xyzrgb(new PointCloudXYZRGB());
+  pcl::copyPointCloud(*normal, *xyz);
+  pcl::copyPointCloud(*normal, *xyzrgb);
+  Eigen::Vector4f min, max;
+  pcl::getMinMax3D(*xyz, min, max);
+  const float diagonal = (max - min).head<3>().norm();
+
+  std::vector<Configuration> configurations;
+  sweepVariant<icp::IcpPointToPoint>("IcpPointToPoint", xyz, diagonal, false, true, false, options, configurations);
+  sweepVariant<icp::IcpPointToPointSO3>("IcpPointToPointSO3", xyz, diagonal, false, true, true, options,
+                                        configurations);
+  sweepVariant<icp::IcpPointToPointXYZRGB>("IcpPointToPointXYZRGB", xyzrgb, diagonal, false, true, false, options,
+                                           configurations);
+  sweepVariant<icp::IcpPointToPointSim3>("IcpPointToPointSim3", xyz, diagonal, false, true, false, options,
+                                         configurations);
+  sweepVariant<icp::IcpPointToPointXYZRGBSim3>("IcpPointToPointXYZRGBSim3", xyzrgb, diagonal, false, true, false,
+                                               options, configurations);
+  sweepVariant<icp::IcpPointToPlane>("IcpPointToPlane", normal, diagonal, false, false, false, options,
+                                     configurations);
+  sweepVariant<icp::IcpPointToPlaneSim3>("IcpPointToPlaneSim3", normal, diagonal, false, false, false, options,
+                                         configurations);
+  sweepVariant<icp::IcpPointToPoint2D>("IcpPointToPoint2D", xyz, diagonal, true, false, false, options,
+                                       configurations);
+  sweepVariant<icp::IcpPointToLine2D>("IcpPointToLine2D", normal, diagonal, true, false, false, options,
+                                      configurations);
+
+  std::ofstream file;
+  if (!output.empty()) {
+    file.open(output.c_str());
+    if (!file) {
+      LOG(ERROR) << "Could't open " << output;
+      return 1;
+    }
+  }
+  std::ostream &s = output.empty() ? std::cout : file;
+
+  // Cheapest first among the configurations meeting the requirement
+  std::vector<std::pair<double, unsigned int>> ranking;
+  for (unsigned int i = 0; i < configurations.size(); ++i) {
+    double mean_time;
+    if (configurations[i].meets(options, mean_time)) {
+      ranking.push_back(std::make_pair(mean_time, i));
+    }
+  }
+  std::sort(ranking.begin(), ranking.end());
+
+  JsonWriter json(s);
+  json.beginObject();
+  json.key("model").value(path);
+  json.key("points").value(static_cast<unsigned int>(xyz->size()));
+  json.key("diagonal").value(diagonal);
+  json.key("trials").value(options.trials);
+  json.key("max_iter").value(options.max_iter);
+  json.key("tolerance_rotation").value(options.tolerance_rotation);
+  json.key("tolerance_translation").value(options.tolerance_translation);
+  json.key("success_rate").value(options.success_rate);
+  json.key("basin_rotation").value(options.basin_rotation);
+  json.key("basin_translation").value(options.basin_translation);
+  json.key("configurations").beginArray();
+  for (const Configuration &c : configurations) {
+    double mean_time;
+    const bool meets = c.meets(options, mean_time);
+    json.beginObject();
+    json.key("variant").value(c.variant);
+    json.key("solver").value(toString(c.solver));
+    json.key("rotation_only").value(c.rotation_only);
+    json.key("meets_requirement").value(meets);
+    json.key("basin_mean_time_ms").value(mean_time);
+    json.key("cells").beginArray();
+    for (const Cell &cell : c.cells) {
+      json.beginObject();
+      json.key("rotation").value(cell.rotation);
+      json.key("translation").value(cell.translation);
+      json.key("runs").value(cell.runs);
+      json.key("success_rate").value(cell.successRate());
+      json.key("mean_iterations").value(cell.runs ? static_cast<double>(cell.iterations) / cell.runs : 0.);
+      json.key("mean_time_ms").value(cell.runs ? cell.time / cell.runs : 0.);
+      json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+  }
+  json.endArray();
+  json.key("ranking").beginArray();
+  for (const std::pair<double, unsigned int> &r : ranking) {
+    json.beginObject();
+    json.key("variant").value(configurations[r.second].variant);
+    json.key("solver").value(toString(configurations[r.second].solver));
+    json.key("basin_mean_time_ms").value(r.first);
+    json.endObject();
+  }
+  json.endArray();
+  json.endObject();
+  s << std::endl;
+
+  for (const Configuration &c : configurations) {
+    printTable(c, options, std::cerr);
+  }
+  std::cerr << "\nMeeting " << 100 * options.success_rate << "% of successes up to " << options.basin_rotation
+            << " rad and " << options.basin_translation << " of the diagonal, cheapest first:\n";
+  for (const std::pair<double, unsigned int> &r : ranking) {
+    std::cerr << "  " << std::left << std::setw(28) << configurations[r.second].variant << std::setw(22)
+              << toString(configurations[r.second].solver) << std::right << std::setw(10) << r.first << " ms\n";
+  }
+  if (ranking.empty()) {
+    std::cerr << "  none\n";
+  }
+  return 0;
+}
@@ -0,0 +1,225 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_BENCH_TOOLS_HPP
+#define ICP_BENCH_TOOLS_HPP
+
+/**
+ * Helpers shared by the benchmarks: timing, JSON output, perturbations of the
+ * models and normal estimation.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <Eigen/Geometry>
+#include <pcl/common/io.h>
+#include <pcl/common/transforms.h>
+#include <pcl/features/normal_3d_omp.h>
+#include <pcl/point_types.h>
+#include <pcl/search/kdtree.h>
+
+typedef pcl::PointCloud<pcl::PointXYZ> PointCloudXYZ;
+typedef pcl::PointCloud<pcl::PointXYZRGB> PointCloudXYZRGB;
+typedef pcl::PointCloud<pcl::PointNormal> PointCloudNormal;
+typedef std::chrono::steady_clock Clock;
+
+inline double elapsedMs(const Clock::time_point &start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/**
+ * @brief Minimal JSON writer, takes care of the separators and of the
+ * indentation
+ */
+class JsonWriter {
+  public:
+    explicit JsonWriter(std::ostream &s) : s_(s), first_(true), in_member_(false), depth_(0) {
+      s_ << std::setprecision(9);
+    }
+
+    void beginObject() {
+      separate();
+      open('{');
+    }
+    void endObject() {
+      close('}');
+    }
+    void beginArray() {
+      separate();
+      open('[');
+    }
+    void endArray() {
+      close(']');
+    }
+
+    //! Name of the next member, within an object
+    JsonWriter &key(const std::string &name) {
+      separate();
+      s_ << "\"" << name << "\": ";
+      in_member_ = true;
+      return *this;
+    }
+
+    void value(const std::string &v) {
+      separate();
+      s_ << "\"";
+      for (char c : v) {
+        if (c == '"' || c == '\\') {
+          s_ << '\\';
+        }
+        s_ << c;
+      }
+      s_ << "\"";
+    }
+    void value(const char *v) {
+      value(std::string(v));
+    }
+    void value(bool v) {
+      separate();
+      s_ << (v ? "true" : "false");
+    }
+    void value(unsigned int v) {
+      separate();
+      s_ << v;
+    }
+    //! Non finite numbers are not valid JSON, they are written as null
+    void value(double v) {
+      separate();
+      if (std::isfinite(v)) {
+        s_ << v;
+      } else {
+        s_ << "null";
+      }
+    }
+
+  private:
+    void open(char c) {
+      s_ << c;
+      first_ = true;
+      ++depth_;
+    }
+    void close(char c) {
+      --depth_;
+      if (!first_) {
+        s_ << "\n" << std::string(2 * depth_, ' ');
+      }
+      s_ << c;
+      first_ = false;
+    }
+    //! Comma and new line before the next value, unless it follows its key
+    void separate() {
+      if (in_member_) {
+        in_member_ = false;
+        return;
+      }
+      if (depth_ > 0) {
+        s_ << (first_ ? "\n" : ",\n") << std::string(2 * depth_, ' ');
+      }
+      first_ = false;
+    }
+
+    std::ostream &s_;
+    bool first_;
+    bool in_member_;
+    unsigned int depth_;
+};
+
+struct Perturbation {
+  //! Magnitude class (small, medium, large)
+  std::string name;
+  unsigned int trial;
+  //! Rotation angle (rad) and translation (fraction of the model diagonal)
+  float rotation;
+  float translation;
+  //! Ground truth, the transformation the ICP should find
+  Eigen::Matrix4f transformation;
+};
+
+/**
+ * @brief Perturbations of increasing magnitude, each one drawn trials times
+ * about random axes and along random directions
+ */
+inline std::vector<Perturbation> makePerturbations(float diagonal, unsigned int trials, bool planar) {
+  struct Magnitude {
+    const char *name;
+    float rotation;
+    float translation;
+  };
+  const Magnitude magnitudes[] = {{"small", 0.02f, 0.01f}, {"medium", 0.05f, 0.03f}, {"large", 0.1f, 0.05f}};
+
+  std::vector<Perturbation> perturbations;
+  std::mt19937 rng(42);
+  std::normal_distribution<float> normal;
+  for (const Magnitude &m : magnitudes) {
+    for (unsigned int t = 0; t < trials; ++t) {
+      // Drawn the same way in the planar case, to keep the same sequence
+      Eigen::Vector3f axis(normal(rng), normal(rng), normal(rng));
+      Eigen::Vector3f direction(normal(rng), normal(rng), normal(rng));
+      if (planar) {
+        axis = Eigen::Vector3f::UnitZ();
+        direction.z() = 0;
+      }
+      axis.normalize();
+      direction.normalize();
+
+      Perturbation p;
+      p.name = m.name;
+      p.trial = t;
+      p.rotation = m.rotation;
+      p.translation = m.translation;
+      Eigen::Affine3f T = Eigen::Translation3f(m.translation * diagonal * direction)
+                          * Eigen::AngleAxisf(m.rotation, axis);
+      p.transformation = T.matrix();
+      perturbations.push_back(p);
+    }
+  }
+  return perturbations;
+}
+
+template<typename PointT>
+void transformCloud(const pcl::PointCloud<PointT> &in, pcl::PointCloud<PointT> &out, const Eigen::Matrix4f &T) {
+  pcl::transformPointCloud(in, out, T);
+}
+
+inline void transformCloud(const PointCloudNormal &in, PointCloudNormal &out, const Eigen::Matrix4f &T) {
+  pcl::transformPointCloudWithNormals(in, out, T);
+}
+
+/**
+ * @brief Estimates the normals of the model, as the icp_methods example does
+ *
+ * Points without a normal (not enough neighbors) are dropped.
+ */
+inline PointCloudNormal::Ptr estimateNormals(const PointCloudXYZ::Ptr &cloud) {
+  pcl::NormalEstimationOMP<pcl::PointXYZ, pcl::Normal> ne;
+  ne.setKSearch(20);
+  pcl::search::KdTree<pcl::PointXYZ>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZ>());
+  ne.setSearchMethod(tree);
+  ne.setInputCloud(cloud);
+  pcl::PointCloud<pcl::Normal> normals;
+  ne.compute(normals);
+
+  PointCloudNormal with_normals;
+  pcl::concatenateFields(*cloud, normals, with_normals);
+  PointCloudNormal::Ptr out(new PointCloudNormal());
+  out->reserve(with_normals.size());
+  for (const pcl::PointNormal &p : with_normals.points) {
+    if (p.getNormalVector3fMap().allFinite()) {
+      out->push_back(p);
+    }
+  }
+  return out;
+}
+
+#endif /* ICP_BENCH_TOOLS_HPP */
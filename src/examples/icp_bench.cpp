@@ -0,0 +1,431 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+/**
+ * Runs every ICP variant of DEFINE_ICP_TYPES on the bundled models, for
+ * controlled perturbations of the model, and reports as JSON:
+ * - the time spent indexing the reference cloud,
+ * - the time of each registration, its number of iterations and the time per
+ *   iteration,
+ * - the throughput, in current points processed per second (points times
+ *   iterations over the registration time),
+ * - the error of the registration with respect to the perturbation,
+ * - the time spent in each stage when the library is built with
+ *   ENABLE_PROFILING.
+ *
+ * The current cloud is the model moved by the inverse of the perturbation, the
+ * ICP should find the perturbation. Perturbations are drawn with a fixed seed,
+ * their axes and directions are the same from one version to the next. The
+ * planar variants get planar perturbations (yaw and translation in the (x, y)
+ * plane).
+ *
+ * With --synthetic, synthetic scenes of the given sizes are registered as
+ * well, for the time and memory scaling curves (see icp/synthetic.hpp). The
+ * scenes are made of planes, cylinders and resampled copies of
+ * --synthetic-model, with the requested noise, outliers and overlap.
+ *
+ * Usage: icp_bench [--trials N] [--max-iter N] [--output file.json]
+ *                  [--synthetic N,N,...] [--noise m] [--outliers ratio]
+ *                  [--overlap ratio] [--seed N] [--synthetic-model model.pcd]
+ *                  [model.pcd ...]
+ * Defaults to the models of ../models/, or to none with --synthetic
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <pcl/common/common.h>
+#include <pcl/io/pcd_io.h>
+#include <icp/eigentools.hpp>
+#include <icp/icp.hpp>
+#include <icp/logging.hpp>
+#include <icp/synthetic.hpp>
+#include "bench_tools.hpp"
+
+struct Options {
+  unsigned int trials;
+  unsigned int max_iter;
+  Options() : trials(3), max_iter(50) {
+  }
+};
+
+/**
+ * @brief Resident memory of the process (MB), 0 where /proc is not available
+ *
+ * Memory released by a variant may be kept by the allocator and reused by the
+ * next ones, the growth measured around a variant is a lower bound of its
+ * footprint.
+ */
+double residentMemoryMb() {
+  std::ifstream statm("/proc/self/statm");
+  unsigned long size = 0, resident = 0;
+  if (!(statm >> size >> resident)) {
+    return 0;
+  }
+  return resident * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1024 * 1024);
+}
+
+//! Peak resident memory of the process (MB)
+double peakMemoryMb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.;
+}
+
+/**
+ * @brief Totals over the runs of a variant
+ */
+struct Summary {
+  unsigned int runs;
+  unsigned int converged;
+  unsigned int iterations;
+  double time;
+  double points;
+
+  Summary() : runs(0), converged(0), iterations(0), time(0), points(0) {
+  }
+
+  void write(JsonWriter &json) const {
+    json.key("summary").beginObject();
+    json.key("runs").value(runs);
+    json.key("converged").value(converged);
+    json.key("mean_iterations").value(runs ? static_cast<double>(iterations) / runs : 0.);
+    json.key("time_per_iteration_ms").value(iterations ? time / iterations : 0.);
+    json.key("points_per_second").value(points / time * 1000);
+    json.endObject();
+  }
+};
+
+/**
+ * @brief Registers the current cloud onto the shared model, writes the
+ * measures of the run in the current JSON object
+ */
+template<typename Icp>
+void runRegistration(const typename Icp::ReferenceModelConstPtr &model, const typename Icp::PcPtr &current,
+                     const Eigen::Matrix4f &ground_truth, const Options &options, JsonWriter &json,
+                     Summary &summary) {
+  typename Icp::IcpParameters param;
+  param.max_iter = options.max_iter;
+
+  const double memory = residentMemoryMb();
+  Icp icp(model);
+  icp.setParameters(param);
+  icp.setInputCurrent(current);
+  Clock::time_point start = Clock::now();
+  icp.run();
+  const double time = elapsedMs(start);
+  const typename Icp::IcpResults r = icp.getResults();
+
+  const unsigned int iterations = r.registrationError.size();
+  const double points = static_cast<double>(current->size()) * iterations;
+  const Eigen::Matrix4f error = r.transformation * ground_truth.inverse();
+  ++summary.runs;
+  summary.converged += r.has_converged;
+  summary.iterations += iterations;
+  summary.time += time;
+  summary.points += points;
+
+  json.key("time_ms").value(time);
+  json.key("iterations").value(iterations);
+  json.key("time_per_iteration_ms").value(iterations ? time / iterations : 0.);
+  json.key("points_per_second").value(points / time * 1000);
+  json.key("memory_mb").value(residentMemoryMb() - memory);
+  json.key("converged").value(r.has_converged);
+  json.key("stop_reason").value(toString(r.stop_reason));
+  json.key("rmse").value(r.rmse);
+  json.key("rotation_error").value(eigentools::rotationAngle(error));
+  json.key("translation_error").value(
+    (r.transformation.template topRightCorner<3, 1>() - ground_truth.topRightCorner<3, 1>()).norm());
+  json.key("scale").value(r.scale);
+#if ICP_PROFILING_ENABLED
+  const icp::IcpIterationProfile stages = r.profile.total();
+  json.key("stages_ms").beginObject();
+  json.key("pyramid").value(r.profile.pyramid_time);
+  json.key("sampling").value(stages.sampling_time);
+  json.key("search").value(stages.search_time);
+  json.key("error").value(stages.error_time);
+  json.key("weights").value(stages.weights_time);
+  json.key("solve").value(stages.solve_time);
+  json.endObject();
+  json.key("correspondences").value(stages.num_correspondences);
+  json.key("rejected").value(stages.num_rejected);
+#endif
+}
+
+/**
+ * @brief Builds the shared reference model of a variant, writes its name and
+ * the cost of its index
+ */
+template<typename Icp>
+typename Icp::ReferenceModelConstPtr buildModel(const std::string &name, const typename Icp::PrPtr &reference,
+    bool planar, JsonWriter &json) {
+  // Built once, shared by the registrations as in a tracking loop
+  const double memory = residentMemoryMb();
+  Clock::time_point start = Clock::now();
+  typename Icp::ReferenceModelConstPtr model(new typename Icp::ReferenceModel(reference));
+  const double index_build_time = elapsedMs(start);
+
+  json.key("name").value(name);
+  json.key("planar").value(planar);
+  json.key("index_build_ms").value(index_build_time);
+  json.key("index_memory_mb").value(residentMemoryMb() - memory);
+  return model;
+}
+
+/**
+ * @brief Registers the perturbed model against the model with one variant,
+ * writes one record per perturbation
+ */
+template<typename Icp>
+void benchmarkVariant(const std::string &name, const typename Icp::PrPtr &reference, float diagonal,
+                      bool planar, const Options &options, JsonWriter &json) {
+  json.beginObject();
+  const typename Icp::ReferenceModelConstPtr model = buildModel<Icp>(name, reference, planar, json);
+  json.key("runs").beginArray();
+
+  Summary summary;
+  for (const Perturbation &p : makePerturbations(diagonal, options.trials, planar)) {
+    typename Icp::PcPtr current(new typename Icp::Pc());
+    transformCloud(*reference, *current, Eigen::Matrix4f(p.transformation.inverse()));
+
+    json.beginObject();
+    json.key("perturbation").value(p.name);
+    json.key("trial").value(p.trial);
+    json.key("rotation").value(p.rotation);
+    json.key("translation").value(p.translation * diagonal);
+    runRegistration<Icp>(model, current, p.transformation, options, json, summary);
+    json.endObject();
+  }
+  json.endArray();
+  summary.write(json);
+  json.endObject();
+}
+
+/**
+ * @brief Registers a synthetic pair with one variant, trials times
+ */
+template<typename Icp>
+void benchmarkSyntheticVariant(const std::string &name, const PointCloudNormal::Ptr &reference_normal,
+                               const PointCloudNormal::Ptr &current_normal, const Eigen::Matrix4f &ground_truth,
+                               bool planar, const Options &options, JsonWriter &json) {
+  typename Icp::PrPtr reference(new typename Icp::Pr());
+  typename Icp::PcPtr current(new typename Icp::Pc());
+  pcl::copyPointCloud(*reference_normal, *reference);
+  pcl::copyPointCloud(*current_normal, *current);
+
+  json.beginObject();
+  const typename Icp::ReferenceModelConstPtr model = buildModel<Icp>(name, reference, planar, json);
+  json.key("runs").beginArray();
+  Summary summary;
+  for (unsigned int t = 0; t < options.trials; ++t) {
+    json.beginObject();
+    json.key("trial").value(t);
+    runRegistration<Icp>(model, current, ground_truth, options, json, summary);
+    json.endObject();
+  }
+  json.endArray();
+  summary.write(json);
+  json.endObject();
+}
+
+void benchmark(const std::string &path, const Options &options, JsonWriter &json) {
+  PointCloudXYZ::Ptr xyz(new PointCloudXYZ());
+  PointCloudXYZRGB::Ptr xyzrgb(new PointCloudXYZRGB());
+  if (pcl::io::loadPCDFile<pcl::PointXYZ>(path.c_str(), *xyz) == -1 ||
+      pcl::io::loadPCDFile<pcl::PointXYZRGB>(path.c_str(), *xyzrgb) == -1) {
+    LOG(ERROR) << "Could't read file " << path;
+    return;
+  }
+  Eigen::Vector4f min, max;
+  pcl::getMinMax3D(*xyz, min, max);
+  const float diagonal = (max - min).head<3>().norm();
+
+  Clock::time_point start = Clock::now();
+  PointCloudNormal::Ptr normal = estimateNormals(xyz);
+  const double normals_time = elapsedMs(start);
+  std::cerr << path << ": " << xyz->size() << " points" << std::endl;
+
+  json.beginObject();
+  json.key("model").value(path);
+  json.key("points").value(static_cast<unsigned int>(xyz->size()));
+  json.key("points_with_normals").value(static_cast<unsigned int>(normal->size()));
+  json.key("diagonal").value(diagonal);
+  json.key("normals_ms").value(normals_time);
+  json.key("variants").beginArray();
+  benchmarkVariant<icp::IcpPointToPoint>("IcpPointToPoint", xyz, diagonal, false, options, json);
+  benchmarkVariant<icp::IcpPointToPointSO3>("IcpPointToPointSO3", xyz, diagonal, false, options, json);
+  benchmarkVariant<icp::IcpPointToPointXYZRGB>("IcpPointToPointXYZRGB", xyzrgb, diagonal, false, options, json);
+  benchmarkVariant<icp::IcpPointToPointSim3>("IcpPointToPointSim3", xyz, diagonal, false, options, json);
+  benchmarkVariant<icp::IcpPointToPointXYZRGBSim3>("IcpPointToPointXYZRGBSim3", xyzrgb, diagonal, false, options,
+      json);
+  benchmarkVariant<icp::IcpPointToPlane>("IcpPointToPlane", normal, diagonal, false, options, json);
+  benchmarkVariant<icp::IcpPointToPlaneSim3>("IcpPointToPlaneSim3", normal, diagonal, false, options, json);
+  benchmarkVariant<icp::IcpPointToPoint2D>("IcpPointToPoint2D", xyz, diagonal, true, options, json);
+  benchmarkVariant<icp::IcpPointToLine2D>("IcpPointToLine2D", normal, diagonal, true, options, json);
+  json.endArray();
+  json.endObject();
+}
+
+/**
+ * @brief Registers synthetic scenes of increasing sizes with every variant,
+ * for the time and memory scaling curves
+ *
+ * The planar variants register a second current cloud, moved by the planar
+ * part of the ground truth.
+ */
+void benchmarkSynthetic(const icp::SyntheticSceneParameters &scene, const std::vector<unsigned int> &sizes,
+                        const PointCloudNormal::ConstPtr &model, const Options &options, JsonWriter &json) {
+  const float size = scene.size;
+  const Eigen::Matrix4f transformation = eigentools::createTransformationMatrix(
+      0.01f * size, -0.005f * size, 0.002f * size, 0.02f, -0.01f, 0.05f);
+  const Eigen::Matrix4f planar_transformation = eigentools::createTransformationMatrix(
+      0.01f * size, -0.005f * size, 0.f, 0.f, 0.f, 0.05f);
+
+  for (unsigned int num_points : sizes) {
+    icp::SyntheticSceneParameters param = scene;
+    param.num_points = num_points;
+    param.transformation = transformation;
+    PointCloudNormal::Ptr reference(new PointCloudNormal()), current(new PointCloudNormal());
+    const double memory = residentMemoryMb();
+    Clock::time_point start = Clock::now();
+    icp::generateSyntheticScene(param, model, *reference, *current);
+    const double generation_time = elapsedMs(start);
+    std::cerr << "Synthetic scene: " << num_points << " points" << std::endl;
+
+    json.beginObject();
+    json.key("points").value(num_points);
+    json.key("generation_ms").value(generation_time);
+    json.key("clouds_memory_mb").value(residentMemoryMb() - memory);
+    json.key("variants").beginArray();
+    benchmarkSyntheticVariant<icp::IcpPointToPoint>("IcpPointToPoint", reference, current, transformation, false,
+        options, json);
+    benchmarkSyntheticVariant<icp::IcpPointToPointSO3>("IcpPointToPointSO3", reference, current, transformation,
+        false, options, json);
+    benchmarkSyntheticVariant<icp::IcpPointToPointXYZRGB>("IcpPointToPointXYZRGB", reference, current,
+        transformation, false, options, json);
+    benchmarkSyntheticVariant<icp::IcpPointToPointSim3>("IcpPointToPointSim3", reference, current, transformation,
+        false, options, json);
+    benchmarkSyntheticVariant<icp::IcpPointToPointXYZRGBSim3>("IcpPointToPointXYZRGBSim3", reference, current,
+        transformation, false, options, json);
+    benchmarkSyntheticVariant<icp::IcpPointToPlane>("IcpPointToPlane", reference, current, transformation, false,
+        options, json);
+    benchmarkSyntheticVariant<icp::IcpPointToPlaneSim3>("IcpPointToPlaneSim3", reference, current, transformation,
+        false, options, json);
+
+    param.transformation = planar_transformation;
+    icp::generateSyntheticScene(param, model, *reference, *current);
+    benchmarkSyntheticVariant<icp::IcpPointToPoint2D>("IcpPointToPoint2D", reference, current, planar_transformation,
+        true, options, json);
+    benchmarkSyntheticVariant<icp::IcpPointToLine2D>("IcpPointToLine2D", reference, current, planar_transformation,
+        true, options, json);
+    json.endArray();
+    json.key("peak_memory_mb").value(peakMemoryMb());
+    json.endObject();
+  }
+}
+
+int main(int argc, char *argv[]) {
+#if GLOG_ENABLED
+  google::InitGoogleLogging(argv[0]);
+#endif
+
+  Options options;
+  std::string output;
+  std::vector<std::string> models;
+  std::vector<unsigned int> synthetic_sizes;
+  icp::SyntheticSceneParameters scene;
+  std::string synthetic_model = "../models/valve.pcd";
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--synthetic" && i + 1 < argc) {
+      std::istringstream sizes(argv[++i]);
+      std::string size;
+      while (std::getline(sizes, size, ',')) {
+        synthetic_sizes.push_back(std::strtoul(size.c_str(), 0, 10));
+      }
+    } else if (arg == "--noise" && i + 1 < argc) {
+      scene.noise = std::atof(argv[++i]);
+    } else if (arg == "--outliers" && i + 1 < argc) {
+      scene.outlier_ratio = std::atof(argv[++i]);
+    } else if (arg == "--overlap" && i + 1 < argc) {
+      scene.overlap = std::atof(argv[++i]);
+    } else if (arg == "--seed" && i + 1 < argc) {
+      scene.seed = std::atoi(argv[++i]);
+    } else if (arg == "--synthetic-model" && i + 1 < argc) {
+      synthetic_model = argv[++i];
+    } else if (arg == "--trials" && i + 1 < argc) {
+      options.trials = std::atoi(argv[++i]);
+    } else if (arg == "--max-iter" && i + 1 < argc) {
+      options.max_iter = std::atoi(argv[++i]);
+    } else if (arg == "--output" && i + 1 < argc) {
+      output = argv[++i];
+    } else {
+      models.push_back(arg);
+    }
+  }
+  if (models.empty() && synthetic_sizes.empty()) {
+    models.push_back("../models/valve.pcd");
+    models.push_back("../models/valve_simulation.pcd");
+    models.push_back("../models/teapot.pcd");
+    models.push_back("../models/ladder_robot/ladder_jr13_arnaud.pcd");
+  }
+
+  std::ofstream file;
+  if (!output.empty()) {
+    file.open(output.c_str());
+    if (!file) {
+      LOG(ERROR) << "Could't open " << output;
+      return 1;
+    }
+  }
+  std::ostream &s = output.empty() ? std::cout : file;
+
+  JsonWriter json(s);
+  json.beginObject();
+  json.key("profiling").value(static_cast<bool>(ICP_PROFILING_ENABLED));
+  json.key("trials").value(options.trials);
+  json.key("max_iter").value(options.max_iter);
+  json.key("models").beginArray();
+  for (const std::string &model : models) {
+    benchmark(model, options, json);
+  }
+  json.endArray();
+
+  if (!synthetic_sizes.empty()) {
+    // The model copies are optional, the scene is made of planes and
+    // cylinders without them
+    PointCloudXYZ::Ptr xyz(new PointCloudXYZ());
+    PointCloudNormal::Ptr model;
+    if (pcl::io::loadPCDFile<pcl::PointXYZ>(synthetic_model.c_str(), *xyz) == -1) {
+      LOG(WARNING) << "Could't read file " << synthetic_model << ", the synthetic scenes have no model copy";
+      synthetic_model.clear();
+    } else {
+      model = estimateNormals(xyz);
+    }
+    json.key("synthetic").beginObject();
+    json.key("model").value(synthetic_model);
+    json.key("size").value(scene.size);
+    json.key("noise").value(scene.noise);
+    json.key("outlier_ratio").value(scene.outlier_ratio);
+    json.key("overlap").value(scene.overlap);
+    json.key("seed").value(scene.seed);
+    json.key("scenes").beginArray();
+    benchmarkSynthetic(scene, synthetic_sizes, model, options, json);
+    json.endArray();
+    json.endObject();
+  }
+  json.endObject();
+  s << std::endl;
+  return 0;
+}
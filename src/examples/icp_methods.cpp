@@ -97,6 +97,8 @@ int main(int argc, char *argv[]) {
   icp_param.mestimator = true;
   icp_param.max_iter = 20;
   icp_param.min_variation = 10e-5;
+  // The initial guesses below are far from the solution
+  icp_param.solver = icp::SOLVER_LEVENBERG_MARQUARDT;
   icp_param.initial_guess = Eigen::Matrix4f::Identity();
   // Far
   //icp_param.initial_guess(0, 3) = 1.6;
@@ -0,0 +1,154 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+/**
+ * Compares the nearest neighbor search policies of the ICP on real models:
+ * construction time, query time (unbounded and bounded by the correspondence
+ * distance) and complete registrations.
+ *
+ * Usage: icp_kdtree_benchmark [model.pcd ...]
+ * Defaults to ../models/teapot.pcd and ../models/valve_simulation.pcd
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <pcl/common/common.h>
+#include <pcl/common/transforms.h>
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_types.h>
+#include <icp/eigentools.hpp>
+#include <icp/icp.hpp>
+#include <icp/kdtree.hpp>
+#include <icp/logging.hpp>
+
+typedef pcl::PointCloud<pcl::PointXYZ> PointCloudXYZ;
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMs(const Clock::time_point &start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/**
+ * @brief Searches the nearest neighbor of every query, returns the time in ms
+ * and the number of neighbors found
+ */
+template<typename Search>
+double benchmarkQueries(const Search &search, const std::vector<Eigen::Vector3f> &queries,
+                        float max_sqr_distance, unsigned int repeat, unsigned int &found) {
+  int index;
+  float sqr_distance;
+  Clock::time_point start = Clock::now();
+  for (unsigned int r = 0; r < repeat; ++r) {
+    found = 0;
+    for (const Eigen::Vector3f &q : queries) {
+      found += search.nearest(q, max_sqr_distance, index, sqr_distance);
+    }
+  }
+  return elapsedMs(start) / repeat;
+}
+
+template<typename Icp>
+double benchmarkIcp(const PointCloudXYZ::Ptr &reference, const PointCloudXYZ::Ptr &current,
+                    const icp::IcpParametersf &param, icp::IcpResults &results) {
+  Icp icp;
+  icp.setParameters(param);
+  icp.setInputReference(reference);
+  icp.setInputCurrent(current);
+  Clock::time_point start = Clock::now();
+  icp.run();
+  const double t = elapsedMs(start);
+  results = icp.getResults();
+  return t;
+}
+
+void benchmark(const std::string &model) {
+  PointCloudXYZ::Ptr reference(new PointCloudXYZ());
+  if (pcl::io::loadPCDFile<pcl::PointXYZ>(model.c_str(), *reference) == -1) {
+    LOG(ERROR) << "Could't read file " << model;
+    return;
+  }
+
+  // The current cloud is the model slightly moved
+  Eigen::Vector4f min, max;
+  pcl::getMinMax3D(*reference, min, max);
+  const float diagonal = (max - min).head<3>().norm();
+  Eigen::Matrix4f transformation = eigentools::createTransformationMatrix(0.01f * diagonal, -0.01f * diagonal,
+                                   0.005f * diagonal, 0.05f, -0.03f, 0.02f);
+  PointCloudXYZ::Ptr current(new PointCloudXYZ());
+  pcl::transformPointCloud(*reference, *current, transformation);
+  std::vector<Eigen::Vector3f> queries;
+  queries.reserve(current->size());
+  for (const pcl::PointXYZ &p : current->points) {
+    queries.push_back(p.getVector3fMap());
+  }
+
+  std::cout << "\n" << model << ": " << reference->size() << " points\n";
+  std::cout << std::fixed << std::setprecision(3);
+
+  const unsigned int repeat = 5;
+  icp::KdTreeFLANNSearch<pcl::PointXYZ> flann;
+  icp::ImplicitKdTree<pcl::PointXYZ> implicit;
+  Clock::time_point start = Clock::now();
+  flann.setInputCloud(reference);
+  const double build_flann = elapsedMs(start);
+  start = Clock::now();
+  implicit.setInputCloud(reference);
+  const double build_implicit = elapsedMs(start);
+  std::cout << "  build (ms)            FLANN " << std::setw(10) << build_flann
+            << "   implicit " << std::setw(10) << build_implicit << "\n";
+
+  const float bounds[] = {std::numeric_limits<float>::infinity(), 0.01f * diagonal};
+  for (float bound : bounds) {
+    unsigned int found_flann, found_implicit;
+    const double t_flann = benchmarkQueries(flann, queries, bound * bound, repeat, found_flann);
+    const double t_implicit = benchmarkQueries(implicit, queries, bound * bound, repeat, found_implicit);
+    std::cout << "  queries (ms), max " << std::setw(8) << bound
+              << " FLANN " << std::setw(10) << t_flann << " (" << found_flann << " found)"
+              << "   implicit " << std::setw(10) << t_implicit << " (" << found_implicit << " found)"
+              << "   speedup x" << t_flann / t_implicit << "\n";
+  }
+
+  icp::IcpParametersf param;
+  param.max_iter = 30;
+  icp::IcpResults r_flann, r_implicit;
+  const double icp_flann = benchmarkIcp<icp::IcpPointToPoint>(reference, current, param, r_flann);
+  const double icp_implicit =
+    benchmarkIcp<icp::Icp_<float, pcl::PointXYZ, pcl::PointXYZ, icp::ErrorPointToPointXYZ, icp::ImplicitKdTree<pcl::PointXYZ>>>
+    (reference, current, param, r_implicit);
+  std::cout << "  icp run (ms)          FLANN " << std::setw(10) << icp_flann
+            << "   implicit " << std::setw(10) << icp_implicit
+            << "   (" << r_flann.registrationError.size() << " / " << r_implicit.registrationError.size()
+            << " iterations)\n";
+  std::cout << "  transformation difference: "
+            << (r_flann.transformation - r_implicit.transformation).norm() << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+#if GLOG_ENABLED
+  google::InitGoogleLogging(argv[0]);
+#endif
+
+  std::vector<std::string> models;
+  for (int i = 1; i < argc; ++i) {
+    models.push_back(argv[i]);
+  }
+  if (models.empty()) {
+    models.push_back("../models/teapot.pcd");
+    models.push_back("../models/valve_simulation.pcd");
+  }
+
+  for (const std::string &model : models) {
+    benchmark(model);
+  }
+  return 0;
+}
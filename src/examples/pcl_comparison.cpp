@@ -0,0 +1,484 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+/**
+ * Compares this library with the registrations of PCL on the same inputs:
+ * - IcpPointToPoint with pcl::IterativeClosestPoint,
+ * - IcpPointToPlane with pcl::IterativeClosestPointWithNormals,
+ * - IcpPointToPlane with pcl::GeneralizedIterativeClosestPoint.
+ *
+ * The inputs are the bundled models moved by the perturbations of icp_bench
+ * and, with --synthetic, synthetic scenes of the given sizes. Every method
+ * gets the same clouds, the same maximum number of iterations and the same
+ * maximum correspondence distance. The stopping criteria are matched to the
+ * default convergence criteria of PCL: a pose increment below
+ * acos(0.99999) rad and the translation epsilon, or a relative variation of
+ * the error below 1e-5. No M-estimator is used.
+ *
+ * The wall time includes the indexing of the reference cloud, which PCL does
+ * within align(). The RMSE is computed the same way for every method, over
+ * the current points with a reference point within the correspondence
+ * distance. The pose error is the translation error plus the rotation error
+ * times half the diagonal of the scene, an upper bound of the displacement of
+ * its points.
+ *
+ * Writes the measures and a summary per comparison as JSON, and a table of the
+ * summary on the standard error.
+ *
+ * Usage: icp_pcl_comparison [--trials N] [--max-iter N] [--output file.json]
+ *                           [--synthetic N,N,...] [model.pcd ...]
+ * Defaults to the models of ../models/
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <pcl/common/common.h>
+#include <pcl/io/pcd_io.h>
+#include <pcl/registration/gicp.h>
+#include <pcl/registration/icp.h>
+#include <icp/eigentools.hpp>
+#include <icp/icp.hpp>
+#include <icp/kdtree.hpp>
+#include <icp/logging.hpp>
+#include <icp/synthetic.hpp>
+#include "bench_tools.hpp"
+
+/**
+ * @brief Settings shared by both stacks
+ */
+struct Settings {
+  unsigned int trials;
+  unsigned int max_iter;
+  //! Maximum correspondence distance, fraction of the diagonal of the scene
+  float max_distance_ratio;
+  //! Translation increment below which the registration stops, fraction of
+  //! the diagonal of the scene
+  float translation_epsilon_ratio;
+  //! Rotation increment below which the registration stops (rad), the one of
+  //! the default convergence criteria of PCL
+  float rotation_epsilon;
+  //! Relative variation of the error below which the registration stops
+  float relative_variation;
+
+  Settings() : trials(3), max_iter(50), max_distance_ratio(0.2f), translation_epsilon_ratio(1e-5f),
+    rotation_epsilon(std::acos(0.99999f)), relative_variation(1e-5f) {
+  }
+};
+
+/**
+ * @brief One registration problem
+ */
+struct Input {
+  std::string name;
+  std::string perturbation;
+  unsigned int trial;
+  float diagonal;
+  Eigen::Matrix4f ground_truth;
+  PointCloudXYZ::Ptr reference, current;
+  PointCloudNormal::Ptr reference_normal, current_normal;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<Input, Eigen::aligned_allocator<Input>> InputVector;
+typedef std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> TransformationVector;
+
+struct Result {
+  std::string name;
+  std::string stack;
+  double time;
+  unsigned int iterations;
+  bool converged;
+  double rmse;
+  double rotation_error;
+  double translation_error;
+  double pose_error;
+};
+
+/**
+ * @brief Measures a registration, the same way for both stacks
+ */
+void evaluate(const Input &input, const icp::ImplicitKdTree<pcl::PointXYZ> &index, float max_distance,
+              const Eigen::Matrix4f &transformation, Result &result) {
+  double sum = 0;
+  unsigned int n = 0;
+  int i;
+  float sqr_distance;
+  for (const pcl::PointXYZ &p : input.current->points) {
+    const Eigen::Vector3f q = transformation.topLeftCorner<3, 3>() * p.getVector3fMap()
+                              + transformation.topRightCorner<3, 1>();
+    if (index.nearest(q, max_distance * max_distance, i, sqr_distance)) {
+      sum += sqr_distance;
+      ++n;
+    }
+  }
+  result.rmse = n ? std::sqrt(sum / n) : std::numeric_limits<double>::quiet_NaN();
+  const Eigen::Matrix4f error = transformation * input.ground_truth.inverse();
+  result.rotation_error = eigentools::rotationAngle(error);
+  result.translation_error = (transformation.topRightCorner<3, 1>()
+                              - input.ground_truth.topRightCorner<3, 1>()).norm();
+  result.pose_error = result.translation_error + result.rotation_error * input.diagonal / 2;
+}
+
+template<typename Icp>
+Result runIcp(const std::string &name, const typename Icp::PrPtr &reference, const typename Icp::PcPtr &current,
+              const Input &input, const Settings &settings, Eigen::Matrix4f &transformation) {
+  typename Icp::IcpParameters param;
+  param.max_iter = settings.max_iter;
+  param.max_correspondance_distance = settings.max_distance_ratio * input.diagonal;
+  param.min_variation = 0;
+  param.min_relative_variation = settings.relative_variation;
+  param.min_rotation_increment = settings.rotation_epsilon;
+  param.min_translation_increment = settings.translation_epsilon_ratio * input.diagonal;
+  param.convergence_policy = icp::CONVERGENCE_ANY;
+
+  Icp icp;
+  icp.setParameters(param);
+  Clock::time_point start = Clock::now();
+  icp.setInputReference(reference);
+  icp.setInputCurrent(current);
+  icp.run();
+  Result result;
+  result.name = name;
+  result.stack = "icp";
+  result.time = elapsedMs(start);
+  const typename Icp::IcpResults r = icp.getResults();
+  result.iterations = r.registrationError.size();
+  result.converged = r.has_converged;
+  transformation = r.transformation;
+  return result;
+}
+
+/**
+ * @brief Exposes the number of iterations of a PCL registration
+ */
+template<typename Registration>
+class CountedRegistration : public Registration {
+  public:
+    unsigned int getIterations() const {
+      return this->nr_iterations_;
+    }
+};
+
+template<typename Registration, typename PointT>
+Result runPcl(const std::string &name, CountedRegistration<Registration> &registration,
+              const typename pcl::PointCloud<PointT>::Ptr &reference,
+              const typename pcl::PointCloud<PointT>::Ptr &current,
+              const Input &input, const Settings &settings, Eigen::Matrix4f &transformation) {
+  const double translation_epsilon = settings.translation_epsilon_ratio * input.diagonal;
+  registration.setMaximumIterations(settings.max_iter);
+  registration.setMaxCorrespondenceDistance(settings.max_distance_ratio * input.diagonal);
+  registration.setTransformationEpsilon(translation_epsilon * translation_epsilon);
+
+  pcl::PointCloud<PointT> aligned;
+  Clock::time_point start = Clock::now();
+  registration.setInputSource(current);
+  registration.setInputTarget(reference);
+  registration.align(aligned);
+  Result result;
+  result.name = name;
+  result.stack = "pcl";
+  result.time = elapsedMs(start);
+  result.iterations = registration.getIterations();
+  result.converged = registration.hasConverged();
+  transformation = registration.getFinalTransformation();
+  return result;
+}
+
+/**
+ * @brief A method of this library against a method of PCL, and its totals
+ * over the inputs
+ */
+struct Comparison {
+  std::string name;
+  //! Indices of the two methods in the results of an input
+  unsigned int icp;
+  unsigned int pcl;
+
+  unsigned int runs;
+  unsigned int icp_faster;
+  unsigned int icp_more_accurate;
+  double sum_log_speedup;
+  double sum_icp_pose_error;
+  double sum_pcl_pose_error;
+  unsigned int sum_icp_iterations;
+  unsigned int sum_pcl_iterations;
+
+  Comparison(const std::string &name, unsigned int icp, unsigned int pcl) : name(name), icp(icp), pcl(pcl),
+    runs(0), icp_faster(0), icp_more_accurate(0), sum_log_speedup(0), sum_icp_pose_error(0),
+    sum_pcl_pose_error(0), sum_icp_iterations(0), sum_pcl_iterations(0) {
+  }
+
+  //! PCL time over the time of this library, above 1 when this library is
+  //! faster
+  double meanSpeedup() const {
+    return runs ? std::exp(sum_log_speedup / runs) : 0.;
+  }
+};
+
+/**
+ * @brief Runs every method on an input, writes their results and their
+ * comparisons
+ */
+void compare(const Input &input, const Settings &settings, std::vector<Comparison> &comparisons,
+             JsonWriter &json) {
+  std::cerr << input.name << " (" << input.perturbation << " " << input.trial << ")" << std::endl;
+  std::vector<Result> results;
+  TransformationVector transformations;
+  Eigen::Matrix4f T;
+
+  results.push_back(runIcp<icp::IcpPointToPoint>("IcpPointToPoint", input.reference, input.current, input,
+                    settings, T));
+  transformations.push_back(T);
+  results.push_back(runIcp<icp::IcpPointToPlane>("IcpPointToPlane", input.reference_normal,
+                    input.current_normal, input, settings, T));
+  transformations.push_back(T);
+
+  CountedRegistration<pcl::IterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ>> pcl_icp;
+  results.push_back(runPcl<pcl::IterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ>, pcl::PointXYZ>(
+                      "IterativeClosestPoint", pcl_icp, input.reference, input.current, input, settings, T));
+  transformations.push_back(T);
+  CountedRegistration<pcl::IterativeClosestPointWithNormals<pcl::PointNormal, pcl::PointNormal>> pcl_icp_normals;
+  results.push_back(runPcl<pcl::IterativeClosestPointWithNormals<pcl::PointNormal, pcl::PointNormal>,
+                    pcl::PointNormal>("IterativeClosestPointWithNormals", pcl_icp_normals,
+                                      input.reference_normal, input.current_normal, input, settings, T));
+  transformations.push_back(T);
+  CountedRegistration<pcl::GeneralizedIterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ>> pcl_gicp;
+  pcl_gicp.setRotationEpsilon(settings.rotation_epsilon);
+  results.push_back(runPcl<pcl::GeneralizedIterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ>, pcl::PointXYZ>(
+                      "GeneralizedIterativeClosestPoint", pcl_gicp, input.reference, input.current, input,
+                      settings, T));
+  transformations.push_back(T);
+
+  icp::ImplicitKdTree<pcl::PointXYZ> index;
+  index.setInputCloud(input.reference);
+  for (unsigned int i = 0; i < results.size(); ++i) {
+    evaluate(input, index, settings.max_distance_ratio * input.diagonal, transformations[i], results[i]);
+  }
+
+  json.beginObject();
+  json.key("input").value(input.name);
+  json.key("perturbation").value(input.perturbation);
+  json.key("trial").value(input.trial);
+  json.key("reference_points").value(static_cast<unsigned int>(input.reference->size()));
+  json.key("current_points").value(static_cast<unsigned int>(input.current->size()));
+  json.key("methods").beginArray();
+  for (const Result &r : results) {
+    json.beginObject();
+    json.key("name").value(r.name);
+    json.key("stack").value(r.stack);
+    json.key("time_ms").value(r.time);
+    json.key("iterations").value(r.iterations);
+    json.key("converged").value(r.converged);
+    json.key("rmse").value(r.rmse);
+    json.key("rotation_error").value(r.rotation_error);
+    json.key("translation_error").value(r.translation_error);
+    json.key("pose_error").value(r.pose_error);
+    json.endObject();
+  }
+  json.endArray();
+
+  json.key("comparisons").beginArray();
+  for (Comparison &c : comparisons) {
+    const Result &a = results[c.icp], &b = results[c.pcl];
+    const double speedup = b.time / a.time;
+    ++c.runs;
+    c.icp_faster += a.time < b.time;
+    c.icp_more_accurate += a.pose_error < b.pose_error;
+    c.sum_log_speedup += std::log(speedup);
+    c.sum_icp_pose_error += a.pose_error;
+    c.sum_pcl_pose_error += b.pose_error;
+    c.sum_icp_iterations += a.iterations;
+    c.sum_pcl_iterations += b.iterations;
+
+    json.beginObject();
+    json.key("name").value(c.name);
+    json.key("icp").value(a.name);
+    json.key("pcl").value(b.name);
+    json.key("speedup").value(speedup);
+    json.key("faster").value(a.time < b.time ? "icp" : "pcl");
+    json.key("more_accurate").value(a.pose_error < b.pose_error ? "icp" : "pcl");
+    json.endObject();
+  }
+  json.endArray();
+  json.endObject();
+}
+
+/**
+ * @brief Inputs made of a model moved by the perturbations of icp_bench
+ */
+void addModelInputs(const std::string &path, const Settings &settings, InputVector &inputs) {
+  PointCloudXYZ::Ptr xyz(new PointCloudXYZ());
+  if (pcl::io::loadPCDFile<pcl::PointXYZ>(path.c_str(), *xyz) == -1) {
+    LOG(ERROR) << "Could't read file " << path;
+    return;
+  }
+  // Both stacks get the points with a normal
+  PointCloudNormal::Ptr normal = estimateNormals(xyz);
+  PointCloudXYZ::Ptr reference(new PointCloudXYZ());
+  pcl::copyPointCloud(*normal, *reference);
+  Eigen::Vector4f min, max;
+  pcl::getMinMax3D(*reference, min, max);
+  const float diagonal = (max - min).head<3>().norm();
+
+  for (const Perturbation &p : makePerturbations(diagonal, settings.trials, false)) {
+    Input input;
+    input.name = path;
+    input.perturbation = p.name;
+    input.trial = p.trial;
+    input.diagonal = diagonal;
+    input.ground_truth = p.transformation;
+    input.reference = reference;
+    input.reference_normal = normal;
+    input.current.reset(new PointCloudXYZ());
+    input.current_normal.reset(new PointCloudNormal());
+    const Eigen::Matrix4f inverse = p.transformation.inverse();
+    transformCloud(*reference, *input.current, inverse);
+    transformCloud(*normal, *input.current_normal, inverse);
+    inputs.push_back(input);
+  }
+}
+
+/**
+ * @brief Synthetic scene with noise, outliers and partial overlap
+ */
+Input makeSyntheticInput(unsigned int num_points) {
+  icp::SyntheticSceneParameters param;
+  param.num_points = num_points;
+  param.noise = 0.005f;
+  param.outlier_ratio = 0.01f;
+  param.overlap = 0.9f;
+  param.transformation = eigentools::createTransformationMatrix(0.1f, -0.05f, 0.02f, 0.02f, -0.01f, 0.05f);
+
+  Input input;
+  std::ostringstream name;
+  name << "synthetic " << num_points;
+  input.name = name.str();
+  input.perturbation = "synthetic";
+  input.trial = 0;
+  input.diagonal = std::sqrt(2.f) * param.size;
+  input.ground_truth = param.transformation;
+  input.reference_normal.reset(new PointCloudNormal());
+  input.current_normal.reset(new PointCloudNormal());
+  icp::generateSyntheticScene(param, PointCloudNormal::ConstPtr(), *input.reference_normal,
+                              *input.current_normal);
+  input.reference.reset(new PointCloudXYZ());
+  input.current.reset(new PointCloudXYZ());
+  pcl::copyPointCloud(*input.reference_normal, *input.reference);
+  pcl::copyPointCloud(*input.current_normal, *input.current);
+  return input;
+}
+
+int main(int argc, char *argv[]) {
+#if GLOG_ENABLED
+  google::InitGoogleLogging(argv[0]);
+#endif
+
+  Settings settings;
+  std::string output;
+  std::vector<std::string> models;
+  std::vector<unsigned int> synthetic_sizes;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--trials" && i + 1 < argc) {
+      settings.trials = std::atoi(argv[++i]);
+    } else if (arg == "--max-iter" && i + 1 < argc) {
+      settings.max_iter = std::atoi(argv[++i]);
+    } else if (arg == "--output" && i + 1 < argc) {
+      output = argv[++i];
+    } else if (arg == "--synthetic" && i + 1 < argc) {
+      std::istringstream sizes(argv[++i]);
+      std::string size;
+      while (std::getline(sizes, size, ',')) {
+        synthetic_sizes.push_back(std::strtoul(size.c_str(), 0, 10));
+      }
+    } else {
+      models.push_back(arg);
+    }
+  }
+  if (models.empty() && synthetic_sizes.empty()) {
+    models.push_back("../models/valve.pcd");
+    models.push_back("../models/valve_simulation.pcd");
+    models.push_back("../models/teapot.pcd");
+    models.push_back("../models/ladder_robot/ladder_jr13_arnaud.pcd");
+  }
+
+  InputVector inputs;
+  for (const std::string &model : models) {
+    addModelInputs(model, settings, inputs);
+  }
+
+  std::ofstream file;
+  if (!output.empty()) {
+    file.open(output.c_str());
+    if (!file) {
+      LOG(ERROR) << "Could't open " << output;
+      return 1;
+    }
+  }
+  std::ostream &s = output.empty() ? std::cout : file;
+
+  // Indices of the methods in the order compare() runs them
+  std::vector<Comparison> comparisons;
+  comparisons.push_back(Comparison("point_to_point", 0, 2));
+  comparisons.push_back(Comparison("point_to_plane", 1, 3));
+  comparisons.push_back(Comparison("generalized", 1, 4));
+
+  JsonWriter json(s);
+  json.beginObject();
+  json.key("max_iter").value(settings.max_iter);
+  json.key("max_distance_ratio").value(settings.max_distance_ratio);
+  json.key("inputs").beginArray();
+  for (const Input &input : inputs) {
+    compare(input, settings, comparisons, json);
+  }
+  // Generated one at a time, the largest ones do not fit twice in memory
+  for (unsigned int num_points : synthetic_sizes) {
+    compare(makeSyntheticInput(num_points), settings, comparisons, json);
+  }
+  json.endArray();
+
+  json.key("summary").beginArray();
+  std::cerr << "\n" << std::left << std::setw(16) << "comparison" << std::right << std::setw(6) << "runs"
+            << std::setw(10) << "speedup" << std::setw(8) << "faster" << std::setw(10) << "accurate"
+            << std::setw(14) << "icp error" << std::setw(14) << "pcl error" << std::setw(10) << "icp iter"
+            << std::setw(10) << "pcl iter" << "\n";
+  for (const Comparison &c : comparisons) {
+    const double n = c.runs ? c.runs : 1;
+    json.beginObject();
+    json.key("name").value(c.name);
+    json.key("runs").value(c.runs);
+    json.key("geometric_mean_speedup").value(c.meanSpeedup());
+    json.key("icp_faster").value(c.icp_faster);
+    json.key("icp_more_accurate").value(c.icp_more_accurate);
+    json.key("icp_mean_pose_error").value(c.sum_icp_pose_error / n);
+    json.key("pcl_mean_pose_error").value(c.sum_pcl_pose_error / n);
+    json.key("icp_mean_iterations").value(c.sum_icp_iterations / n);
+    json.key("pcl_mean_iterations").value(c.sum_pcl_iterations / n);
+    json.endObject();
+
+    std::cerr << std::left << std::setw(16) << c.name << std::right << std::setw(6) << c.runs
+              << std::setw(9) << std::setprecision(3) << c.meanSpeedup() << "x"
+              << std::setw(4) << c.icp_faster << "/" << std::left << std::setw(3) << c.runs << std::right
+              << std::setw(6) << c.icp_more_accurate << "/" << std::left << std::setw(3) << c.runs << std::right
+              << std::setw(14) << c.sum_icp_pose_error / n << std::setw(14) << c.sum_pcl_pose_error / n
+              << std::setw(10) << c.sum_icp_iterations / n << std::setw(10) << c.sum_pcl_iterations / n << "\n";
+  }
+  json.endArray();
+  json.endObject();
+  s << std::endl;
+  return 0;
+}
@@ -0,0 +1,114 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+/**
+ * Compares the scale estimations of the M-estimators on residual vectors of
+ * 10^4 to 10^7 entries: the former MAD (two copies, two selections per
+ * median of an even length), the exact selection in place, and the
+ * histogram approximations.
+ *
+ * Usage: icp_scale_benchmark
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <icp/eigentools.hpp>
+#include <icp/logging.hpp>
+#include <icp/mestimator.hpp>
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedMs(const Clock::time_point &start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/**
+ * @brief Median as it was computed before: on a copy, with two selections for
+ * even lengths
+ */
+float formerMedian(const Eigen::VectorXf &M) {
+  Eigen::VectorXf copy = M;
+  const int len = copy.size();
+  if (len % 2 == 0) {
+    std::nth_element(copy.data(), copy.data() + len / 2 - 1, copy.data() + len);
+    const float n1 = copy(len / 2 - 1);
+    std::nth_element(copy.data(), copy.data() + len / 2, copy.data() + len);
+    return (n1 + copy(len / 2)) / 2;
+  }
+  std::nth_element(copy.data(), copy.data() + len / 2, copy.data() + len);
+  return copy(len / 2);
+}
+
+float formerScale(const Eigen::VectorXf &r) {
+  const float median = formerMedian(r);
+  Eigen::VectorXf deviation = (r.array() - median).abs().matrix();
+  return formerMedian(deviation) / 0.6745f;
+}
+
+template<typename Function>
+double benchmark(const Function &function, unsigned int repeat, float &scale) {
+  Clock::time_point start = Clock::now();
+  for (unsigned int i = 0; i < repeat; ++i) {
+    scale = function();
+  }
+  return elapsedMs(start) / repeat;
+}
+
+int main(int argc, char *argv[]) {
+#if GLOG_ENABLED
+  google::InitGoogleLogging(argv[0]);
+#endif
+
+  std::mt19937 generator(42);
+  std::normal_distribution<float> noise(0.f, 0.01f);
+  std::uniform_real_distribution<float> outlier(-1.f, 1.f);
+
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "entries      former (ms)   in place (ms)   tol 1e-2 (ms) (error)   tol 1e-3 (ms) (error)\n";
+  for (unsigned int n = 10000; n <= 10000000; n *= 10) {
+    // Residuals of 3n / 3 points: gaussian noise and 10% of outliers
+    Eigen::VectorXf r(n);
+    for (unsigned int i = 0; i < n; ++i) {
+      r[i] = i % 10 == 0 ? outlier(generator) : noise(generator);
+    }
+    const unsigned int repeat = std::max(1u, 1000000u / n);
+
+    float former, exact, approximate2, approximate3;
+    icp::RobustScale_<float> scale;
+    const double t_former = benchmark([&r]() {
+      return formerScale(r);
+    }, repeat, former);
+    const double t_exact = benchmark([&]() {
+      return scale(icp::SCALE_MAD, r, 0.f);
+    }, repeat, exact);
+    scale.setTolerance(1e-2f);
+    const double t_approximate2 = benchmark([&]() {
+      return scale(icp::SCALE_MAD, r, 0.f);
+    }, repeat, approximate2);
+    scale.setTolerance(1e-3f);
+    const double t_approximate3 = benchmark([&]() {
+      return scale(icp::SCALE_MAD, r, 0.f);
+    }, repeat, approximate3);
+
+    std::cout << std::setw(8) << n
+              << std::setw(16) << t_former
+              << std::setw(16) << t_exact
+              << std::setw(16) << t_approximate2 << " (" << std::abs(approximate2 - exact) / exact << ")"
+              << std::setw(14) << t_approximate3 << " (" << std::abs(approximate3 - exact) / exact << ")";
+    if (former != exact) {
+      std::cout << "   former " << former << " != " << exact;
+    }
+    std::cout << std::endl;
+  }
+  return 0;
+}
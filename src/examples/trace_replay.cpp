@@ -0,0 +1,212 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+/**
+ * Headless analysis of the traces recorded with Icp_::setTrace(), without the
+ * viewer of step_by_step.
+ *
+ * Prints a summary of each registration of the trace and flags those that
+ * deserve a look: error increasing within a level, iterations slower than
+ * --slow ms, maximum number of iterations reached, failed or incomplete runs.
+ *
+ * --iterations prints the iterations of the flagged runs (of every run with
+ * --all), --csv prints every iteration as CSV instead, for plotting.
+ *
+ * --replay current.pcd writes the current cloud moved by the estimate of each
+ * iteration of run --run (the first flagged one by default), as
+ * <prefix>_<iteration>.pcd, to be stepped through in any PCD viewer.
+ *
+ * Usage: icp_trace_replay [--slow ms] [--iterations] [--all] [--csv]
+ *                         [--replay current.pcd [--run N] [--prefix p]]
+ *                         trace.icpt
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <pcl/common/transforms.h>
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_types.h>
+#include <icp/eigentools.hpp>
+#include <icp/logging.hpp>
+#include <icp/trace.hpp>
+
+typedef std::vector<icp::IcpTraceRun, Eigen::aligned_allocator<icp::IcpTraceRun>> TraceRuns;
+
+/**
+ * @brief What is wrong with a run, empty if nothing
+ */
+std::string diagnose(const icp::IcpTraceRun &run, double slow) {
+  std::ostringstream s;
+  if (!run.complete) {
+    s << " incomplete";
+  } else if (run.stop_reason == icp::STOP_FAILED) {
+    s << " failed";
+  } else if (run.stop_reason == icp::STOP_MAX_ITERATIONS) {
+    s << " max-iterations";
+  }
+  unsigned int increases = 0, slow_iterations = 0;
+  for (unsigned int i = 0; i < run.iterations.size(); ++i) {
+    const icp::IcpTraceIteration &it = run.iterations[i];
+    // The errors of different levels can not be compared
+    if (i > 0 && run.iterations[i - 1].level == it.level && it.error > run.iterations[i - 1].error) {
+      ++increases;
+    }
+    if (slow > 0 && it.time > slow) {
+      ++slow_iterations;
+    }
+  }
+  if (increases > 0) {
+    s << " diverging(" << increases << ")";
+  }
+  if (slow_iterations > 0) {
+    s << " slow(" << slow_iterations << ")";
+  }
+  return s.str();
+}
+
+void printIterations(const icp::IcpTraceRun &run, std::ostream &s) {
+  s << std::setw(6) << "level" << std::setw(6) << "iter" << std::setw(14) << "error" << std::setw(12) << "rmse"
+    << std::setw(12) << "d_rot" << std::setw(12) << "d_trans" << std::setw(14) << "matched"
+    << std::setw(22) << "weights min/mean/max" << std::setw(10) << "reweight" << std::setw(10) << "ms" << "\n";
+  for (const icp::IcpTraceIteration &it : run.iterations) {
+    std::ostringstream matched, weights;
+    matched << it.num_correspondences << "/" << it.num_queries;
+    weights << std::setprecision(2) << it.weight_min << "/" << it.weight_mean << "/" << it.weight_max;
+    s << std::setw(6) << it.level << std::setw(6) << it.iteration << std::setw(14) << it.error
+      << std::setw(12) << it.rmse << std::setw(12) << it.rotation_increment << std::setw(12)
+      << it.translation_increment << std::setw(14) << matched.str() << std::setw(22) << weights.str()
+      << std::setw(10) << it.num_downweighted << std::setw(10) << it.time << "\n";
+  }
+}
+
+void printCsv(const TraceRuns &runs, std::ostream &s) {
+  s << "run,level,iteration,error,rmse,rotation_increment,translation_increment,queries,correspondences,"
+    << "weight_min,weight_mean,weight_max,downweighted,time_ms,angle,tx,ty,tz\n";
+  for (unsigned int r = 0; r < runs.size(); ++r) {
+    for (const icp::IcpTraceIteration &it : runs[r].iterations) {
+      const Eigen::Matrix4f &T = it.transformation;
+      s << r << "," << it.level << "," << it.iteration << "," << it.error << "," << it.rmse << ","
+        << it.rotation_increment << "," << it.translation_increment << "," << it.num_queries << ","
+        << it.num_correspondences << "," << it.weight_min << "," << it.weight_mean << "," << it.weight_max << ","
+        << it.num_downweighted << "," << it.time << "," << eigentools::rotationAngle(T) << "," << T(0, 3) << ","
+        << T(1, 3) << "," << T(2, 3) << "\n";
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+#if GLOG_ENABLED
+  google::InitGoogleLogging(argv[0]);
+#endif
+
+  double slow = 0;
+  bool iterations = false, all = false, csv = false;
+  std::string path, replay, prefix = "replay";
+  int replay_run = -1;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--slow" && i + 1 < argc) {
+      slow = std::atof(argv[++i]);
+    } else if (arg == "--iterations") {
+      iterations = true;
+    } else if (arg == "--all") {
+      all = true;
+    } else if (arg == "--csv") {
+      csv = true;
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replay = argv[++i];
+    } else if (arg == "--run" && i + 1 < argc) {
+      replay_run = std::atoi(argv[++i]);
+    } else if (arg == "--prefix" && i + 1 < argc) {
+      prefix = argv[++i];
+    } else {
+      path = arg;
+    }
+  }
+  if (path.empty()) {
+    LOG(ERROR) << "Usage: " << argv[0] << " [--slow ms] [--iterations] [--all] [--csv] "
+               << "[--replay current.pcd [--run N] [--prefix p]] trace.icpt";
+    return 1;
+  }
+
+  TraceRuns runs;
+  if (!readTrace(path, runs)) {
+    if (runs.empty()) {
+      return 1;
+    }
+    LOG(WARNING) << "Only the beginning of " << path << " could be read";
+  }
+
+  if (csv) {
+    printCsv(runs, std::cout);
+  } else {
+    unsigned int num_flagged = 0;
+    std::cout << runs.size() << " runs\n";
+    for (unsigned int r = 0; r < runs.size(); ++r) {
+      const icp::IcpTraceRun &run = runs[r];
+      double time = 0;
+      for (const icp::IcpTraceIteration &it : run.iterations) {
+        time += it.time;
+      }
+      const std::string flags = diagnose(run, slow);
+      num_flagged += !flags.empty();
+      std::cout << "Run " << r << ": " << run.num_current << " current, " << run.num_reference << " reference points, "
+                << run.iterations.size() << " iterations in " << time << " ms, "
+                << (run.complete ? icp::toString(run.stop_reason) : "no end recorded");
+      if (!run.iterations.empty()) {
+        const icp::IcpTraceIteration &last = run.iterations.back();
+        std::cout << ", error " << run.iterations.front().error << " -> " << last.error << ", rmse " << last.rmse;
+      }
+      std::cout << (flags.empty() ? "" : ", flagged:") << flags << "\n";
+      if (iterations && (all || !flags.empty())) {
+        printIterations(run, std::cout);
+      }
+      if (replay_run < 0 && !flags.empty()) {
+        replay_run = r;
+      }
+    }
+    std::cout << num_flagged << " flagged runs" << std::endl;
+  }
+
+  if (!replay.empty()) {
+    if (replay_run < 0) {
+      replay_run = 0;
+    }
+    if (replay_run >= static_cast<int>(runs.size())) {
+      LOG(ERROR) << "No run " << replay_run << " in the trace";
+      return 1;
+    }
+    pcl::PointCloud<pcl::PointXYZ>::Ptr current(new pcl::PointCloud<pcl::PointXYZ>());
+    if (pcl::io::loadPCDFile<pcl::PointXYZ>(replay.c_str(), *current) == -1) {
+      LOG(ERROR) << "Could't read file " << replay;
+      return 1;
+    }
+    const icp::IcpTraceRun &run = runs[replay_run];
+    if (current->size() != run.num_current) {
+      LOG(WARNING) << replay << " has " << current->size() << " points, run " << replay_run << " registered "
+                   << run.num_current;
+    }
+    // The initial guess, then the estimate after each iteration
+    pcl::PointCloud<pcl::PointXYZ> moved;
+    for (unsigned int i = 0; i <= run.iterations.size(); ++i) {
+      const Eigen::Matrix4f &T = i == 0 ? run.initial_guess : run.iterations[i - 1].transformation;
+      pcl::transformPointCloud(*current, moved, T);
+      std::ostringstream file;
+      file << prefix << "_" << std::setw(3) << std::setfill('0') << i << ".pcd";
+      pcl::io::savePCDFileBinary(file.str(), moved);
+    }
+    std::cerr << "Run " << replay_run << " replayed in " << run.iterations.size() + 1 << " clouds " << prefix
+              << "_*.pcd" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,210 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <icp/batch.hpp>
+#include <icp/eigentools.hpp>
+#include <icp/instanciate.hpp>
+#include <icp/logging.hpp>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+namespace icp
+{
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+template<typename Job>
+void IcpBatch_<Dtype, PointReference, PointCurrent, Error_, Search_>::forEach(unsigned int n, const Job &job) {
+  if (n == 0) {
+    return;
+  }
+  // Built once here, shared by the copies of the workers
+  prototype_.buildReferencePyramid();
+
+  unsigned int num_threads = num_threads_;
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, n);
+
+  // Each worker takes the next job until there is none left
+  std::atomic<unsigned int> next(0);
+  auto worker = [this, &job, &next, n]() {
+    Icp icp(prototype_);
+    for (unsigned int i = next++; i < n; i = next++) {
+      job(icp, i);
+    }
+  };
+
+  if (num_threads == 1) {
+    worker();
+    return;
+  }
+  std::vector<std::thread> threads;
+  std::vector<std::exception_ptr> exceptions(num_threads);
+  threads.reserve(num_threads);
+  for (unsigned int t = 0; t < num_threads; ++t) {
+    threads.push_back(std::thread([&worker, &exceptions, t]() {
+      try {
+        worker();
+      } catch (...) {
+        exceptions[t] = std::current_exception();
+      }
+    }));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (const std::exception_ptr &e : exceptions) {
+    if (e) {
+      std::rethrow_exception(e);
+    }
+  }
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+std::vector<typename IcpBatch_<Dtype, PointReference, PointCurrent, Error_, Search_>::IcpResults>
+IcpBatch_<Dtype, PointReference, PointCurrent, Error_, Search_>::run(
+  const std::vector<PcPtr> &currents,
+  const TransformationVector &initial_guesses) {
+  if (!initial_guesses.empty() && initial_guesses.size() != currents.size()) {
+    throw std::invalid_argument("IcpBatch_::run: one initial guess per current cloud is needed");
+  }
+  std::vector<IcpResults> results(currents.size());
+  forEach(currents.size(), [&](Icp & icp, unsigned int i) {
+    IcpParameters param = param_;
+    if (!initial_guesses.empty()) {
+      param.initial_guess = initial_guesses[i];
+    }
+    icp.setParameters(param);
+    icp.setInputCurrent(currents[i]);
+    icp.run();
+    results[i] = icp.getResults();
+  });
+  LOG(INFO) << "Registered " << currents.size() << " clouds";
+  return results;
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+void IcpBatch_<Dtype, PointReference, PointCurrent, Error_, Search_>::pruneHypotheses(
+  const std::vector<IcpResults> &results, std::vector<unsigned int> &alive) const {
+  // Failed hypotheses and those matching too few points go away, the others
+  // are ranked by RMSE
+  Dtype max_inlier_ratio = 0;
+  for (unsigned int h : alive) {
+    if (results[h].stop_reason != STOP_FAILED) {
+      max_inlier_ratio = std::max(max_inlier_ratio, results[h].inlier_ratio);
+    }
+  }
+  const Dtype min_inlier_ratio = hypotheses_param_.min_inlier_fraction * max_inlier_ratio;
+  alive.erase(std::remove_if(alive.begin(), alive.end(), [&results, min_inlier_ratio](unsigned int h) {
+    return results[h].stop_reason == STOP_FAILED || results[h].inlier_ratio < min_inlier_ratio;
+  }), alive.end());
+  std::stable_sort(alive.begin(), alive.end(), [&results](unsigned int a, unsigned int b) {
+    return results[a].rmse < results[b].rmse;
+  });
+  if (alive.empty()) {
+    return;
+  }
+
+  const Dtype max_rmse = hypotheses_param_.prune_ratio * results[alive.front()].rmse;
+  std::vector<unsigned int> kept;
+  for (unsigned int h : alive) {
+    if (results[h].rmse > max_rmse) {
+      break;
+    }
+    const Eigen::Matrix<Dtype, 4, 4> &T = results[h].transformation;
+    bool merged = false;
+    for (unsigned int k : kept) {
+      const Eigen::Matrix<Dtype, 4, 4> &T_kept = results[k].transformation;
+      const Eigen::Matrix<Dtype, 4, 4> difference = T * T_kept.inverse();
+      if (eigentools::rotationAngle(difference) <= hypotheses_param_.merge_rotation &&
+          (T.template topRightCorner<3, 1>() - T_kept.template topRightCorner<3, 1>()).norm()
+          <= hypotheses_param_.merge_translation) {
+        merged = true;
+        break;
+      }
+    }
+    if (!merged) {
+      kept.push_back(h);
+    }
+  }
+  alive.swap(kept);
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+typename IcpBatch_<Dtype, PointReference, PointCurrent, Error_, Search_>::IcpResults
+IcpBatch_<Dtype, PointReference, PointCurrent, Error_, Search_>::runHypotheses(
+  const PcPtr &current,
+  const TransformationVector &initial_guesses,
+  std::vector<IcpResults> *hypotheses) {
+  const unsigned int n = initial_guesses.size();
+  std::vector<IcpResults> results(n);
+
+  // First stage: a few iterations for every hypothesis
+  const unsigned int prune_after = std::min(hypotheses_param_.prune_after, param_.max_iter);
+  forEach(n, [&](Icp & icp, unsigned int h) {
+    IcpParameters param = param_;
+    param.initial_guess = initial_guesses[h];
+    param.max_iter = prune_after;
+    icp.setParameters(param);
+    icp.setInputCurrent(current);
+    icp.run();
+    results[h] = icp.getResults();
+  });
+
+  std::vector<unsigned int> alive(n);
+  for (unsigned int h = 0; h < n; ++h) {
+    alive[h] = h;
+  }
+  pruneHypotheses(results, alive);
+  LOG(INFO) << alive.size() << "/" << n << " hypotheses left after " << prune_after << " iterations";
+
+  // Second stage: the hypotheses left go on from where they stopped, unless
+  // they already converged
+  std::vector<unsigned int> running;
+  for (unsigned int h : alive) {
+    if (results[h].stop_reason == STOP_MAX_ITERATIONS && prune_after < param_.max_iter) {
+      running.push_back(h);
+    }
+  }
+  forEach(running.size(), [&](Icp & icp, unsigned int r) {
+    IcpResults &result = results[running[r]];
+    IcpParameters param = param_;
+    param.initial_guess = result.transformation;
+    param.max_iter = param_.max_iter - prune_after;
+    param.pyramid.clear();
+    icp.setParameters(param);
+    icp.setInputCurrent(current);
+    icp.run();
+
+    IcpResults second = icp.getResults();
+    second.registrationError.insert(second.registrationError.begin(), result.registrationError.begin(),
+                                    result.registrationError.end());
+    result = second;
+  });
+  pruneHypotheses(results, alive);
+
+  if (hypotheses) {
+    *hypotheses = results;
+  }
+  if (alive.empty()) {
+    LOG(WARNING) << "Every hypothesis failed";
+    IcpResults failed;
+    failed.stop_reason = STOP_FAILED;
+    return failed;
+  }
+  return results[alive.front()];
+}
+
+INSTANCIATE_ICP_BATCH;
+
+}  // namespace icp
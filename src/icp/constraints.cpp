@@ -8,6 +8,8 @@
 //  (at your option) any later version.
 
 #include <algorithm>
+#include <cassert>
+#include <Eigen/Cholesky>
 #include <icp/constraints.hpp>
 #include <icp/instanciate.hpp>
 #include <icp/logging.hpp>
@@ -16,30 +18,89 @@
 namespace icp
 {
 
-int FixTranslationConstraint::numFixedAxes() const
+int FixAxesConstraint::numFixedAxes() const
 {
   return std::count(std::begin(fixedAxes_), std::end(fixedAxes_), true);
 }
 
 template<typename Scalar, unsigned int DegreesOfFreedom>
-void JacobianConstraints<Scalar, DegreesOfFreedom>::processJacobian(const JacobianMatrix &J, JacobianMatrix &Jconstrained) {
-  LOG(INFO) << translationConstraint_.getFixedAxes()[0] << ", " << translationConstraint_.getFixedAxes()[1] << ", " << translationConstraint_.getFixedAxes()[2];
-            Eigen::Matrix<Scalar, 3, DegreesOfFreedom> weights;
-  weights.setOnes();
-  int i = 0;
-  for (bool axis : this->translationConstraint_.getFixedAxes()) {
-    if (axis) {
-      weights(i, i) = 0;
-    } else {
-      weights(i, i) = 1;
+void Constraints_<Scalar, DegreesOfFreedom>::updateParameters() {
+  // Layout of the twist: translation, rotation, scale. SO3 only has the
+  // rotation.
+  const bool has_translation = DegreesOfFreedom >= 6;
+  const unsigned int rotation = has_translation ? 3 : 0;
+  fixed_.fill(false);
+  for (unsigned int axis = 0; axis < 3; ++axis) {
+    if (has_translation && translationConstraint_.getFixedAxes()[axis]) {
+      fixed_[axis] = true;
+    }
+    if (rotationConstraint_.getFixedAxes()[axis]) {
+      fixed_[rotation + axis] = true;
+    }
+  }
+  if (DegreesOfFreedom == 7 && scaleFixed_) {
+    fixed_[6] = true;
+  }
+
+  numFree_ = 0;
+  for (unsigned int p = 0; p < DegreesOfFreedom; ++p) {
+    if (!fixed_[p]) {
+      free_[numFree_++] = p;
+    }
+  }
+}
+
+template<typename Scalar, unsigned int DegreesOfFreedom>
+void Constraints_<Scalar, DegreesOfFreedom>::processJacobian(const JacobianMatrix &J, JacobianMatrix &Jconstrained) const {
+  Jconstrained.resize(J.rows(), numFree_);
+  for (unsigned int k = 0; k < numFree_; ++k) {
+    Jconstrained.col(k) = J.col(free_[k]);
+  }
+}
+
+template<typename Scalar, unsigned int DegreesOfFreedom>
+void Constraints_<Scalar, DegreesOfFreedom>::cancelFixedColumns(JacobianMatrix &J) const {
+  for (unsigned int p = 0; p < DegreesOfFreedom; ++p) {
+    if (fixed_[p]) {
+      J.col(p).setZero();
+    }
+  }
+}
+
+template<typename Scalar, unsigned int DegreesOfFreedom>
+typename Constraints_<Scalar, DegreesOfFreedom>::Twist
+Constraints_<Scalar, DegreesOfFreedom>::getTwist(const VectorX &twist) const {
+  assert(twist.size() == numFree_);
+  Twist full = Twist::Zero();
+  for (unsigned int k = 0; k < numFree_; ++k) {
+    full[free_[k]] = twist[k];
+  }
+  return full;
+}
+
+template<typename Scalar, unsigned int DegreesOfFreedom>
+typename Constraints_<Scalar, DegreesOfFreedom>::Twist
+Constraints_<Scalar, DegreesOfFreedom>::solve(const Hessian &A, const Twist &b) const {
+  if (numFree_ == DegreesOfFreedom) {
+    return A.ldlt().solve(b);
+  }
+  Twist x = Twist::Zero();
+  if (numFree_ == 0) {
+    return x;
+  }
+  ReducedHessian A_free(numFree_, numFree_);
+  ReducedTwist b_free(numFree_);
+  for (unsigned int i = 0; i < numFree_; ++i) {
+    b_free[i] = b[free_[i]];
+    for (unsigned int j = 0; j < numFree_; ++j) {
+      A_free(i, j) = A(free_[i], free_[j]);
     }
-    ++i;
   }
-  LOG(INFO) << "W: " << weights;
-  Jconstrained = J;
-  for (i = 0; i < J.rows() / 3; i++) {
-    Jconstrained.block(i*3, 0, 3, DegreesOfFreedom) = weights.array() * Jconstrained.block(i*3, 0, 3, DegreesOfFreedom).array();
+  const ReducedTwist x_free = A_free.ldlt().solve(b_free);
+  for (unsigned int i = 0; i < numFree_; ++i) {
+    x[free_[i]] = x_free[i];
   }
+  return x;
 }
 
 INSTANCIATE_CONSTRAINTS;
@@ -1,3 +1,5 @@
+#include <cmath>
+#include <limits>
 #include <icp/error.hpp>
 #include <icp/instanciate.hpp>
 #include <icp/linear_algebra.hpp>
@@ -8,20 +10,108 @@ namespace icp {
 template<typename Scalar, unsigned int DegreesOfFreedom, typename PointReference, typename PointCurrent>
 void Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::setInputCurrent(const PcsPtr &in) {
   current_ = in;
+  indicesCurrent_ = 0;
+  indicesReference_ = 0;
+  n_ = current_->size();
 
   // Resize the data structures
-  errorVector_.resize(3 * current_->size(), Eigen::NoChange);
-  weightsVector_ = VectorX::Ones(current_->size() * 3);
-  J_.setZero(3 * current_->size(), DegreesOfFreedom);
+  resizeBuffers(rowsPerCorrespondence() * n_);
+}
+
+template<typename Scalar, unsigned int DegreesOfFreedom, typename PointReference, typename PointCurrent>
+void Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::setCorrespondences(
+  const std::vector<int> &indices_current,
+  const std::vector<int> &indices_reference) {
+  indicesCurrent_ = &indices_current;
+  indicesReference_ = &indices_reference;
+  n_ = indices_current.size();
+  resizeBuffers(rowsPerCorrespondence() * n_);
+}
+
+template<typename Scalar, unsigned int DegreesOfFreedom, typename PointReference, typename PointCurrent>
+void Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::setTransformation(const Eigen::Matrix<Scalar, 4, 4> &T) {
+  R_ = T.template block<3, 3>(0, 0);
+  t_ = T.template block<3, 1>(0, 3);
+  // Remove the scale (Sim3) from the rotation of the normals
+  normalRotation_ = R_ / std::cbrt(R_.determinant());
+}
+
+template<typename Scalar, unsigned int DegreesOfFreedom, typename PointReference, typename PointCurrent>
+void Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::resizeBuffers(unsigned int rows) {
+  if (errorVector_.size() < rows) {
+    errorVector_.resize(rows);
+    weightsVector_.resize(rows);
+  }
+  rows_ = rows;
+  weighted_ = false;
 }
 
 template<typename Scalar, unsigned int DegreesOfFreedom, typename PointReference, typename PointCurrent>
 Eigen::Matrix<Scalar, 4, 4> Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::update() {
-  auto Jt = J_.transpose();
-  Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> W = weightsVector_.asDiagonal().inverse();
-  Eigen::Matrix<Scalar, DegreesOfFreedom, 1> x = -constraints_->getTwist((Jt*W*J_).ldlt().solve(Jt * W * errorVector_));
+  Eigen::Matrix<Scalar, DegreesOfFreedom, 1> x = -solve(JtWJ_, JtWe_);
   // return update step transformation matrix
-  return  la::expLie(x);
+  return expTwist(x);
+}
+
+template<typename Scalar, unsigned int DegreesOfFreedom, typename PointReference, typename PointCurrent>
+Eigen::Matrix<Scalar, 4, 4> Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::update(
+  Scalar damping, Scalar &predicted_decrease) {
+  // Marquardt scaling. Parameters the error does not depend on have a null
+  // diagonal, keep them damped so that the system stays invertible
+  const Gradient D = JtWJ_.diagonal().cwiseMax(std::numeric_limits<Scalar>::epsilon());
+  Hessian A = JtWJ_;
+  A.diagonal() += damping * D;
+  // The fixed parameters of x are 0, they do not count in the decrease
+  const Gradient x = -solve(A, JtWe_);
+  // With the cost F(x) = |e + J x|^2, F(0) - F(x) = -2 x^T J^T e - x^T J^T J x,
+  // which simplifies with (J^T J + lambda D) x = -J^T e
+  predicted_decrease = -x.dot(JtWe_) + damping * x.dot(D.cwiseProduct(x));
+  return expTwist(x);
+}
+
+template<typename Scalar, unsigned int DegreesOfFreedom, typename PointReference, typename PointCurrent>
+typename Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::Gradient
+Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::solve(const Hessian &A, const Gradient &b) const {
+  // Only the free parameters are solved for
+  return constraints_->solve(A, b);
+}
+
+template<typename Scalar, unsigned int DegreesOfFreedom, typename PointReference, typename PointCurrent>
+Eigen::Matrix<Scalar, 4, 4> Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::expTwist(
+  const Gradient &x) const {
+  return la::expLie(x);
+}
+
+template<typename Scalar, unsigned int DegreesOfFreedom, typename PointReference, typename PointCurrent>
+Eigen::Matrix<Scalar, 4, 4> Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::closedFormTransformation(
+  bool translation, bool scale) const {
+  Eigen::Matrix4d T = Eigen::Matrix4d::Identity();
+  if (closedFormWeight_ <= 0) {
+    return T.cast<Scalar>();
+  }
+  Eigen::Vector3d centroid_current = Eigen::Vector3d::Zero();
+  Eigen::Vector3d centroid_reference = Eigen::Vector3d::Zero();
+  if (translation) {
+    centroid_current = sumCurrent_ / closedFormWeight_;
+    centroid_reference = sumReference_ / closedFormWeight_;
+  }
+  const Eigen::Matrix3d covariance = sumCross_ / closedFormWeight_ - centroid_reference * centroid_current.transpose();
+  const double variance = sumSquaredCurrent_ / closedFormWeight_ - centroid_current.squaredNorm();
+
+  // R = U D V^T, D making it a rotation rather than a reflection
+  Eigen::JacobiSVD<Eigen::Matrix3d> svd(covariance, Eigen::ComputeFullU | Eigen::ComputeFullV);
+  Eigen::Vector3d d = Eigen::Vector3d::Ones();
+  if (svd.matrixU().determinant() * svd.matrixV().determinant() < 0) {
+    d[2] = -1;
+  }
+  const Eigen::Matrix3d R = svd.matrixU() * d.asDiagonal() * svd.matrixV().transpose();
+  double s = 1;
+  if (scale && variance > 0) {
+    s = svd.singularValues().dot(d) / variance;
+  }
+  T.topLeftCorner<3, 3>() = s * R;
+  T.topRightCorner<3, 1>() = centroid_reference - s * R * centroid_current;
+  return T.cast<Scalar>();
 }
 
 template<typename Scalar, unsigned int DegreesOfFreedom, typename PointReference, typename PointCurrent>
@@ -32,9 +122,10 @@ void Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::setInputRefe
 template<typename Scalar, unsigned int DegreesOfFreedom, typename PointReference, typename PointCurrent>
 void Error<Scalar, DegreesOfFreedom, PointReference, PointCurrent>::computeWeights()
 {
-  Scalar mad = median_absolute_deviation(errorVector_);
-  Scalar scale = mad / 0.6745;
-  hubert_weight(errorVector_, weightsVector_, scale);
+  const Scalar scale = scale_(scaleEstimator_, errorVector_.head(rows_), fixedScale_);
+  const Scalar tuning = mestimatorTuning_ > 0 ? mestimatorTuning_ : defaultTuning<Scalar>(mestimatorType_);
+  robustWeights<Scalar>(mestimatorType_, tuning, errorVector_.head(rows_), scale, weightsVector_.head(rows_));
+  weighted_ = true;
 }
 
 INSTANCIATE_ERROR;
@@ -0,0 +1,81 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <icp/error_point_to_line_2d.hpp>
+#include <icp/instanciate.hpp>
+#include <icp/logging.hpp>
+
+namespace icp
+{
+
+template<typename Dtype, typename PointReference, typename PointCurrent>
+void ErrorPointToLine2D<Dtype, PointReference, PointCurrent>::computeJacobianBlock(const Vector2 &p, const Vector2 &n,
+    JacobianBlock &J) {
+  J << n.x(), n.y(), p.x() * n.y() - p.y() * n.x();
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent>
+void ErrorPointToLine2D<Dtype, PointReference, PointCurrent>::computeJacobian() {
+  J_.setZero(n_, 3);
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    computeJacobianBlock(currentPoint(i).template head<2>(), currentNormal(i), Ji);
+    J_.row(i) = Ji;
+  }
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent>
+void ErrorPointToLine2D<Dtype, PointReference, PointCurrent>::computeError() {
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    errorVector_[i] = currentNormal(i).dot((currentPoint(i) - referencePoint(i)).template head<2>());
+  }
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
+  }
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent>
+void ErrorPointToLine2D<Dtype, PointReference, PointCurrent>::computeNormalEquations() {
+  JtWJ_.setZero();
+  JtWe_.setZero();
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    computeJacobianBlock(currentPoint(i).template head<2>(), currentNormal(i), Ji);
+    const Dtype w = weighted_ ? weightsVector_[i] : 1;
+    JtWJ_.noalias() += w * Ji.transpose() * Ji;
+    JtWe_.noalias() += (w * errorVector_[i]) * Ji.transpose();
+  }
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent>
+void ErrorPointToLine2D<Dtype, PointReference, PointCurrent>::computeErrorAndNormalEquations() {
+  JtWJ_.setZero();
+  JtWe_.setZero();
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    const Vector2 p_c = currentPoint(i).template head<2>();
+    const Vector2 n = currentNormal(i);
+    const Dtype e = n.dot(p_c - referencePoint(i).template head<2>());
+    errorVector_[i] = e;
+    computeJacobianBlock(p_c, n, Ji);
+    JtWJ_.noalias() += Ji.transpose() * Ji;
+    JtWe_.noalias() += e * Ji.transpose();
+  }
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
+  }
+}
+
+INSTANCIATE_ERROR_POINT_TO_LINE_2D;
+
+}  // namespace icp
@@ -15,54 +15,69 @@
 namespace icp
 {
 
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPlaneSim3<Scalar, PointReference, PointSource>::computeJacobianBlock(const Vector3 &p, const Vector3 &n, JacobianBlock &J) {
+  J << n.x(), n.y(), n.z(),
+       p.y() * n.z() - p.z() * n.y(),
+       p.z() * n.x() - p.x() * n.z(),
+       p.x() * n.y() - p.y() * n.x(),
+       p.dot(n);
+}
+
 template<typename Scalar, typename PointReference, typename PointSource>
 void ErrorPointToPlaneSim3<Scalar, PointReference, PointSource>::computeJacobian() {
-  const unsigned int n = current_->size();
-  J_.setZero(n, 7);
-  for (unsigned int i = 0; i < n; ++i)
+  J_.setZero(n_, 7);
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
   {
-    const PointSource &p = (*current_)[i];
-    J_.row(i) << p.normal_x, p.normal_y, p.normal_z,
-           p.y *p.normal_z - p.z *p.normal_y,
-           p.z *p.normal_x - p.x *p.normal_z,
-           p.y *p.normal_y - p.y *p.normal_x,
-           p.x * p.normal_x + p.y * p.normal_y + p.z * p.normal_z;
+    computeJacobianBlock(currentPoint(i), currentNormal(i), Ji);
+    J_.row(i) = Ji;
   }
 }
 
 template<typename Scalar, typename PointReference, typename PointSource>
 void ErrorPointToPlaneSim3<Scalar, PointReference, PointSource>::computeError() {
-  // XXX: Does not make use of eigen's map, possible optimization for floats
-
-  PrPtr pc_e = pcltools::substractPointcloud<PointReference, PointSource>(reference_, current_);
-  //Eigen::MatrixXf matrixMap = current_->getMatrixXfMap(3, 4, 0) - reference_->getMatrixXfMap(3, 4, 0);
-
-  for (unsigned int i = 0; i < pc_e->size(); ++i)
+  for (unsigned int i = 0; i < n_; ++i)
   {
-    const auto &p = (*pc_e)[i];
-    const PointSource &n = (*current_)[i];
-    errorVector_[i] =  n.normal_x * p.x
-                       + n.normal_y * p.y
-                       + n.normal_z * p.z;
+    errorVector_[i] = currentNormal(i).dot(currentPoint(i) - referencePoint(i));
   }
-  if (!errorVector_.allFinite()) {
-    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_;
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
   }
 }
 
 template<typename Scalar, typename PointReference, typename PointSource>
-void ErrorPointToPlaneSim3<Scalar, PointReference, PointSource>::setInputCurrent(const PcPtr& in) {
-  current_ = in;
-
-  // Resize the data structures
-  errorVector_.resize(current_->size(), Eigen::NoChange);
-  weightsVector_ = VectorX::Ones(current_->size());
-  J_.setZero(current_->size(), 7);
+void ErrorPointToPlaneSim3<Scalar, PointReference, PointSource>::computeNormalEquations() {
+  JtWJ_.setZero();
+  JtWe_.setZero();
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    computeJacobianBlock(currentPoint(i), currentNormal(i), Ji);
+    const Scalar w = weighted_ ? weightsVector_[i] : 1;
+    JtWJ_.noalias() += w * Ji.transpose() * Ji;
+    JtWe_.noalias() += (w * errorVector_[i]) * Ji.transpose();
+  }
 }
 
 template<typename Scalar, typename PointReference, typename PointSource>
-void ErrorPointToPlaneSim3<Scalar, PointReference, PointSource>::setInputReference(const PrPtr &in) {
-  reference_ = in;
+void ErrorPointToPlaneSim3<Scalar, PointReference, PointSource>::computeErrorAndNormalEquations() {
+  JtWJ_.setZero();
+  JtWe_.setZero();
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    const Vector3 p_c = currentPoint(i);
+    const Vector3 n = currentNormal(i);
+    const Scalar e = n.dot(p_c - referencePoint(i));
+    errorVector_[i] = e;
+    computeJacobianBlock(p_c, n, Ji);
+    JtWJ_.noalias() += Ji.transpose() * Ji;
+    JtWe_.noalias() += e * Ji.transpose();
+  }
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
+  }
 }
 
 /**
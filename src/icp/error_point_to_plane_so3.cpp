@@ -9,76 +9,73 @@
 //
 #include <icp/error_point_to_plane_so3.hpp>
 #include <icp/instanciate.hpp>
-#include <icp/linear_algebra.hpp>
 #include <icp/logging.hpp>
 
 
 namespace icp
 {
 
+template<typename Dtype, typename PointReference, typename PointCurrent>
+void ErrorPointToPlaneSO3<Dtype, PointReference, PointCurrent>::computeJacobianBlock(const Vector3 &p, const Vector3 &n, JacobianBlock &J) {
+  J << p.y() * n.z() - p.z() * n.y(),
+       p.z() * n.x() - p.x() * n.z(),
+       p.x() * n.y() - p.y() * n.x();
+}
+
 template<typename Dtype, typename PointReference, typename PointCurrent>
 void ErrorPointToPlaneSO3<Dtype, PointReference, PointCurrent>::computeJacobian() {
-  const unsigned int n = current_->size();
-  J_.setZero(n, 3);
-  for (unsigned int i = 0; i < n; ++i)
+  J_.setZero(n_, 3);
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
   {
-    const PointCurrent &p = (*current_)[i];
-    J_.row(i) << p.y*p.normal_z - p.z*p.normal_y, p.z*p.normal_x - p.x*p.normal_z, p.x*p.normal_y - p.y*p.normal_x;
+    computeJacobianBlock(currentPoint(i), currentNormal(i), Ji);
+    J_.row(i) = Ji;
   }
 }
 
 template<typename Dtype, typename PointReference, typename PointCurrent>
 void ErrorPointToPlaneSO3<Dtype, PointReference, PointCurrent>::computeError() {
-  // XXX: Does not make use of eigen's map, possible optimization for floats
-
-  PcrPtr pc_e = pcltools::substractPointcloud<PointReference, PointCurrent>(reference_, current_);
-  //Eigen::MatrixXf matrixMap = current_->getMatrixXfMap(3, 4, 0) - reference_->getMatrixXfMap(3, 4, 0);
-
-  for (unsigned int i = 0; i < pc_e->size(); ++i)
+  for (unsigned int i = 0; i < n_; ++i)
   {
-    const auto &p = (*pc_e)[i];
-    const PointCurrent &n = (*current_)[i];
-    errorVector_[i] =  n.normal_x * p.x
-                       + n.normal_y * p.y
-                       + n.normal_z * p.z;
+    errorVector_[i] = currentNormal(i).dot(currentPoint(i) - referencePoint(i));
   }
-  if (!errorVector_.allFinite()) {
-    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_;
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
   }
 }
 
-template<typename Scalar, typename PointReference, typename PointCurrent>
-void ErrorPointToPlaneSO3<Scalar, PointReference, PointCurrent>::setInputCurrent(const PcsPtr &in) {
-  current_ = in;
-
-  // Resize the data structures
-  errorVector_.resize(current_->size(), Eigen::NoChange);
-  weightsVector_ = VectorX::Ones(current_->size());
-  J_.setZero(current_->size(), 6);
-}
-
-template<typename Scalar, typename PointReference, typename PointCurrent>
-void ErrorPointToPlaneSO3<Scalar, PointReference, PointCurrent>::setInputReference(const PcrPtr &in) {
-  reference_ = in;
+template<typename Dtype, typename PointReference, typename PointCurrent>
+void ErrorPointToPlaneSO3<Dtype, PointReference, PointCurrent>::computeNormalEquations() {
+  JtWJ_.setZero();
+  JtWe_.setZero();
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    computeJacobianBlock(currentPoint(i), currentNormal(i), Ji);
+    const Dtype w = weighted_ ? weightsVector_[i] : 1;
+    JtWJ_.noalias() += w * Ji.transpose() * Ji;
+    JtWe_.noalias() += (w * errorVector_[i]) * Ji.transpose();
+  }
 }
 
-template<typename Scalar, typename PointReference, typename PointCurrent>
-Eigen::Matrix<Scalar, 4, 4> ErrorPointToPlaneSO3<Scalar, PointReference, PointCurrent>::update() {
-  auto Jt = J_.transpose();
-  Eigen::Matrix<Scalar, 3, 1> x = -(Jt*J_).ldlt().solve(Jt * errorVector_);
-  // return update step transformation matrix
-  Eigen::Matrix<Scalar, 4, 4> T = Eigen::Matrix<Scalar, 4, 4>::Identity();
-  Eigen::Matrix<Scalar, 3, 3> rot = la::expSO3(x);
-  T(0, 0) = rot(0, 0);
-  T(0, 1) = rot(0, 1);
-  T(0, 2) = rot(0, 2);
-  T(1, 0) = rot(1, 0);
-  T(1, 1) = rot(1, 1);
-  T(1, 2) = rot(1, 2);
-  T(2, 0) = rot(2, 0);
-  T(2, 1) = rot(2, 1);
-  T(2, 2) = rot(2, 2);
-  return  T;
+template<typename Dtype, typename PointReference, typename PointCurrent>
+void ErrorPointToPlaneSO3<Dtype, PointReference, PointCurrent>::computeErrorAndNormalEquations() {
+  JtWJ_.setZero();
+  JtWe_.setZero();
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    const Vector3 p_c = currentPoint(i);
+    const Vector3 n = currentNormal(i);
+    const Dtype e = n.dot(p_c - referencePoint(i));
+    errorVector_[i] = e;
+    computeJacobianBlock(p_c, n, Ji);
+    JtWJ_.noalias() += Ji.transpose() * Ji;
+    JtWe_.noalias() += e * Ji.transpose();
+  }
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
+  }
 }
 
 /**
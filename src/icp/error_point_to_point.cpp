@@ -6,46 +6,115 @@
 namespace icp
 {
 
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint<Scalar, PointReference, PointSource>::computeJacobianBlock(const Vector3 &p, JacobianBlock &J) {
+  J <<  -1,     0,    0,      0,   -p.z(),   p.y(),
+         0,    -1,    0,  p.z(),        0,  -p.x(),
+         0,     0,   -1, -p.y(),    p.x(),        0;
+}
+
 template<typename Scalar, typename PointReference, typename PointSource>
 void ErrorPointToPoint<Scalar, PointReference, PointSource>::computeJacobian() {
-  const unsigned int n = reference_->size();
-  JacobianMatrix J;
-  J.setZero(3 * n, 6);
-  pcl::PointXYZ p;
-  for (unsigned int i = 0; i < n; ++i)
+  J_.resize(3 * n_, 6);
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
   {
-    const PointReference &p_t =  (*reference_)[i];
-    p.x = p_t.x;
-    p.y = p_t.y;
-    p.z = p_t.z;
-    J.row(i * 3)     <<  -1,     0,    0,    0,   -p.z,   p.y;
-    J.row(i * 3 + 1) <<  0,    -1,    0,  p.z,      0,  -p.x;
-    J.row(i * 3 + 2) <<  0,     0,   -1, -p.y,    p.x,     0;
+    computeJacobianBlock(referencePoint(i), Ji);
+    J_.block(i * 3, 0, 3, 6) = Ji;
   }
-  constraints_->processJacobian(J, J_);
+  // Fixed parameters do not move the points
+  constraints_->cancelFixedColumns(J_);
 }
 
 template<typename Scalar, typename PointReference, typename PointSource>
 void ErrorPointToPoint<Scalar, PointReference, PointSource>::computeError() {
-  // XXX: Does not make use of eigen's map, possible optimization for floats
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    errorVector_.template segment<3>(i * 3) = referencePoint(i) - currentPoint(i);
+  }
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
+  }
+}
 
-  PcPtr pc_e = pcltools::substractPointcloud<PointSource, PointReference>(current_, reference_);
-  //Eigen::MatrixXf matrixMap = current_->getMatrixXfMap(3, 4, 0) - reference_->getMatrixXfMap(3, 4, 0);
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint<Scalar, PointReference, PointSource>::computeNormalEquations() {
+  JtWJ_.setZero();
+  JtWe_.setZero();
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    computeJacobianBlock(referencePoint(i), Ji);
+    const Vector3 e = errorVector_.template segment<3>(i * 3);
+    if (weighted_) {
+      const Vector3 w = weightsVector_.template segment<3>(i * 3);
+      JtWJ_.noalias() += Ji.transpose() * w.asDiagonal() * Ji;
+      JtWe_.noalias() += Ji.transpose() * w.cwiseProduct(e);
+    } else {
+      JtWJ_.noalias() += Ji.transpose() * Ji;
+      JtWe_.noalias() += Ji.transpose() * e;
+    }
+  }
+}
 
-  pcl::PointXYZ p;
-  for (unsigned int i = 0; i < pc_e->size(); ++i)
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint<Scalar, PointReference, PointSource>::computeErrorAndNormalEquations() {
+  JtWJ_.setZero();
+  JtWe_.setZero();
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
   {
-    const PointSource &p_t = (*pc_e)[i];
-    p.x = p_t.x;
-    p.y = p_t.y;
-    p.z = p_t.z;
-    errorVector_[i * 3] = p.x;
-    errorVector_[i * 3 + 1] =  p.y;
-    errorVector_[i * 3 + 2] =  p.z;
+    const Vector3 p_r = referencePoint(i);
+    const Vector3 e = p_r - currentPoint(i);
+    errorVector_.template segment<3>(i * 3) = e;
+    computeJacobianBlock(p_r, Ji);
+    JtWJ_.noalias() += Ji.transpose() * Ji;
+    JtWe_.noalias() += Ji.transpose() * e;
   }
-  if (!errorVector_.allFinite()) {
-    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_;
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
+  }
+}
+
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint<Scalar, PointReference, PointSource>::computeClosedForm() {
+  if (constraints_->hasConstraints()) {
+    computeNormalEquations();
+    return;
+  }
+  resetClosedForm();
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    const Scalar w = weighted_ ? weightsVector_.template segment<3>(i * 3).minCoeff() : 1;
+    accumulateClosedForm(currentPoint(i), referencePoint(i), w);
+  }
+}
+
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint<Scalar, PointReference, PointSource>::computeErrorAndClosedForm() {
+  if (constraints_->hasConstraints()) {
+    computeErrorAndNormalEquations();
+    return;
+  }
+  resetClosedForm();
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    const Vector3 p_r = referencePoint(i);
+    const Vector3 p_c = currentPoint(i);
+    errorVector_.template segment<3>(i * 3) = p_r - p_c;
+    accumulateClosedForm(p_c, p_r, 1);
+  }
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
+  }
+}
+
+template<typename Scalar, typename PointReference, typename PointSource>
+Eigen::Matrix<Scalar, 4, 4> ErrorPointToPoint<Scalar, PointReference, PointSource>::closedFormUpdate() {
+  if (constraints_->hasConstraints()) {
+    return this->update();
   }
+  return closedFormTransformation(true, false);
 }
 
 INSTANCIATE_ERROR_POINT_TO_POINT;
@@ -0,0 +1,132 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <icp/error_point_to_point_2d.hpp>
+#include <icp/instanciate.hpp>
+#include <icp/logging.hpp>
+#include <cmath>
+
+namespace icp
+{
+
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint2D<Scalar, PointReference, PointSource>::computeJacobianBlock(const Vector2 &p, JacobianBlock &J) {
+  J << -1,  0,  p.y(),
+        0, -1, -p.x();
+}
+
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint2D<Scalar, PointReference, PointSource>::computeJacobian() {
+  J_.resize(2 * n_, 3);
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    computeJacobianBlock(referencePoint(i).template head<2>(), Ji);
+    J_.block(i * 2, 0, 2, 3) = Ji;
+  }
+}
+
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint2D<Scalar, PointReference, PointSource>::computeError() {
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    errorVector_.template segment<2>(i * 2) = (referencePoint(i) - currentPoint(i)).template head<2>();
+  }
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
+  }
+}
+
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint2D<Scalar, PointReference, PointSource>::computeNormalEquations() {
+  JtWJ_.setZero();
+  JtWe_.setZero();
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    computeJacobianBlock(referencePoint(i).template head<2>(), Ji);
+    const Vector2 e = errorVector_.template segment<2>(i * 2);
+    if (weighted_) {
+      const Vector2 w = weightsVector_.template segment<2>(i * 2);
+      JtWJ_.noalias() += Ji.transpose() * w.asDiagonal() * Ji;
+      JtWe_.noalias() += Ji.transpose() * w.cwiseProduct(e);
+    } else {
+      JtWJ_.noalias() += Ji.transpose() * Ji;
+      JtWe_.noalias() += Ji.transpose() * e;
+    }
+  }
+}
+
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint2D<Scalar, PointReference, PointSource>::computeErrorAndNormalEquations() {
+  JtWJ_.setZero();
+  JtWe_.setZero();
+  JacobianBlock Ji;
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    const Vector2 p_r = referencePoint(i).template head<2>();
+    const Vector2 e = p_r - currentPoint(i).template head<2>();
+    errorVector_.template segment<2>(i * 2) = e;
+    computeJacobianBlock(p_r, Ji);
+    JtWJ_.noalias() += Ji.transpose() * Ji;
+    JtWe_.noalias() += Ji.transpose() * e;
+  }
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
+  }
+}
+
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint2D<Scalar, PointReference, PointSource>::computeClosedForm() {
+  resetClosedForm();
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    const Scalar w = weighted_ ? weightsVector_.template segment<2>(i * 2).minCoeff() : 1;
+    accumulateClosedForm(currentPoint(i), referencePoint(i), w);
+  }
+}
+
+template<typename Scalar, typename PointReference, typename PointSource>
+void ErrorPointToPoint2D<Scalar, PointReference, PointSource>::computeErrorAndClosedForm() {
+  resetClosedForm();
+  for (unsigned int i = 0; i < n_; ++i)
+  {
+    const Vector3 p_r = referencePoint(i);
+    const Vector3 p_c = currentPoint(i);
+    errorVector_.template segment<2>(i * 2) = (p_r - p_c).template head<2>();
+    accumulateClosedForm(p_c, p_r, 1);
+  }
+  if (!errorVector_.head(rows_).allFinite()) {
+    LOG(WARNING) << "Error Vector has NaN values\n!" << errorVector_.head(rows_);
+  }
+}
+
+template<typename Scalar, typename PointReference, typename PointSource>
+Eigen::Matrix<Scalar, 4, 4> ErrorPointToPoint2D<Scalar, PointReference, PointSource>::closedFormUpdate() {
+  Eigen::Matrix4d T = Eigen::Matrix4d::Identity();
+  if (closedFormWeight_ <= 0) {
+    return T.cast<Scalar>();
+  }
+  // Only x and y of the sums matter, z is left untouched
+  const Eigen::Vector2d centroid_current = sumCurrent_.template head<2>() / closedFormWeight_;
+  const Eigen::Vector2d centroid_reference = sumReference_.template head<2>() / closedFormWeight_;
+  const Eigen::Matrix2d H = sumCross_.template topLeftCorner<2, 2>() / closedFormWeight_
+                            - centroid_reference * centroid_current.transpose();
+
+  // Maximizes tr(R^T H) over the planar rotations
+  const double theta = std::atan2(H(1, 0) - H(0, 1), H(0, 0) + H(1, 1));
+  const Eigen::Matrix2d R = Eigen::Rotation2Dd(theta).toRotationMatrix();
+  T.topLeftCorner<2, 2>() = R;
+  T.topRightCorner<2, 1>() = centroid_reference - R * centroid_current;
+  return T.cast<Scalar>();
+}
+
+INSTANCIATE_ERROR_POINT_TO_POINT_2D;
+
+}  // namespace icp
@@ -0,0 +1,36 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <icp/error_se2.hpp>
+#include <icp/instanciate.hpp>
+#include <icp/linear_algebra.hpp>
+
+namespace icp
+{
+
+template<typename Scalar, typename PointReference, typename PointCurrent>
+typename ErrorSE2<Scalar, PointReference, PointCurrent>::Gradient
+ErrorSE2<Scalar, PointReference, PointCurrent>::solve(const Hessian &A, const Gradient &b) const {
+  Hessian inverse;
+  bool invertible;
+  A.computeInverseWithCheck(inverse, invertible);
+  if (invertible) {
+    return inverse * b;
+  }
+  return A.ldlt().solve(b);
+}
+
+template<typename Scalar, typename PointReference, typename PointCurrent>
+Eigen::Matrix<Scalar, 4, 4> ErrorSE2<Scalar, PointReference, PointCurrent>::expTwist(const Gradient &x) const {
+  return la::expSE2(x);
+}
+
+INSTANCIATE_ERROR_SE2;
+
+}  // namespace icp
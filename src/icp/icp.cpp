@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <limits>
+#include <thread>
+#include <icp/eigentools.hpp>
 #include <icp/icp.hpp>
 #include <icp/mestimator.hpp>
 #include <icp/error_point_to_point.hpp>
@@ -6,97 +11,281 @@
 #include <icp/instanciate.hpp>
 #include <icp/logging.hpp>
 #include <icp/linear_algebra.hpp>
+#include <icp/pcltools.hpp>
+#include <icp/profiling.hpp>
 
 
 namespace icp {
 
+namespace
+{
+// Below this many current points per thread, the correspondence search runs
+// on the calling thread only
+const unsigned int kMinPointsPerThread = 128;
+}
 
-template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_>
-void Icp_<Dtype, PointReference, PointCurrent, Error_>::initialize(const PcPtr &current,
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+void Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::initialize(const PcPtr &current,
     const PrPtr &reference,
     const IcpParameters &param) {
   setInputCurrent(current);
   setInputReference(reference);
-  param_ = param;
+  setParameters(param);
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+void Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::findNearestNeighbors(
+  const Search_ &search,
+  const PcPtr &src,
+  const std::vector<int> *samples,
+  const Eigen::Matrix<Dtype, 4, 4> &T,
+  Dtype max_correspondance_distance,
+  unsigned int begin, unsigned int end,
+  SearchBuffer &buffer) const {
+  buffer.indices_src.clear();
+  buffer.indices_target.clear();
+  buffer.distances.clear();
+  buffer.indices_src.reserve(end - begin);
+  buffer.indices_target.reserve(end - begin);
+  buffer.distances.reserve(end - begin);
+
+  // The current points are transformed on the fly
+  const Eigen::Matrix<float, 3, 3> R = T.template block<3, 3>(0, 0).template cast<float>();
+  const Eigen::Matrix<float, 3, 1> t = T.template block<3, 1>(0, 3).template cast<float>();
+  const float max_sqr_distance = static_cast<float>(max_correspondance_distance) * max_correspondance_distance;
+  int index;
+  float sqr_distance;
+  for (unsigned int s = begin; s < end; s++) {
+    const int i = samples ? (*samples)[s] : s;
+    const Eigen::Vector3f pt = R * (*src)[i].getVector3fMap() + t;
+
+    // Look for the nearest neighbor, ignoring those that are too far
+    if (search.nearest(pt, max_sqr_distance, index, sqr_distance)) {
+      buffer.indices_src.push_back(i);
+      buffer.indices_target.push_back(index);
+      buffer.distances.push_back(sqr_distance);
+    }
+  }
 }
 
-template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_>
-void Icp_<Dtype, PointReference, PointCurrent, Error_>::findNearestNeighbors(
-  const pcl::PointCloud<pcl::PointXYZ>::Ptr &src,
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+void Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::findNearestNeighbors(
+  const Search_ &search,
+  const PcPtr &src,
+  const std::vector<int> *samples,
+  const Eigen::Matrix<Dtype, 4, 4> &T,
   Dtype max_correspondance_distance,
-  std::vector<int> &indices_ref,
-  std::vector<int> &indices_current,
+  std::vector<int> &indices_src,
+  std::vector<int> &indices_target,
   std::vector<Dtype> &distances) {
-  // We're only interrested in the nearest point
-  const int K = 1;
-  indices_ref.clear();
-  indices_current.clear();
-  indices_ref.reserve(src->size());
-  indices_current.reserve(src->size());
-  distances.clear();
-  distances.reserve(src->size());
-  std::vector<int> pointIdxNKNSearch(K);
-  std::vector<Dtype> pointNKNSquaredDistance(K);
-
-  PointReference pt;
-  for (unsigned int i = 0; i < src->size(); i++) {
-    // Copy only coordinates from the point (for genericity)
-    pt.x = src->at(i).x;
-    pt.y = src->at(i).y;
-    pt.z = src->at(i).z;
-
-    // Look for the nearest neighbor
-    if ( kdtree_.nearestKSearch(pt, K, pointIdxNKNSearch,
-                                pointNKNSquaredDistance) > 0 ) {
-      Dtype distance = pointNKNSquaredDistance[0];
-      if (distance <= max_correspondance_distance * max_correspondance_distance) {
-        indices_ref.push_back(i);
-        indices_current.push_back(pointIdxNKNSearch[0]);
-        distances.push_back(distance);
-      } else {
-        //LOG(INFO) << "Ignoring, distance too big << " << distance;
+  const unsigned int n = samples ? samples->size() : src->size();
+  unsigned int num_threads = param_.num_threads;
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  search_workers_.resize(num_threads);
+  search_buffers_.resize(search_workers_.size());
+
+  // Each thread searches a contiguous chunk of the current cloud into its own
+  // buffer. Chunks are then concatenated in order, so that the output is the
+  // same whatever the number of threads. Small clouds and coarse levels are
+  // not worth waking the workers up.
+  const unsigned int num_chunks = std::max(1u, std::min(search_workers_.size(), n / kMinPointsPerThread));
+  const unsigned int chunk = (n + num_chunks - 1) / num_chunks;
+  for (unsigned int t = num_chunks; t < search_buffers_.size(); ++t) {
+    search_buffers_[t].indices_src.clear();
+    search_buffers_[t].indices_target.clear();
+    search_buffers_[t].distances.clear();
+  }
+  if (num_chunks == 1) {
+    findNearestNeighbors(search, src, samples, T, max_correspondance_distance, 0, n, search_buffers_[0]);
+  } else {
+    search_workers_.run([this, &search, &src, samples, &T, max_correspondance_distance, n, num_chunks,
+                         chunk](unsigned int t) {
+      if (t < num_chunks) {
+        const unsigned int begin = std::min(n, t * chunk);
+        const unsigned int end = std::min(n, begin + chunk);
+        findNearestNeighbors(search, src, samples, T, max_correspondance_distance, begin, end,
+                             search_buffers_[t]);
       }
-    } else {
-      LOG(WARNING) << "Could not find a nearest neighbor for point " << i;
+    });
+  }
+
+  indices_src.clear();
+  indices_target.clear();
+  distances.clear();
+  indices_src.reserve(n);
+  indices_target.reserve(n);
+  distances.reserve(n);
+  for (const SearchBuffer &buffer : search_buffers_) {
+    indices_src.insert(indices_src.end(), buffer.indices_src.begin(), buffer.indices_src.end());
+    indices_target.insert(indices_target.end(), buffer.indices_target.begin(), buffer.indices_target.end());
+    distances.insert(distances.end(), buffer.distances.begin(), buffer.distances.end());
+  }
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+void Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::buildReferencePyramid() {
+  const unsigned int levels = param_.pyramid.size();
+  reference_pyramid_.resize(levels);
+  for (unsigned int l = 0; l < levels; ++l) {
+    const Dtype resolution = param_.pyramid[l].resolution;
+    if (!reference_pyramid_[l] || reference_pyramid_[l]->resolution != resolution) {
+      reference_pyramid_[l] = reference_->getLevel(resolution);
+    }
+  }
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+void Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::buildPyramid() {
+  buildReferencePyramid();
+  const unsigned int levels = param_.pyramid.size();
+  current_pyramid_.resize(levels);
+  for (unsigned int l = 0; l < levels; ++l) {
+    const Dtype resolution = param_.pyramid[l].resolution;
+    // The current cloud may have changed in place since the previous run
+    if (!current_pyramid_[l]) {
+      current_pyramid_[l].reset(new Pc());
     }
+    pcltools::voxelDownsample<PointCurrent>(P_current_, resolution, current_pyramid_[l]);
   }
 }
 
-template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_>
-void Icp_<Dtype, PointReference, PointCurrent, Error_>::run() {
-  // Cleanup
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+void Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::run() {
+  // Cleanup, each run starts from the initial guess
   r_.clear();
+  T_ = Eigen::Matrix<Dtype, 4, 4>::Identity();
+  unsigned int total_iter = param_.max_iter;
+  for (const IcpPyramidLevel_<Dtype> &level : param_.pyramid) {
+    total_iter += level.max_iter;
+  }
+  r_.registrationError.reserve(total_iter + 2 * (param_.pyramid.size() + 1));
+
+  damping_ = param_.lm_initial_damping;
+  damping_growth_ = 2;
+
+  // Same samples from one run to the next
+  sampler_.seed(param_.sampling_seed);
+  sampled_cloud_ = 0;
+
+  if (trace_) {
+    trace_->beginRun(param_.initial_guess.template cast<float>(), P_current_->size(),
+                     reference_->getCloud()->size(), total_iter);
+  }
+
+  // Coarse to fine: each level starts from the estimate of the previous one
+  {
+    ICP_PROFILE_SCOPE(r_.profile.pyramid_time);
+    buildPyramid();
+  }
+#if ICP_PROFILING_ENABLED
+  r_.profile.iterations.reserve(total_iter);
+  r_.profile.index_build_time = reference_->getBuildTime();
+  for (const typename ReferenceModel::LevelConstPtr &level : reference_pyramid_) {
+    r_.profile.index_build_time += level->build_time;
+  }
+#endif
+  bool failed = false;
+  for (level_ = 0; level_ < static_cast<int>(param_.pyramid.size()) && !failed; ++level_) {
+    LOG(INFO) << "Pyramid level " << level_ << ", resolution " << param_.pyramid[level_].resolution
+              << ", " << current_pyramid_[level_]->size() << " current points";
+    // The next levels would start from a meaningless pose
+    failed = runLevel(param_.pyramid[level_].max_iter) == STOP_FAILED;
+  }
+  level_ = -1;
+
+  r_.stop_reason = failed ? STOP_FAILED : runLevel(param_.max_iter);
+  // An error that stops decreasing does not mean that the criteria required
+  // together were met
+  r_.has_converged = r_.stop_reason != STOP_FAILED && r_.stop_reason != STOP_MAX_ITERATIONS
+                     && !(r_.stop_reason == STOP_NO_DECREASE && param_.convergence_policy == CONVERGENCE_ALL);
+  if (trace_) {
+    trace_->endRun(r_.stop_reason, r_.transformation.template cast<float>(), r_.registrationError.size());
+  }
+  LOG(INFO) << "ICP stopped after " << iter_ << " iterations: " << toString(r_.stop_reason);
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+StopReason Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::runLevel(unsigned int max_iter) {
   iter_ = 0;
-  boost::optional<Dtype> error_variation;
-
-  // Stopping condition. ICP will stop when one of two things
-  // happens
-  // - The error variation drops below a small threshold min_variation
-  // - The number of iteration reaches the maximum max_iter allowed
-  bool converged = false;
-  while ((converged = step()) && (!error_variation || (error_variation && *error_variation < 0 &&
-                                         -*error_variation > param_.min_variation &&
-                                         iter_ <= param_.max_iter)))  {
-    error_variation = r_.getLastErrorVariation();
-
-    if (error_variation) {
-      LOG(INFO) << "Iteration " << iter_ << "/" << param_.max_iter <<
-                std::setprecision(8) << ", E=" << r_.getLastError() <<
-                ", error_variation=" << *error_variation;
-    } else {
-      LOG(INFO) << "Iteration " << iter_ << "/" << param_.max_iter <<
-                std::setprecision(8) << ", E=" << r_.getLastError() <<
-                ", error_variation=none";
+  boost::optional<Dtype> previous_error;
+
+  // The error is only compared within the level, the error of downsampled
+  // clouds can not be compared with the next ones.
+  while (true) {
+    if (!step()) {
+      return STOP_FAILED;
+    }
+    const Dtype error = *r_.getLastError();
+    LOG(INFO) << "Iteration " << iter_ << "/" << max_iter << std::setprecision(8)
+              << ", E=" << error << ", RMSE=" << r_.rmse
+              << ", increment=" << rotation_increment_ << " rad, " << translation_increment_;
+
+    const StopReason reason = checkConvergence(previous_error);
+    if (reason != STOP_NONE) {
+      return reason;
+    }
+    if (iter_ >= max_iter) {
+      return STOP_MAX_ITERATIONS;
     }
+    previous_error = error;
   }
-  r_.has_converged = converged && (iter_ <= param_.max_iter);
 }
 
-template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_>
-bool Icp_<Dtype, PointReference, PointCurrent, Error_>::step() {
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+StopReason Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::checkConvergence(
+  const boost::optional<Dtype> &previous_error) const {
+  const Dtype error = *r_.getLastError();
+  // Whatever the criteria, there is no point in going on once the error
+  // stops decreasing
+  if (previous_error && error >= *previous_error) {
+    return STOP_NO_DECREASE;
+  }
+
+  // Enabled criteria, in the order they are reported
+  StopReason met[4];
+  unsigned int num_enabled = 0, num_met = 0;
+  if (param_.min_variation > 0) {
+    ++num_enabled;
+    if (previous_error && *previous_error - error <= param_.min_variation) {
+      met[num_met++] = STOP_ABSOLUTE_VARIATION;
+    }
+  }
+  if (param_.min_relative_variation > 0) {
+    ++num_enabled;
+    if (previous_error && *previous_error - error <= param_.min_relative_variation * *previous_error) {
+      met[num_met++] = STOP_RELATIVE_VARIATION;
+    }
+  }
+  if (param_.min_rotation_increment > 0 || param_.min_translation_increment > 0) {
+    ++num_enabled;
+    if ((param_.min_rotation_increment <= 0 || rotation_increment_ <= param_.min_rotation_increment) &&
+        (param_.min_translation_increment <= 0 || translation_increment_ <= param_.min_translation_increment)) {
+      met[num_met++] = STOP_INCREMENT;
+    }
+  }
+  if (param_.max_rmse > 0) {
+    ++num_enabled;
+    if (r_.rmse <= param_.max_rmse) {
+      met[num_met++] = STOP_RMSE;
+    }
+  }
+
+  if (num_met == 0) {
+    return STOP_NONE;
+  }
+  if (param_.convergence_policy == CONVERGENCE_ANY) {
+    return met[0];
+  }
+  return num_met == num_enabled ? STOP_ALL_CRITERIA : STOP_NONE;
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+bool Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::step() {
   /**
    * Notations:
-   * - P_ref_: reference point cloud \f[ P^* \f]
+   * - reference_: reference point cloud \f[ P^* \f]
    * - P_current_: \f[ P \f], current point cloud (CAO model, cloud extracted from one sensor
    * view....)
    * - xk: pose twist to be optimized \f[ \xi \f]
@@ -104,71 +293,137 @@ bool Icp_<Dtype, PointReference, PointCurrent, Error_>::step() {
    * - hat_T: previous pose
    **/
 
+  // Clouds of the current pyramid level
+  const bool full_resolution = level_ < 0;
+  const PcPtr &current = full_resolution ? P_current_ : current_pyramid_[level_];
+  const typename ReferenceModel::PrConstPtr &reference = full_resolution ? reference_->getCloud()
+      : reference_pyramid_[level_]->cloud;
+  const Search_ &search = full_resolution ? reference_->getSearch() : reference_pyramid_[level_]->search;
+  const Dtype max_correspondance_distance = full_resolution ? param_.max_correspondance_distance
+      : param_.pyramid[level_].max_correspondance_distance;
+
   ++iter_;
-  if (P_current_->size() == 0) {
+  std::chrono::steady_clock::time_point start;
+  if (trace_) {
+    start = std::chrono::steady_clock::now();
+  }
+#if ICP_PROFILING_ENABLED
+  r_.profile.iterations.push_back(IcpIterationProfile());
+  IcpIterationProfile &profile = r_.profile.iterations.back();
+  profile.level = level_;
+#endif
+  if (current->size() == 0) {
     convergenceFailed();
     return false;
   }
 
-  std::vector<int> indices_ref;
-  std::vector<int> indices_current;
-  std::vector<Dtype> distances;
-  PcPtr P_current_transformed(new Pc());
-  PcPtr P_current_phi(new Pc());
-  PrPtr P_ref_phi(new Pr());
-
-  pcl::transformPointCloud(*P_current_, *P_current_transformed, T_);
-  // XXX only convert if needed!
-  pcl::PointCloud<pcl::PointXYZ>::Ptr P_current_transformed_xyz(new pcl::PointCloud<pcl::PointXYZ>());
-  pcl::copyPointCloud(*P_current_transformed, *P_current_transformed_xyz);
-
-  if (P_current_transformed_xyz->size() == 0) {
-    LOG(ERROR) << "Error: ICP can't run on empty pointclouds!";
-    convergenceFailed();
-    return false;
+  // Only a sample of the current points takes part in the iteration
+  const std::vector<int> *samples = 0;
+  if (param_.sampling != SAMPLING_NONE && param_.sample_size < current->size()) {
+    bool resample = iter_ == 1 || (param_.sampling_period > 0 && (iter_ - 1) % param_.sampling_period == 0);
+    if (sampled_cloud_ != current.get()) {
+      sampler_.setInputCloud(current);
+      sampled_cloud_ = current.get();
+      resample = true;
+    }
+    if (resample) {
+      ICP_PROFILE_SCOPE(profile.sampling_time);
+      sampler_.sample(param_.sampling, param_.sample_size, workspace_.samples);
+    }
+    samples = &workspace_.samples;
   }
 
   try {
-    findNearestNeighbors(P_current_transformed_xyz, param_.max_correspondance_distance,
-                         indices_ref, indices_current, distances);
+    ICP_PROFILE_SCOPE(profile.search_time);
+    // The reference cloud is searched in its own frame: the current points are
+    // moved by the initial guess as well, which scales distances
+    findNearestNeighbors(search, current, samples, param_.initial_guess * T_,
+                         initial_guess_scale_ * max_correspondance_distance,
+                         workspace_.indices_current, workspace_.indices_reference, workspace_.distances);
   } catch (...) {
     LOG(WARNING) << "Could not find the nearest neighbors in the KD-Tree, impossible to run ICP without them!";
     return false;
   }
 
-  if (indices_ref.size() == 0) {
+  const unsigned int num_queries = samples ? samples->size() : current->size();
+  ICP_PROFILE(profile.num_queries = num_queries);
+  ICP_PROFILE(profile.num_correspondences = workspace_.indices_current.size());
+  ICP_PROFILE(profile.num_rejected = profile.num_queries - profile.num_correspondences);
+
+  if (workspace_.indices_current.size() == 0) {
     LOG(ERROR) << "Error: No nearest neightbors found";
     convergenceFailed();
     return false;
   }
 
+  // The error reads the matched points directly through the correspondence
+  // indices, and transforms the current ones on the fly
+  err_.setInputReference(reference);
+  err_.setInputCurrent(current);
+  err_.setCorrespondences(workspace_.indices_current, workspace_.indices_reference);
+  err_.setReferenceTransformation(initial_guess_inv_);
+  err_.setMEstimator(param_.mestimator_type, param_.mestimator_tuning, param_.mestimator_scale,
+                     param_.mestimator_fixed_scale, param_.mestimator_scale_tolerance);
 
-  // Generate new current point cloud with only the matches in it
-  // XXX: Speed improvement possible by using the indices directly instead of
-  // generating a new pointcloud. Maybe PCL has stuff to do it.
-  pcltools::subPointCloud<PointCurrent>(P_current_transformed, indices_ref, P_current_phi);
-  pcltools::subPointCloud<PointReference>(P_ref_init_inv, indices_current, P_ref_phi);
+  // Several updates may be computed from these correspondences. The motion of
+  // the matched current points since the search is bounded from the radius
+  // of their bounding sphere.
+  const unsigned int inner_iterations = std::max(1u, param_.inner_iterations);
+  const Eigen::Matrix<Dtype, 4, 4> T_search = T_;
+  Dtype radius = 0;
+  if (inner_iterations > 1) {
+    for (const int i : workspace_.indices_current) {
+      const Eigen::Matrix<Dtype, 3, 1> p = (*current)[i].getVector3fMap().template cast<Dtype>();
+      radius = std::max(radius, (T_search.template topLeftCorner<3, 3>() * p
+                                 + T_search.template topRightCorner<3, 1>()).norm());
+    }
+  }
 
-  // Update the reference point cloud to use the previously estimated one
-  err_.setInputReference(P_ref_phi);
-  err_.setInputCurrent(P_current_phi);
-  // Computes the Jacobian
-  err_.computeJacobian();
+  Dtype E = 0;
+  for (unsigned int inner = 0; inner < inner_iterations; ++inner) {
+    // Residuals and Jacobians at the updated pose
+    err_.setTransformation(T_);
+    linearize();
+    if (inner == 0) {
+      // Error at the pose of the search, before the solver evaluates other ones
+      E = err_.getErrorNorm();
+    }
 
-  // Computes the error
-  err_.computeError();
+    // Computes the update-step
+    Eigen::Matrix<Dtype, 4, 4> increment;
+    {
+      ICP_PROFILE_SCOPE(profile.solve_time);
+      switch (param_.solver) {
+        case SOLVER_LEVENBERG_MARQUARDT:
+          increment = levenbergMarquardtUpdate();
+          break;
+        case SOLVER_CLOSED_FORM:
+          increment = err_.closedFormUpdate();
+          break;
+        default:
+          increment = err_.update();
+      }
+    }
+    T_ = increment * T_;
 
-  // Initialize mestimator weights from point cloud
-  if (param_.mestimator) {
-    err_.computeWeights();
+    if (inner + 1 < inner_iterations) {
+      // Stop once the inner solve has converged, or once the points moved
+      // enough for their nearest neighbors to have changed
+      if (displacementBound(increment, radius) <= param_.inner_min_displacement ||
+          displacementBound(T_ * T_search.inverse(), radius) >= param_.inner_max_displacement) {
+        break;
+      }
+    }
   }
 
-  // Transforms the reference point cloud according to new twist
-  // Computes the Gauss-Newton update-step
-  T_ = err_.update() * T_;
+  // Size of the increment since the search, for the convergence criteria
+  const Eigen::Matrix<Dtype, 4, 4> increment = T_ * T_search.inverse();
+  rotation_increment_ = eigentools::rotationAngle(increment);
+  translation_increment_ = increment.template topRightCorner<3, 1>().norm();
 
-  Dtype E = err_.getErrorNorm();
   r_.registrationError.push_back(E);
+  r_.rmse = E / std::sqrt(static_cast<Dtype>(workspace_.indices_current.size()));
+  r_.inlier_ratio = static_cast<Dtype>(workspace_.indices_current.size()) / num_queries;
   r_.transformation = param_.initial_guess * T_ ;
   r_.relativeTransformation = T_;
   try {
@@ -180,9 +435,111 @@ bool Icp_<Dtype, PointReference, PointCurrent, Error_>::step() {
   if (std::isinf(E)) {
     LOG(WARNING) << "Error is infinite!";
   }
+  if (trace_) {
+    traceIteration(num_queries, start);
+  }
   return true;
 }
 
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+void Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::traceIteration(
+  unsigned int num_queries, const std::chrono::steady_clock::time_point &start) {
+  IcpTraceIteration it;
+  it.level = level_;
+  it.iteration = iter_;
+  it.transformation = r_.transformation.template cast<float>();
+  it.error = r_.registrationError.back();
+  it.rmse = r_.rmse;
+  it.rotation_increment = rotation_increment_;
+  it.translation_increment = translation_increment_;
+  it.num_queries = num_queries;
+  it.num_correspondences = workspace_.indices_current.size();
+  // Weights of the last linearization, those of the accepted update. Without
+  // M-estimator they are all 1, as initialized.
+  const Eigen::VectorBlock<const typename Error_::VectorX> w = err_.getWeights();
+  if (err_.isWeighted() && w.size() > 0) {
+    it.weight_min = w.minCoeff();
+    it.weight_mean = w.mean();
+    it.weight_max = w.maxCoeff();
+    it.num_downweighted = (w.array() < 1).count();
+  }
+  it.time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  trace_->writeIteration(it, workspace_.indices_current, workspace_.indices_reference);
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+void Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::linearize() {
+#if ICP_PROFILING_ENABLED
+  IcpIterationProfile &profile = r_.profile.iterations.back();
+#endif
+  const bool closed_form = param_.solver == SOLVER_CLOSED_FORM;
+  if (param_.mestimator) {
+    // The weights depend on all the residuals, the normal equations can only
+    // be accumulated afterwards
+    {
+      ICP_PROFILE_SCOPE(profile.error_time);
+      err_.computeError();
+    }
+    {
+      ICP_PROFILE_SCOPE(profile.weights_time);
+      err_.computeWeights();
+    }
+    ICP_PROFILE_SCOPE(profile.error_time);
+    if (closed_form) {
+      err_.computeClosedForm();
+    } else {
+      err_.computeNormalEquations();
+    }
+  } else {
+    ICP_PROFILE_SCOPE(profile.error_time);
+    if (closed_form) {
+      err_.computeErrorAndClosedForm();
+    } else {
+      // Single pass: residuals and normal equations at once
+      err_.computeErrorAndNormalEquations();
+    }
+  }
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+Dtype Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::displacementBound(
+  const Eigen::Matrix<Dtype, 4, 4> &increment, Dtype radius) {
+  // |s R p + t - p| <= (|s - 1| + s * angle) |p| + |t|
+  const Dtype scale = std::cbrt(increment.template topLeftCorner<3, 3>().determinant());
+  return (std::abs(scale - 1) + scale * eigentools::rotationAngle(increment)) * radius
+         + increment.template topRightCorner<3, 1>().norm();
+}
+
+template<typename Dtype, typename PointReference, typename PointCurrent, typename Error_, typename Search_>
+Eigen::Matrix<Dtype, 4, 4> Icp_<Dtype, PointReference, PointCurrent, Error_, Search_>::levenbergMarquardtUpdate() {
+  const Dtype cost = err_.getCost();
+  for (unsigned int trial = 0; trial < param_.lm_max_trials; ++trial) {
+    Dtype predicted_decrease;
+    const Eigen::Matrix<Dtype, 4, 4> increment = err_.update(damping_, predicted_decrease);
+
+    // Error at the candidate pose, with the same correspondences (and weights)
+    err_.setTransformation(increment * T_);
+    err_.computeError();
+    const Dtype decrease = cost - err_.getCost();
+    if (decrease > 0 && predicted_decrease > 0) {
+      // Accepted: the better the linear model predicted the decrease, the
+      // less the next step is damped
+      const Dtype rho = decrease / predicted_decrease;
+      const Dtype x = 2 * rho - 1;
+      damping_ *= std::max(Dtype(1) / 3, 1 - x * x * x);
+      damping_growth_ = 2;
+      return increment;
+    }
+    // Rejected: shrink the trust region
+    damping_ = std::max(damping_, std::numeric_limits<Dtype>::epsilon()) * damping_growth_;
+    damping_growth_ *= 2;
+  }
+  LOG(INFO) << "No Levenberg-Marquardt step decreased the error, damping " << damping_;
+  // Back to the residuals of the pose, not those of the last rejected step
+  err_.setTransformation(T_);
+  err_.computeError();
+  return Eigen::Matrix<Dtype, 4, 4>::Identity();
+}
 
 INSTANCIATE_ICP;
 
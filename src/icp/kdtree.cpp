@@ -0,0 +1,155 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <icp/kdtree.hpp>
+#include <icp/instanciate.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace icp
+{
+
+template<typename PointT>
+bool KdTreeFLANNSearch<PointT>::nearest(const Eigen::Vector3f &query, float max_sqr_distance,
+                                        int &index, float &sqr_distance) const {
+  // pcl::KdTreeFLANN's interface requires vectors, keep one set per thread
+  static thread_local std::vector<int> k_indices(1);
+  static thread_local std::vector<float> k_sqr_distances(1);
+  PointT pt;
+  pt.getVector3fMap() = query;
+  if (kdtree_.nearestKSearch(pt, 1, k_indices, k_sqr_distances) > 0
+      && k_sqr_distances[0] <= max_sqr_distance) {
+    index = k_indices[0];
+    sqr_distance = k_sqr_distances[0];
+    return true;
+  }
+  return false;
+}
+
+template<typename PointT, int Dimensions>
+void ImplicitKdTree<PointT, Dimensions>::setInputCloud(const PointCloudConstPtr &cloud) {
+  std::vector<Entry> entries;
+  entries.reserve(cloud->size());
+  for (unsigned int i = 0; i < cloud->size(); ++i) {
+    Entry e;
+    e.point = (*cloud)[i].getVector3fMap().template head<Dimensions>();
+    e.index = i;
+    // Invalid points can not be matched, leave them out of the tree
+    if (e.point.allFinite()) {
+      entries.push_back(e);
+    }
+  }
+  axes_.assign(entries.size(), 0);
+  build(entries, 0, entries.size());
+
+  points_.resize(entries.size());
+  indices_.resize(entries.size());
+  for (unsigned int i = 0; i < entries.size(); ++i) {
+    points_[i] = entries[i].point;
+    indices_[i] = entries[i].index;
+  }
+}
+
+template<typename PointT, int Dimensions>
+void ImplicitKdTree<PointT, Dimensions>::build(std::vector<Entry> &entries, unsigned int begin, unsigned int end) {
+  if (end - begin <= leaf_size_) {
+    return;
+  }
+
+  // Split along the axis of largest extent
+  Vector min = entries[begin].point;
+  Vector max = entries[begin].point;
+  for (unsigned int i = begin + 1; i < end; ++i) {
+    min = min.cwiseMin(entries[i].point);
+    max = max.cwiseMax(entries[i].point);
+  }
+  int axis;
+  (max - min).maxCoeff(&axis);
+
+  // Partition [begin, end[ around its median
+  const unsigned int median = begin + (end - begin) / 2;
+  std::nth_element(entries.begin() + begin, entries.begin() + median, entries.begin() + end,
+  [axis](const Entry & a, const Entry & b) {
+    return a.point[axis] < b.point[axis];
+  });
+  axes_[median] = axis;
+
+  build(entries, begin, median);
+  build(entries, median + 1, end);
+}
+
+template<typename PointT, int Dimensions>
+bool ImplicitKdTree<PointT, Dimensions>::nearest(const Eigen::Vector3f &query3, float max_sqr_distance,
+    int &index, float &sqr_distance) const {
+  struct Range {
+    unsigned int begin;
+    unsigned int end;
+    // Lower bound of the squared distance between query and the range
+    float sqr_bound;
+  };
+  const Vector query = query3.template head<Dimensions>();
+  // Depth first traversal, the stack never holds more than one range per
+  // level of the tree
+  Range stack[64];
+  int top = 0;
+  stack[top++] = {0, static_cast<unsigned int>(points_.size()), 0.f};
+
+  int best = -1;
+  float best_sqr_distance = max_sqr_distance;
+  while (top > 0) {
+    const Range r = stack[--top];
+    if (r.sqr_bound > best_sqr_distance) {
+      continue;
+    }
+
+    if (r.end - r.begin <= leaf_size_) {
+      for (unsigned int i = r.begin; i < r.end; ++i) {
+        const float d = (points_[i] - query).squaredNorm();
+        if (d <= best_sqr_distance) {
+          best_sqr_distance = d;
+          best = i;
+        }
+      }
+      continue;
+    }
+
+    const unsigned int median = r.begin + (r.end - r.begin) / 2;
+    const float d = (points_[median] - query).squaredNorm();
+    if (d <= best_sqr_distance) {
+      best_sqr_distance = d;
+      best = median;
+    }
+
+    // Visit the side of the query first, the other one only if the
+    // splitting plane is close enough
+    const int axis = axes_[median];
+    const float diff = query[axis] - points_[median][axis];
+    const Range left = {r.begin, median, 0.f};
+    const Range right = {median + 1, r.end, 0.f};
+    Range closer = diff < 0 ? left : right;
+    Range further = diff < 0 ? right : left;
+    closer.sqr_bound = r.sqr_bound;
+    further.sqr_bound = std::max(r.sqr_bound, diff * diff);
+    if (further.sqr_bound <= best_sqr_distance) {
+      stack[top++] = further;
+    }
+    stack[top++] = closer;
+  }
+
+  if (best < 0) {
+    return false;
+  }
+  index = indices_[best];
+  sqr_distance = best_sqr_distance;
+  return true;
+}
+
+INSTANCIATE_KDTREE;
+
+}  // namespace icp
@@ -0,0 +1,230 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <icp/mestimator.hpp>
+#include <icp/instanciate.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace icp
+{
+
+template <typename Scalar>
+Scalar defaultTuning(MEstimatorType type) {
+  switch (type) {
+    case MESTIMATOR_HUBER:
+      return 1.345;
+    case MESTIMATOR_TUKEY:
+      return 4.6851;
+    case MESTIMATOR_CAUCHY:
+      return 2.3849;
+    case MESTIMATOR_GEMAN_MCCLURE:
+      return 1;
+    case MESTIMATOR_WELSCH:
+      return 2.9846;
+  }
+  return 1;
+}
+
+namespace
+{
+
+// Consistent with the standard deviation of gaussian residuals
+const double kConsistency = 0.6745;
+
+//! Unsigned integer type of the bits of a floating point type, and number of
+//! bits of its mantissa
+template <typename Scalar>
+struct FloatBits;
+
+template <>
+struct FloatBits<float> {
+  typedef uint32_t Key;
+  static const int mantissa = 23;
+};
+
+template <>
+struct FloatBits<double> {
+  typedef uint64_t Key;
+  static const int mantissa = 52;
+};
+
+/**
+ * @brief Histogram key of |v|: its exponent and first mantissa bits, in the
+ * precision of v. Keys grow with the magnitude, a key spans a relative width
+ * of 2^-bits.
+ */
+template <typename Scalar>
+inline typename FloatBits<Scalar>::Key geometricKey(Scalar v, int shift) {
+  const Scalar magnitude = std::abs(v);
+  typename FloatBits<Scalar>::Key bits;
+  std::memcpy(&bits, &magnitude, sizeof(bits));
+  return bits >> shift;
+}
+
+/**
+ * @brief Middle of the bin of a key
+ */
+template <typename Scalar>
+inline Scalar geometricValue(typename FloatBits<Scalar>::Key key, int shift) {
+  typedef typename FloatBits<Scalar>::Key Key;
+  const Key bits = (key << shift) | (Key(1) << (shift - 1));
+  Scalar value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}  // namespace
+
+template <typename Scalar>
+template <typename Value>
+Scalar RobustScale_<Scalar>::approximateMedian(unsigned int n, const Value &value) {
+  typedef typename FloatBits<Scalar>::Key Key;
+  // The middle of a bin is within 2^-(bits + 1) of its values
+  const int bits = std::max(1, static_cast<int>(std::ceil(-std::log2(2 * tolerance_))));
+  const int key_bits = std::min(bits, 20);
+  const int shift = FloatBits<Scalar>::mantissa - key_bits;
+
+  Key max_key = 0;
+  for (unsigned int i = 0; bits <= 20 && i < n; ++i) {
+    max_key = std::max(max_key, geometricKey<Scalar>(value(i), shift));
+  }
+  const Key range = Key(40) << key_bits;
+  const Key min_key = max_key > range ? max_key - range : 0;
+  const Key bins = max_key - min_key + 1;
+
+  // A histogram larger than the values costs more than selecting the exact
+  // median, and its size grows with the precision
+  if (bits > 20 || 2 * bins + 1 > n) {
+    if (buffer_.size() < n) {
+      buffer_.resize(n);
+    }
+    for (unsigned int i = 0; i < n; ++i) {
+      buffer_[i] = value(i);
+    }
+    return eigentools::medianInPlace(buffer_.data(), n);
+  }
+
+  // Sorted slots: negative values from the largest magnitude, then the
+  // (nearly) null ones, then the positive ones. There are never more slots
+  // than values, reserving them all keeps the number of bins free to vary.
+  if (histogram_.capacity() < n) {
+    histogram_.reserve(n);
+  }
+  histogram_.assign(2 * bins + 1, 0);
+  for (unsigned int i = 0; i < n; ++i) {
+    const Scalar v = value(i);
+    const Key key = geometricKey(v, shift);
+    unsigned int slot = bins;
+    if (key >= min_key) {
+      slot = v < 0 ? bins - 1 - (key - min_key) : bins + 1 + (key - min_key);
+    }
+    ++histogram_[slot];
+  }
+
+  // Both central values, the same one for odd lengths
+  const unsigned int ranks[2] = {(n - 1) / 2, n / 2};
+  Scalar central[2];
+  unsigned int slot = 0, count = histogram_[0];
+  for (unsigned int c = 0; c < 2; ++c) {
+    while (count <= ranks[c]) {
+      count += histogram_[++slot];
+    }
+    if (slot == bins) {
+      central[c] = 0;
+    } else if (slot < bins) {
+      central[c] = -geometricValue<Scalar>(min_key + bins - 1 - slot, shift);
+    } else {
+      central[c] = geometricValue<Scalar>(min_key + slot - bins - 1, shift);
+    }
+  }
+  return (central[0] + central[1]) / 2;
+}
+
+template <typename Scalar>
+Scalar RobustScale_<Scalar>::operator()(ScaleEstimator estimator, const Eigen::Ref<const VectorX<Scalar>> &r,
+                                        Scalar fixed_scale) {
+  if (estimator == SCALE_FIXED) {
+    return fixed_scale;
+  }
+  const unsigned int n = r.size();
+  if (n == 0) {
+    return 0;
+  }
+
+  if (tolerance_ > 0) {
+    if (estimator == SCALE_MEDIAN) {
+      return approximateMedian(n, [&r](unsigned int i) {
+        return std::abs(r[i]);
+      }) / kConsistency;
+    }
+    const Scalar median = approximateMedian(n, [&r](unsigned int i) {
+      return r[i];
+    });
+    return approximateMedian(n, [&r, median](unsigned int i) {
+      return std::abs(r[i] - median);
+    }) / kConsistency;
+  }
+
+  // Only grows, no allocation once warmed up
+  if (buffer_.size() < n) {
+    buffer_.resize(n);
+  }
+  Eigen::Map<VectorX<Scalar>> buffer(buffer_.data(), n);
+  if (estimator == SCALE_MEDIAN) {
+    buffer = r.cwiseAbs();
+    return eigentools::medianInPlace(buffer.data(), n) / kConsistency;
+  }
+  buffer = r;
+  const Scalar median = eigentools::medianInPlace(buffer.data(), n);
+  buffer = (r.array() - median).abs().matrix();
+  return eigentools::medianInPlace(buffer.data(), n) / kConsistency;
+}
+
+template <typename Scalar>
+Scalar robustScale(ScaleEstimator estimator, const Eigen::Ref<const VectorX<Scalar>> &r, Scalar fixed_scale) {
+  RobustScale_<Scalar> scale;
+  return scale(estimator, r, fixed_scale);
+}
+
+template <typename Scalar>
+void robustWeights(MEstimatorType type, Scalar tuning, const Eigen::Ref<const VectorX<Scalar>> &r,
+                   Scalar scale, Eigen::Ref<VectorX<Scalar>> w) {
+  assert(r.size() == w.size());
+  if (!(tuning * scale > std::numeric_limits<Scalar>::min())) {
+    w.setOnes();
+    return;
+  }
+  const auto u = r.array() * (1 / (tuning * scale));
+  switch (type) {
+    case MESTIMATOR_HUBER:
+      // 1 / 0 = inf for null residuals, clamped to 1 as well
+      w.array() = u.abs().inverse().min(Scalar(1));
+      break;
+    case MESTIMATOR_TUKEY:
+      w.array() = (Scalar(1) - u.square()).max(Scalar(0)).square();
+      break;
+    case MESTIMATOR_CAUCHY:
+      w.array() = (Scalar(1) + u.square()).inverse();
+      break;
+    case MESTIMATOR_GEMAN_MCCLURE:
+      w.array() = (Scalar(1) + u.square()).inverse().square();
+      break;
+    case MESTIMATOR_WELSCH:
+      w.array() = (-u.square()).exp();
+      break;
+  }
+}
+
+INSTANCIATE_MESTIMATOR;
+
+}  // namespace icp
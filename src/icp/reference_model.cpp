@@ -0,0 +1,57 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <icp/reference_model.hpp>
+#include <icp/instanciate.hpp>
+#include <icp/logging.hpp>
+#include <icp/pcltools.hpp>
+
+namespace icp
+{
+
+template<typename Dtype, typename PointReference, typename Search_>
+ReferenceModel_<Dtype, PointReference, Search_>::ReferenceModel_(const PrConstPtr &cloud) : cloud_(cloud),
+  build_time_(0) {
+  if (cloud_->empty()) {
+    LOG(WARNING) << "You are using an empty reference cloud!";
+    return;
+  }
+  ICP_PROFILE_SCOPE(build_time_);
+  search_.setInputCloud(cloud_);
+}
+
+template<typename Dtype, typename PointReference, typename Search_>
+typename ReferenceModel_<Dtype, PointReference, Search_>::LevelConstPtr
+ReferenceModel_<Dtype, PointReference, Search_>::getLevel(Dtype resolution) const {
+  // Levels are few and built once, a single lock is enough. Building one
+  // under the lock also spares the other threads from building it too.
+  std::lock_guard<std::mutex> lock(levels_mutex_);
+  for (const LevelConstPtr &level : levels_) {
+    if (level->resolution == resolution) {
+      return level;
+    }
+  }
+
+  boost::shared_ptr<Level> level(new Level());
+  level->resolution = resolution;
+  typename Pr::Ptr cloud(new Pr());
+  pcltools::voxelDownsample<PointReference>(cloud_, resolution, cloud);
+  level->cloud = cloud;
+  {
+    ICP_PROFILE_SCOPE(level->build_time);
+    level->search.setInputCloud(level->cloud);
+  }
+  levels_.push_back(level);
+  LOG(INFO) << "Reference level at resolution " << resolution << ": " << cloud->size() << " points";
+  return level;
+}
+
+INSTANCIATE_REFERENCE_MODEL;
+
+}  // namespace icp
@@ -0,0 +1,148 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <icp/sampling.hpp>
+#include <icp/instanciate.hpp>
+#include <icp/logging.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace icp
+{
+
+namespace
+{
+// Number of azimuth and elevation bins of the normal space
+const int AZIMUTH_BINS = 8;
+const int ELEVATION_BINS = 4;
+
+template<typename PointT>
+bool getNormal(const PointT &, Eigen::Vector3f &) {
+  return false;
+}
+
+bool getNormal(const pcl::PointNormal &p, Eigen::Vector3f &n) {
+  n = p.getNormalVector3fMap();
+  return true;
+}
+}  // namespace
+
+template<typename PointT>
+void Sampler<PointT>::setInputCloud(const PointCloudConstPtr &cloud) {
+  size_ = cloud->size();
+  permutation_.resize(size_);
+  for (unsigned int i = 0; i < size_; ++i) {
+    permutation_[i] = i;
+  }
+
+  // Bins the points by normal direction. Those without a valid normal are
+  // kept aside, they are only drawn once the bins are exhausted.
+  buckets_.assign(AZIMUTH_BINS * ELEVATION_BINS, std::vector<int>());
+  invalid_normals_.clear();
+  Eigen::Vector3f n;
+  for (unsigned int i = 0; i < size_ && getNormal((*cloud)[i], n); ++i) {
+    if (!std::isfinite(n[0]) || !std::isfinite(n[1]) || !std::isfinite(n[2]) || n.norm() == 0) {
+      invalid_normals_.push_back(i);
+      continue;
+    }
+    n.normalize();
+    const float azimuth = std::atan2(n[1], n[0]) + static_cast<float>(M_PI);
+    const float elevation = std::acos(std::max(-1.f, std::min(1.f, n[2])));
+    const int a = std::min(AZIMUTH_BINS - 1, static_cast<int>(azimuth / (2 * M_PI) * AZIMUTH_BINS));
+    const int e = std::min(ELEVATION_BINS - 1, static_cast<int>(elevation / M_PI * ELEVATION_BINS));
+    buckets_[e * AZIMUTH_BINS + a].push_back(i);
+  }
+  buckets_.erase(std::remove_if(buckets_.begin(), buckets_.end(),
+  [](const std::vector<int> &b) {
+    return b.empty();
+  }), buckets_.end());
+  has_normals_ = !buckets_.empty();
+  cursors_.resize(buckets_.size());
+}
+
+template<typename PointT>
+void Sampler<PointT>::sample(SamplingMethod method, unsigned int sample_size, std::vector<int> &indices) {
+  indices.clear();
+  if (method == SAMPLING_NONE || sample_size >= size_) {
+    indices.reserve(size_);
+    for (unsigned int i = 0; i < size_; ++i) {
+      indices.push_back(i);
+    }
+    return;
+  }
+
+  indices.reserve(sample_size);
+  switch (method) {
+    case SAMPLING_UNIFORM:
+      sampleUniform(sample_size, indices);
+      break;
+    case SAMPLING_NORMAL_SPACE:
+      if (has_normals_) {
+        sampleNormalSpace(sample_size, indices);
+        break;
+      }
+      LOG(WARNING) << "Normal space sampling requires normals, using random sampling";
+    // Fall through
+    default:
+      sampleRandom(sample_size, indices);
+  }
+  // Increasing order, for memory locality in the next stages
+  std::sort(indices.begin(), indices.end());
+}
+
+template<typename PointT>
+void Sampler<PointT>::sampleUniform(unsigned int sample_size, std::vector<int> &indices) const {
+  const double step = static_cast<double>(size_) / sample_size;
+  for (unsigned int i = 0; i < sample_size; ++i) {
+    indices.push_back(static_cast<int>(i * step));
+  }
+}
+
+template<typename PointT>
+void Sampler<PointT>::sampleRandom(unsigned int sample_size, std::vector<int> &indices) {
+  // Partial Fisher-Yates shuffle: the first sample_size entries of the
+  // permutation are a uniform random subset
+  for (unsigned int i = 0; i < sample_size; ++i) {
+    std::uniform_int_distribution<unsigned int> distribution(i, size_ - 1);
+    std::swap(permutation_[i], permutation_[distribution(rng_)]);
+    indices.push_back(permutation_[i]);
+  }
+}
+
+template<typename PointT>
+void Sampler<PointT>::sampleNormalSpace(unsigned int sample_size, std::vector<int> &indices) {
+  // Draws one random point from each bucket in turn, so that rare normal
+  // directions are as represented as frequent ones
+  std::fill(cursors_.begin(), cursors_.end(), 0);
+  bool exhausted = false;
+  while (indices.size() < sample_size && !exhausted) {
+    exhausted = true;
+    for (unsigned int b = 0; b < buckets_.size() && indices.size() < sample_size; ++b) {
+      std::vector<int> &bucket = buckets_[b];
+      unsigned int &cursor = cursors_[b];
+      if (cursor < bucket.size()) {
+        std::uniform_int_distribution<unsigned int> distribution(cursor, bucket.size() - 1);
+        std::swap(bucket[cursor], bucket[distribution(rng_)]);
+        indices.push_back(bucket[cursor]);
+        ++cursor;
+        exhausted = false;
+      }
+    }
+  }
+  // Points without a valid normal complete the sample, at random
+  for (unsigned int i = 0; indices.size() < sample_size && i < invalid_normals_.size(); ++i) {
+    std::uniform_int_distribution<unsigned int> distribution(i, invalid_normals_.size() - 1);
+    std::swap(invalid_normals_[i], invalid_normals_[distribution(rng_)]);
+    indices.push_back(invalid_normals_[i]);
+  }
+}
+
+INSTANCIATE_SAMPLER;
+
+}  // namespace icp
@@ -0,0 +1,305 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <icp/synthetic.hpp>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+#include <icp/logging.hpp>
+
+namespace icp
+{
+
+namespace
+{
+
+/**
+ * @brief Random numbers computed from the raw output of the generator, which
+ * the standard fixes, unlike the output of its distributions
+ */
+class SyntheticRandom {
+  public:
+    explicit SyntheticRandom(unsigned int seed) : rng_(seed) {
+    }
+
+    //! Uniform in [0, 1)
+    float uniform() {
+      return (rng_() >> 8) * (1.f / 16777216.f);
+    }
+
+    float uniform(float min, float max) {
+      return min + (max - min) * uniform();
+    }
+
+    //! Standard normal distribution (Box-Muller)
+    float gaussian() {
+      const float u = 1.f - uniform();
+      const float v = uniform();
+      return std::sqrt(-2.f * std::log(u)) * std::cos(2.f * static_cast<float>(M_PI) * v);
+    }
+
+    Eigen::Vector3f direction() {
+      Eigen::Vector3f d;
+      do {
+        d << gaussian(), gaussian(), gaussian();
+      } while (d.squaredNorm() < 1e-12f);
+      return d.normalized();
+    }
+
+  private:
+    std::mt19937 rng_;
+};
+
+enum ShapeType { SHAPE_PLANE, SHAPE_CYLINDER, SHAPE_MODEL };
+
+struct Shape {
+  ShapeType type;
+  //! Plane: corner. Cylinder: center of the base. Model: position.
+  Eigen::Vector3f origin;
+  //! Plane: sides
+  Eigen::Vector3f u, v;
+  //! Cylinder dimensions
+  float radius, height;
+  //! Model pose and scale
+  Eigen::Matrix3f rotation;
+  float scale;
+  float area;
+};
+
+//! Model points with a valid normal, and their spacing
+struct Model {
+  pcl::PointCloud<pcl::PointNormal>::ConstPtr cloud;
+  std::vector<unsigned int> valid;
+  Eigen::Vector3f centroid;
+  float diagonal;
+  float min_z;
+};
+
+Model prepareModel(const pcl::PointCloud<pcl::PointNormal>::ConstPtr &cloud) {
+  Model model;
+  model.cloud = cloud;
+  model.centroid.setZero();
+  model.diagonal = 0;
+  model.min_z = 0;
+  if (!cloud) {
+    return model;
+  }
+  Eigen::Vector3f min = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+  Eigen::Vector3f max = -min;
+  for (unsigned int i = 0; i < cloud->size(); ++i) {
+    const pcl::PointNormal &p = (*cloud)[i];
+    if (p.getVector3fMap().allFinite() && p.getNormalVector3fMap().allFinite()) {
+      model.valid.push_back(i);
+      model.centroid += p.getVector3fMap();
+      min = min.cwiseMin(p.getVector3fMap());
+      max = max.cwiseMax(p.getVector3fMap());
+    }
+  }
+  if (!model.valid.empty()) {
+    model.centroid /= static_cast<float>(model.valid.size());
+    model.diagonal = (max - min).norm();
+    model.min_z = min.z() - model.centroid.z();
+  }
+  return model;
+}
+
+/**
+ * @brief Lays the shapes out on the floor
+ */
+std::vector<Shape> layout(const SyntheticSceneParameters &param, const Model &model) {
+  SyntheticRandom random(param.seed);
+  const float size = param.size;
+  std::vector<Shape> shapes;
+
+  for (unsigned int i = 0; i < param.num_planes; ++i) {
+    Shape s;
+    s.type = SHAPE_PLANE;
+    if (i == 0) {
+      s.origin << -size / 2, -size / 2, 0;
+      s.u << size, 0, 0;
+      s.v << 0, size, 0;
+    } else {
+      // Vertical panel of random orientation
+      const float yaw = random.uniform(0, static_cast<float>(M_PI));
+      const float width = random.uniform(0.1f, 0.4f) * size;
+      const Eigen::Vector3f center(random.uniform(-0.4f, 0.4f) * size, random.uniform(-0.4f, 0.4f) * size, 0);
+      s.u << width * std::cos(yaw), width * std::sin(yaw), 0;
+      s.v << 0, 0, random.uniform(0.1f, 0.3f) * size;
+      s.origin = center - s.u / 2;
+    }
+    s.area = s.u.cross(s.v).norm();
+    shapes.push_back(s);
+  }
+
+  for (unsigned int i = 0; i < param.num_cylinders; ++i) {
+    Shape s;
+    s.type = SHAPE_CYLINDER;
+    s.origin << random.uniform(-0.4f, 0.4f) * size, random.uniform(-0.4f, 0.4f) * size, 0;
+    s.radius = random.uniform(0.02f, 0.06f) * size;
+    s.height = random.uniform(0.1f, 0.3f) * size;
+    s.area = 2 * static_cast<float>(M_PI) * s.radius * s.height;
+    shapes.push_back(s);
+  }
+
+  if (!model.valid.empty() && model.diagonal > 0) {
+    for (unsigned int i = 0; i < param.num_models; ++i) {
+      Shape s;
+      s.type = SHAPE_MODEL;
+      s.scale = 0.2f * size / model.diagonal;
+      s.rotation = Eigen::AngleAxisf(random.uniform(0, 2 * static_cast<float>(M_PI)),
+                                     Eigen::Vector3f::UnitZ()).toRotationMatrix();
+      // Standing on the floor
+      s.origin << random.uniform(-0.4f, 0.4f) * size, random.uniform(-0.4f, 0.4f) * size, -model.min_z * s.scale;
+      s.area = 0.04f * size * size;
+      shapes.push_back(s);
+    }
+  }
+  return shapes;
+}
+
+/**
+ * @brief Draws a point uniformly on a shape
+ */
+void samplePoint(const Shape &s, const Model &model, SyntheticRandom &random, pcl::PointNormal &p) {
+  switch (s.type) {
+    case SHAPE_PLANE: {
+      p.getVector3fMap() = s.origin + random.uniform() * s.u + random.uniform() * s.v;
+      p.getNormalVector3fMap() = s.u.cross(s.v).normalized();
+      break;
+    }
+    case SHAPE_CYLINDER: {
+      const float angle = random.uniform(0, 2 * static_cast<float>(M_PI));
+      const Eigen::Vector3f n(std::cos(angle), std::sin(angle), 0);
+      p.getVector3fMap() = s.origin + s.radius * n + Eigen::Vector3f(0, 0, random.uniform() * s.height);
+      p.getNormalVector3fMap() = n;
+      break;
+    }
+    case SHAPE_MODEL: {
+      // A random model point moved within its tangent plane by up to the
+      // spacing of the model points, so that the copies are not made of the
+      // same points
+      const unsigned int index = std::min<unsigned int>(random.uniform() * model.valid.size(),
+                                 model.valid.size() - 1);
+      const pcl::PointNormal &q = (*model.cloud)[model.valid[index]];
+      const Eigen::Vector3f n = q.getNormalVector3fMap().normalized();
+      const Eigen::Vector3f t1 = n.unitOrthogonal();
+      const Eigen::Vector3f t2 = n.cross(t1);
+      const float spacing = model.diagonal / std::sqrt(static_cast<float>(model.valid.size()));
+      const Eigen::Vector3f x = q.getVector3fMap() - model.centroid
+                                + spacing * (random.uniform(-0.5f, 0.5f) * t1 + random.uniform(-0.5f, 0.5f) * t2);
+      p.getVector3fMap() = s.origin + s.scale * s.rotation * x;
+      p.getNormalVector3fMap() = s.rotation * n;
+      break;
+    }
+  }
+}
+
+/**
+ * @brief Samples count points over the shapes, in proportion to their areas
+ */
+void sampleScene(const std::vector<Shape> &shapes, const std::vector<float> &cumulated_area, const Model &model,
+                 unsigned long count, SyntheticRandom &random, pcl::PointCloud<pcl::PointNormal> &cloud) {
+  cloud.clear();
+  cloud.reserve(count);
+  pcl::PointNormal p;
+  for (unsigned long i = 0; i < count; ++i) {
+    const float a = random.uniform() * cumulated_area.back();
+    const unsigned int s = std::min<unsigned int>(
+                             std::upper_bound(cumulated_area.begin(), cumulated_area.end(), a) - cumulated_area.begin(),
+                             shapes.size() - 1);
+    samplePoint(shapes[s], model, random, p);
+    cloud.push_back(p);
+  }
+}
+
+/**
+ * @brief Adds the noise and the outliers to a cloud
+ */
+void degrade(const SyntheticSceneParameters &param, SyntheticRandom &random,
+             pcl::PointCloud<pcl::PointNormal> &cloud) {
+  for (pcl::PointNormal &p : cloud.points) {
+    if (param.outlier_ratio > 0 && random.uniform() < param.outlier_ratio) {
+      p.getVector3fMap() << random.uniform(-0.5f, 0.5f) * param.size, random.uniform(-0.5f, 0.5f) * param.size,
+                         random.uniform(0, 0.3f) * param.size;
+      p.getNormalVector3fMap() = random.direction();
+    } else if (param.noise > 0) {
+      p.x += param.noise * random.gaussian();
+      p.y += param.noise * random.gaussian();
+      p.z += param.noise * random.gaussian();
+    }
+  }
+}
+
+}  // namespace
+
+void generateSyntheticScene(const SyntheticSceneParameters &param,
+                            const pcl::PointCloud<pcl::PointNormal>::ConstPtr &model_cloud,
+                            pcl::PointCloud<pcl::PointNormal> &reference,
+                            pcl::PointCloud<pcl::PointNormal> &current) {
+  const Model model = prepareModel(model_cloud);
+  const std::vector<Shape> shapes = layout(param, model);
+  reference.clear();
+  current.clear();
+  if (shapes.empty()) {
+    LOG(WARNING) << "The synthetic scene has no shape";
+    return;
+  }
+  std::vector<float> cumulated_area;
+  cumulated_area.reserve(shapes.size());
+  float area = 0;
+  for (const Shape &s : shapes) {
+    area += s.area;
+    cumulated_area.push_back(area);
+  }
+
+  // Each cloud has its own samples
+  SyntheticRandom random_reference(param.seed + 1);
+  sampleScene(shapes, cumulated_area, model, param.num_points, random_reference, reference);
+  degrade(param, random_reference, reference);
+
+  // The current cloud only keeps the points on one side of a vertical plane,
+  // enough are drawn to be left with num_points
+  SyntheticRandom random_current(param.seed + 2);
+  const float overlap = std::min(1.f, std::max(param.overlap, 1e-3f));
+  sampleScene(shapes, cumulated_area, model, static_cast<unsigned long>(std::ceil(param.num_points / overlap)),
+              random_current, current);
+  if (overlap < 1 && current.size() > param.num_points && param.num_points > 0) {
+    const float angle = random_current.uniform(0, 2 * static_cast<float>(M_PI));
+    const Eigen::Vector3f cut(std::cos(angle), std::sin(angle), 0);
+    std::vector<float> distances(current.size());
+    for (unsigned int i = 0; i < current.size(); ++i) {
+      distances[i] = cut.dot(current[i].getVector3fMap());
+    }
+    std::vector<float> sorted = distances;
+    std::nth_element(sorted.begin(), sorted.begin() + (param.num_points - 1), sorted.end());
+    const float threshold = sorted[param.num_points - 1];
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < current.size() && kept < param.num_points; ++i) {
+      if (distances[i] <= threshold) {
+        current[kept++] = current[i];
+      }
+    }
+    current.resize(kept);
+  }
+  degrade(param, random_current, current);
+
+  // Seen from the moved sensor
+  const Eigen::Matrix4f inverse = param.transformation.inverse();
+  const Eigen::Matrix3f rotation = inverse.topLeftCorner<3, 3>();
+  const Eigen::Vector3f translation = inverse.topRightCorner<3, 1>();
+  for (pcl::PointNormal &p : current.points) {
+    p.getVector3fMap() = rotation * p.getVector3fMap() + translation;
+    p.getNormalVector3fMap() = (rotation * p.getNormalVector3fMap()).normalized();
+  }
+}
+
+}  // namespace icp
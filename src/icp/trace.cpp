@@ -0,0 +1,231 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <icp/trace.hpp>
+#include <algorithm>
+#include <cstring>
+#include <icp/logging.hpp>
+
+namespace icp
+{
+
+namespace
+{
+const char TRACE_MAGIC[4] = {'I', 'C', 'P', 'T'};
+const uint32_t TRACE_VERSION = 1;
+}
+
+IcpTraceWriter::IcpTraceWriter(const std::string &path, unsigned int max_correspondences) :
+  file_(path.c_str(), std::ios::binary | std::ios::trunc), max_correspondences_(max_correspondences) {
+  if (!file_) {
+    LOG(ERROR) << "Could not open the trace " << path;
+    return;
+  }
+  buffer_.insert(buffer_.end(), TRACE_MAGIC, TRACE_MAGIC + 4);
+  put(TRACE_VERSION);
+  writeRecord();
+}
+
+void IcpTraceWriter::putPose(const Eigen::Matrix4f &T) {
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      put(T(r, c));
+    }
+  }
+}
+
+void IcpTraceWriter::writeRecord() {
+  file_.write(buffer_.data(), buffer_.size());
+  buffer_.clear();
+}
+
+void IcpTraceWriter::beginRun(const Eigen::Matrix4f &initial_guess, unsigned int num_current,
+                              unsigned int num_reference, unsigned int max_iter) {
+  put(static_cast<uint8_t>(TRACE_RUN_BEGIN));
+  putPose(initial_guess);
+  put(static_cast<uint32_t>(num_current));
+  put(static_cast<uint32_t>(num_reference));
+  put(static_cast<uint32_t>(max_iter));
+  writeRecord();
+}
+
+void IcpTraceWriter::writeIteration(const IcpTraceIteration &it, const std::vector<int> &indices_current,
+                                    const std::vector<int> &indices_reference) {
+  put(static_cast<uint8_t>(TRACE_ITERATION));
+  put(static_cast<int32_t>(it.level));
+  put(static_cast<uint32_t>(it.iteration));
+  putPose(it.transformation);
+  put(it.error);
+  put(it.rmse);
+  put(it.rotation_increment);
+  put(it.translation_increment);
+  put(static_cast<uint32_t>(it.num_queries));
+  put(static_cast<uint32_t>(it.num_correspondences));
+  put(it.weight_min);
+  put(it.weight_mean);
+  put(it.weight_max);
+  put(static_cast<uint32_t>(it.num_downweighted));
+  put(it.time);
+
+  // Evenly spaced correspondences, all of them when there are few enough
+  const size_t n = indices_current.size();
+  const size_t num_pairs = std::min<size_t>(n, max_correspondences_);
+  put(static_cast<uint32_t>(num_pairs));
+  for (size_t k = 0; k < num_pairs; ++k) {
+    const size_t i = k * n / num_pairs;
+    put(static_cast<int32_t>(indices_current[i]));
+    put(static_cast<int32_t>(indices_reference[i]));
+  }
+  writeRecord();
+}
+
+void IcpTraceWriter::endRun(StopReason stop_reason, const Eigen::Matrix4f &transformation,
+                            unsigned int iterations) {
+  put(static_cast<uint8_t>(TRACE_RUN_END));
+  put(static_cast<uint8_t>(stop_reason));
+  putPose(transformation);
+  put(static_cast<uint32_t>(iterations));
+  writeRecord();
+  // A run is complete on disk even if the process dies afterwards
+  file_.flush();
+}
+
+IcpTraceReader::IcpTraceReader(const std::string &path) : file_(path.c_str(), std::ios::binary), valid_(false),
+  truncated_(false), size_(0) {
+  if (file_.seekg(0, std::ios::end)) {
+    size_ = file_.tellg();
+    file_.seekg(0, std::ios::beg);
+  }
+  char magic[4];
+  uint32_t version;
+  if (!file_.read(magic, 4) || std::memcmp(magic, TRACE_MAGIC, 4) != 0 || !get(version)) {
+    LOG(ERROR) << path << " is not a trace";
+    return;
+  }
+  if (version != TRACE_VERSION) {
+    LOG(ERROR) << "Unsupported version " << version << " of the trace " << path;
+    return;
+  }
+  valid_ = true;
+}
+
+bool IcpTraceReader::getPose(Eigen::Matrix4f &T) {
+  T.setIdentity();
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      if (!get(T(r, c))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool IcpTraceReader::readIteration(IcpTraceIteration &it) {
+  int32_t level;
+  uint32_t iteration, num_queries, num_correspondences, num_downweighted, num_pairs;
+  if (!get(level) || !get(iteration) || !getPose(it.transformation) || !get(it.error) || !get(it.rmse)
+      || !get(it.rotation_increment) || !get(it.translation_increment) || !get(num_queries)
+      || !get(num_correspondences) || !get(it.weight_min) || !get(it.weight_mean) || !get(it.weight_max)
+      || !get(num_downweighted) || !get(it.time) || !get(num_pairs)) {
+    return false;
+  }
+  it.level = level;
+  it.iteration = iteration;
+  it.num_queries = num_queries;
+  it.num_correspondences = num_correspondences;
+  it.num_downweighted = num_downweighted;
+
+  // A corrupted count must not allocate more than the file holds
+  const std::streamoff remaining = size_ - file_.tellg();
+  const std::streamoff pair_size = 2 * sizeof(int32_t);
+  if (num_pairs > num_correspondences || num_pairs > remaining / pair_size) {
+    LOG(ERROR) << "Invalid number of correspondences " << num_pairs << " in the trace";
+    return false;
+  }
+  it.correspondences.clear();
+  it.correspondences.reserve(std::min<uint32_t>(num_pairs, 4096));
+  for (uint32_t k = 0; k < num_pairs; ++k) {
+    int32_t current, reference;
+    if (!get(current) || !get(reference)) {
+      return false;
+    }
+    it.correspondences.push_back(std::make_pair(current, reference));
+  }
+  return true;
+}
+
+bool IcpTraceReader::read(IcpTraceRun &run) {
+  run = IcpTraceRun();
+  if (!valid_) {
+    return false;
+  }
+  bool started = false;
+  while (true) {
+    // The next record belongs to the next run if this one has begun
+    const int next = file_.peek();
+    if (next == std::char_traits<char>::eof()) {
+      valid_ = false;
+      return started;
+    }
+    if (next == TRACE_RUN_BEGIN && started) {
+      return true;
+    }
+    uint8_t type;
+    get(type);
+    if (type == TRACE_RUN_BEGIN) {
+      uint32_t num_current, num_reference, max_iter;
+      if (!getPose(run.initial_guess) || !get(num_current) || !get(num_reference) || !get(max_iter)) {
+        break;
+      }
+      run.num_current = num_current;
+      run.num_reference = num_reference;
+      run.max_iter = max_iter;
+    } else if (type == TRACE_ITERATION) {
+      run.iterations.push_back(IcpTraceIteration());
+      if (!readIteration(run.iterations.back())) {
+        run.iterations.pop_back();
+        break;
+      }
+    } else if (type == TRACE_RUN_END) {
+      uint8_t stop_reason;
+      uint32_t iterations;
+      if (!get(stop_reason) || !getPose(run.transformation) || !get(iterations)) {
+        break;
+      }
+      run.stop_reason = static_cast<StopReason>(stop_reason);
+      run.complete = true;
+      return true;
+    } else {
+      LOG(ERROR) << "Unknown record " << static_cast<int>(type) << " in the trace";
+      break;
+    }
+    started = true;
+  }
+  // Truncated or corrupted, what was read of the run is kept
+  LOG(WARNING) << "The trace is truncated";
+  valid_ = false;
+  truncated_ = true;
+  return started;
+}
+
+bool readTrace(const std::string &path, std::vector<IcpTraceRun, Eigen::aligned_allocator<IcpTraceRun>> &runs) {
+  runs.clear();
+  IcpTraceReader reader(path);
+  if (!reader.isOpen()) {
+    return false;
+  }
+  IcpTraceRun run;
+  while (reader.read(run)) {
+    runs.push_back(run);
+  }
+  return !reader.isTruncated();
+}
+
+}  // namespace icp
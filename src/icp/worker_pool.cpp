@@ -0,0 +1,116 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <icp/worker_pool.hpp>
+#include <algorithm>
+
+namespace icp
+{
+
+WorkerPool::~WorkerPool() {
+  stop();
+}
+
+void WorkerPool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  start_.notify_all();
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+  stopping_ = false;
+}
+
+void WorkerPool::resize(unsigned int num_threads) {
+  num_threads = std::max(1u, num_threads);
+  if (num_threads == size()) {
+    return;
+  }
+  stop();
+  exceptions_.assign(num_threads, std::exception_ptr());
+  threads_.reserve(num_threads - 1);
+  for (unsigned int t = 1; t < num_threads; ++t) {
+    threads_.push_back(std::thread(&WorkerPool::work, this, t, generation_));
+  }
+}
+
+void WorkerPool::run(Invoke invoke, const void *job) {
+  if (threads_.empty()) {
+    invoke(job, 0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::fill(exceptions_.begin(), exceptions_.end(), std::exception_ptr());
+    invoke_ = invoke;
+    job_ = job;
+    pending_ = threads_.size();
+    ++generation_;
+  }
+  start_.notify_all();
+
+  try {
+    invoke(job, 0);
+  } catch (...) {
+    exceptions_[0] = std::current_exception();
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() {
+      return pending_ == 0;
+    });
+    job_ = 0;
+    invoke_ = 0;
+  }
+  for (const std::exception_ptr &e : exceptions_) {
+    if (e) {
+      std::rethrow_exception(e);
+    }
+  }
+}
+
+void WorkerPool::work(unsigned int t, uint64_t generation) {
+  while (true) {
+    Invoke invoke;
+    const void *job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [this, generation]() {
+        return stopping_ || generation_ != generation;
+      });
+      if (stopping_) {
+        return;
+      }
+      generation = generation_;
+      invoke = invoke_;
+      job = job_;
+    }
+
+    try {
+      invoke(job, t);
+    } catch (...) {
+      exceptions_[t] = std::current_exception();
+    }
+
+    bool last;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      last = --pending_ == 0;
+    }
+    if (last) {
+      done_.notify_one();
+    }
+  }
+}
+
+}  // namespace icp
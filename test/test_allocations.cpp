@@ -0,0 +1,215 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <pcl/common/transforms.h>
+#include <pcl/kdtree/kdtree_flann.h>
+#include <icp/eigentools.hpp>
+#include <icp/icp.hpp>
+
+/**
+ * Counts every heap allocation made while counting is enabled.
+ *
+ * With glibc, malloc itself is interposed, so that allocations made by Eigen
+ * (which bypasses operator new) are counted as well. Elsewhere only operator
+ * new is replaced.
+ */
+namespace {
+std::atomic<bool> counting(false);
+std::atomic<long> allocations(0);
+
+long countAllocations(bool enable) {
+  counting = enable;
+  if (enable) {
+    allocations = 0;
+  }
+  return allocations;
+}
+}  // namespace
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+  if (counting) ++allocations;
+  return __libc_malloc(size);
+}
+void *calloc(size_t n, size_t size) {
+  if (counting) ++allocations;
+  return __libc_calloc(n, size);
+}
+void *realloc(void *ptr, size_t size) {
+  if (counting) ++allocations;
+  return __libc_realloc(ptr, size);
+}
+}
+#else
+void *operator new(std::size_t size) {
+  if (counting) ++allocations;
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+void *operator new[](std::size_t size) {
+  return operator new(size);
+}
+void operator delete[](void *p) noexcept {
+  std::free(p);
+}
+#endif
+
+namespace test_icp {
+
+using namespace icp;
+
+class AllocationTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp() {
+      pc_m_ = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>());
+      pc_d_ = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>());
+      for (int i = 0; i < 10; ++i) {
+        for (int j = 0; j < 10; ++j) {
+          for (int k = 0; k < 10; ++k) {
+            pc_m_->push_back(pcl::PointXYZ(0.1f * i, 0.1f * j + 0.01f * i, 0.1f * k + 0.02f * j));
+          }
+        }
+      }
+      Eigen::Matrix4f transformation = eigentools::createTransformationMatrix(0.02f, 0.01f, 0.f,
+                                       0.01f, 0.f, 0.02f);
+      pcl::transformPointCloud(*pc_m_, *pc_d_, transformation);
+    }
+
+    /**
+     * Number of allocations done by the kd-tree itself for one search per point
+     * of the current cloud. pcl::KdTreeFLANN allocates in every query, this is
+     * out of the hands of the ICP.
+     */
+    long searchAllocations() {
+      pcl::KdTreeFLANN<pcl::PointXYZ> kdtree;
+      kdtree.setInputCloud(pc_m_);
+      std::vector<int> indices(1);
+      std::vector<float> distances(1);
+      countAllocations(true);
+      for (unsigned int i = 0; i < pc_d_->size(); ++i) {
+        kdtree.nearestKSearch((*pc_d_)[i], 1, indices, distances);
+      }
+      return countAllocations(false);
+    }
+
+    /**
+     * Runs once with param to warm up, then checks that each of a few more
+     * iterations allocates what the search does and nothing else
+     */
+    template<typename Icp>
+    void expectSteadyState(Icp &icp, const IcpParametersf &param, long search_allocations) {
+      icp.setParameters(param);
+      icp.setInputReference(pc_m_);
+      icp.setInputCurrent(pc_d_);
+
+      // Warm-up
+      icp.run();
+
+      for (int i = 0; i < 3; ++i) {
+        countAllocations(true);
+        icp.step();
+        const long step_allocations = countAllocations(false);
+        EXPECT_EQ(search_allocations, step_allocations) << "Iteration " << i << " allocated memory";
+      }
+    }
+
+    pcl::PointCloud<pcl::PointXYZ>::Ptr pc_m_;
+    pcl::PointCloud<pcl::PointXYZ>::Ptr pc_d_;
+};
+
+typedef Icp_<float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointXYZ, ImplicitKdTree<pcl::PointXYZ>>
+    IcpImplicitKdTree;
+
+/**
+ * Once warmed up, an iteration should not allocate anything besides what the
+ * kd-tree does internally
+ */
+TEST_F(AllocationTest, SteadyStateStep) {
+  IcpPointToPoint icp;
+  IcpParametersf param;
+  param.max_iter = 20;
+  expectSteadyState(icp, param, searchAllocations());
+}
+
+/**
+ * With the implicit kd-tree the search does not allocate either
+ */
+TEST_F(AllocationTest, SteadyStateStepImplicitKdTree) {
+  IcpImplicitKdTree icp;
+  IcpParametersf param;
+  param.max_iter = 20;
+  expectSteadyState(icp, param, 0);
+}
+
+/**
+ * The M-estimator weights, with exact or histogram medians of the residuals
+ */
+TEST_F(AllocationTest, SteadyStateStepMEstimator) {
+  IcpImplicitKdTree icp;
+  IcpParametersf param;
+  param.max_iter = 20;
+  param.mestimator = true;
+  param.mestimator_type = MESTIMATOR_TUKEY;
+  expectSteadyState(icp, param, 0);
+  // Coarse enough for the 3000 residuals to be counted in a histogram
+  param.mestimator_scale_tolerance = 0.1f;
+  expectSteadyState(icp, param, 0);
+}
+
+/**
+ * The Levenberg-Marquardt solver evaluates its candidate steps in the buffers
+ * of the error
+ */
+TEST_F(AllocationTest, SteadyStateStepLevenbergMarquardt) {
+  IcpImplicitKdTree icp;
+  IcpParametersf param;
+  param.max_iter = 20;
+  param.solver = SOLVER_LEVENBERG_MARQUARDT;
+  expectSteadyState(icp, param, 0);
+}
+
+/**
+ * A new sample is drawn at each iteration, in the buffers of the sampler
+ */
+TEST_F(AllocationTest, SteadyStateStepSampling) {
+  IcpImplicitKdTree icp;
+  IcpParametersf param;
+  param.max_iter = 20;
+  param.sampling = SAMPLING_RANDOM;
+  param.sample_size = 300;
+  param.sampling_period = 1;
+  expectSteadyState(icp, param, 0);
+}
+
+/**
+ * The search threads are started by the warm-up and then reused
+ */
+TEST_F(AllocationTest, SteadyStateStepThreads) {
+  IcpImplicitKdTree icp;
+  IcpParametersf param;
+  param.max_iter = 20;
+  param.num_threads = 3;
+  expectSteadyState(icp, param, 0);
+}
+
+}  // namespace test_icp
@@ -0,0 +1,229 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <pcl/common/transforms.h>
+#include <icp/batch.hpp>
+#include <icp/eigentools.hpp>
+#include <icp/linear_algebra.hpp>
+#include "test_clouds.hpp"
+
+namespace test_icp {
+
+using namespace icp;
+
+class IcpBatchTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp() {
+      reference_ = randomCloud<pcl::PointXYZ>(3);
+      // Each current cloud is the reference moved differently, registered
+      // from a slightly wrong initial guess
+      for (int i = 0; i < 7; ++i) {
+        const float f = 0.01f * (i - 3);
+        Eigen::Matrix4f transformation = eigentools::createTransformationMatrix(0.5f + f, -f, 0.2f,
+                                         0.1f + f, f, -0.05f);
+        currents_.push_back(movedCloud(*reference_, transformation));
+        transformations_.push_back(transformation);
+        initial_guesses_.push_back(eigentools::createTransformationMatrix(0.5f, 0.f, 0.2f, 0.1f, 0.f, -0.05f));
+      }
+      param_.max_iter = 30;
+    }
+
+    pcl::PointCloud<pcl::PointXYZ>::Ptr reference_;
+    std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> currents_;
+    IcpBatchPointToPoint::TransformationVector transformations_;
+    IcpBatchPointToPoint::TransformationVector initial_guesses_;
+    IcpParameters param_;
+};
+
+/**
+ * The batch gives the same results as registering each cloud on its own,
+ * whatever the number of workers
+ */
+TEST_F(IcpBatchTest, MatchesIndividualRegistrations) {
+  std::vector<IcpResults> expected;
+  for (unsigned int i = 0; i < currents_.size(); ++i) {
+    IcpPointToPoint icp;
+    IcpParameters param = param_;
+    param.initial_guess = initial_guesses_[i];
+    icp.setParameters(param);
+    icp.setInputReference(reference_);
+    icp.setInputCurrent(currents_[i]);
+    icp.run();
+    expected.push_back(icp.getResults());
+    EXPECT_TRUE(expected[i].transformation.isApprox(transformations_[i], 1e-3))
+        << "Expected:\n" << transformations_[i] << "\nActual:\n" << expected[i].transformation;
+  }
+
+  IcpBatchPointToPoint batch;
+  batch.setParameters(param_);
+  batch.setInputReference(reference_);
+  for (unsigned int num_threads = 1; num_threads <= 4; num_threads += 3) {
+    batch.setNumThreads(num_threads);
+    std::vector<IcpResults> results = batch.run(currents_, initial_guesses_);
+    ASSERT_EQ(expected.size(), results.size());
+    for (unsigned int i = 0; i < results.size(); ++i) {
+      EXPECT_EQ(expected[i].transformation, results[i].transformation)
+          << "Cloud " << i << ", " << num_threads << " threads";
+      EXPECT_EQ(expected[i].registrationError, results[i].registrationError)
+          << "Cloud " << i << ", " << num_threads << " threads";
+      EXPECT_EQ(expected[i].has_converged, results[i].has_converged);
+    }
+  }
+}
+
+TEST_F(IcpBatchTest, Pyramid) {
+  param_.pyramid.push_back(IcpPyramidLevel(0.2f, 5));
+  IcpBatchPointToPoint batch;
+  batch.setParameters(param_);
+  batch.setInputReference(reference_);
+  batch.setNumThreads(3);
+  std::vector<IcpResults> results = batch.run(currents_, initial_guesses_);
+  ASSERT_EQ(currents_.size(), results.size());
+  for (unsigned int i = 0; i < results.size(); ++i) {
+    EXPECT_TRUE(results[i].transformation.isApprox(transformations_[i], 1e-3))
+        << "Expected:\n" << transformations_[i] << "\nActual:\n" << results[i].transformation;
+  }
+}
+
+/**
+ * Only the promising hypotheses run all their iterations, the best one is
+ * returned
+ */
+TEST_F(IcpBatchTest, Hypotheses) {
+  const Eigen::Matrix4f &transformation = transformations_[0];
+  IcpBatchPointToPoint::TransformationVector guesses;
+  // Far from the solution
+  guesses.push_back(eigentools::createTransformationMatrix(0.5f, 0.f, 0.2f, 1.5f, 0.f, 0.f));
+  guesses.push_back(eigentools::createTransformationMatrix(0.5f, 0.f, 0.2f, 0.f, 1.5f, 3.f));
+  // Close to the solution, both should end up at the same pose
+  guesses.push_back(initial_guesses_[0]);
+  guesses.push_back(eigentools::createTransformationMatrix(0.48f, 0.01f, 0.2f, 0.08f, 0.f, -0.06f));
+
+  IcpHypothesesParameters hypotheses_param;
+  hypotheses_param.prune_after = 3;
+  IcpBatchPointToPoint batch;
+  batch.setParameters(param_);
+  batch.setHypothesesParameters(hypotheses_param);
+  batch.setInputReference(reference_);
+  batch.setNumThreads(2);
+  std::vector<IcpResults> hypotheses;
+  IcpResults best = batch.runHypotheses(currents_[0], guesses, &hypotheses);
+  EXPECT_TRUE(best.transformation.isApprox(transformation, 1e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << best.transformation;
+
+  ASSERT_EQ(guesses.size(), hypotheses.size());
+  // The far hypotheses were dropped after the first stage
+  EXPECT_EQ(3u, hypotheses[0].registrationError.size());
+  EXPECT_EQ(3u, hypotheses[1].registrationError.size());
+  // Only one of the close ones went on
+  EXPECT_TRUE(hypotheses[2].registrationError.size() == 3u || hypotheses[3].registrationError.size() == 3u);
+  EXPECT_GT(std::max(hypotheses[2].registrationError.size(), hypotheses[3].registrationError.size()), 3u);
+  // The selected pose is the one of a close hypothesis, the far ones did not
+  // get there
+  EXPECT_TRUE(best.transformation.isApprox(hypotheses[2].transformation) ||
+              best.transformation.isApprox(hypotheses[3].transformation));
+  EXPECT_FALSE(hypotheses[0].transformation.isApprox(transformation, 1e-3));
+  EXPECT_FALSE(hypotheses[1].transformation.isApprox(transformation, 1e-3));
+}
+
+/**
+ * Planar hypotheses are pruned the same way
+ */
+TEST_F(IcpBatchTest, Hypotheses2D) {
+  srand(5);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr reference(new pcl::PointCloud<pcl::PointXYZ>());
+  for (int i = 0; i < 1000; ++i) {
+    reference->push_back(pcl::PointXYZ(rand() / float(RAND_MAX), rand() / float(RAND_MAX), 0.f));
+  }
+  const Eigen::Matrix4f transformation = la::expSE2(Eigen::Vector3f(0.1f, -0.05f, 0.1f));
+  pcl::PointCloud<pcl::PointXYZ>::Ptr current = movedCloud(*reference, transformation);
+
+  IcpBatchPointToPoint2D::TransformationVector guesses;
+  // Far from the solution
+  guesses.push_back(la::expSE2(Eigen::Vector3f(1.5f, 0.f, 2.5f)));
+  guesses.push_back(la::expSE2(Eigen::Vector3f(-1.f, 1.f, -2.f)));
+  // Close to the solution, and to each other
+  guesses.push_back(transformation * la::expSE2(Eigen::Vector3f(0.04f, 0.f, 0.04f)));
+  guesses.push_back(transformation * la::expSE2(Eigen::Vector3f(0.042f, 0.f, 0.041f)));
+
+  // Only the pruning stops the hypotheses before max_iter
+  param_.min_variation = 0;
+  IcpHypothesesParameters hypotheses_param;
+  hypotheses_param.prune_after = 3;
+  IcpBatchPointToPoint2D batch;
+  batch.setParameters(param_);
+  batch.setHypothesesParameters(hypotheses_param);
+  batch.setInputReference(reference);
+  batch.setNumThreads(2);
+  std::vector<IcpResults> hypotheses;
+  IcpResults best = batch.runHypotheses(current, guesses, &hypotheses);
+  EXPECT_TRUE(best.transformation.isApprox(transformation, 1e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << best.transformation;
+
+  ASSERT_EQ(guesses.size(), hypotheses.size());
+  // The far hypotheses did not go on after the first stage
+  EXPECT_LE(hypotheses[0].registrationError.size(), 3u);
+  EXPECT_LE(hypotheses[1].registrationError.size(), 3u);
+  // The close ones were merged, only one of them went on
+  EXPECT_TRUE(hypotheses[2].registrationError.size() == 3u || hypotheses[3].registrationError.size() == 3u);
+  EXPECT_GT(std::max(hypotheses[2].registrationError.size(), hypotheses[3].registrationError.size()), 3u);
+}
+
+/**
+ * A pose matching a small part of the current points exactly has a lower
+ * RMSE than the right pose, with noisy current points
+ */
+TEST_F(IcpBatchTest, HypothesesInliers) {
+  const Eigen::Matrix4f &transformation = transformations_[0];
+  pcl::PointCloud<pcl::PointXYZ>::Ptr current = movedCloud(*reference_, transformation);
+  srand(11);
+  for (pcl::PointXYZ &p : *current) {
+    p.getVector3fMap() += 0.01f * Eigen::Vector3f::Random();
+  }
+  // Exact copy of the first 100 noisy points, away from the reference
+  const Eigen::Matrix4f shift = eigentools::createTransformationMatrix(5.f, 0.f, 0.f, 0.f, 0.f, 0.f);
+  const Eigen::Affine3f copy(shift * transformation);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr reference(new pcl::PointCloud<pcl::PointXYZ>(*reference_));
+  for (unsigned int i = 0; i < 100; ++i) {
+    pcl::PointXYZ p;
+    p.getVector3fMap() = copy * (*current)[i].getVector3fMap();
+    reference->push_back(p);
+  }
+
+  IcpBatchPointToPoint::TransformationVector guesses;
+  guesses.push_back(shift * transformation);
+  guesses.push_back(transformation);
+  param_.max_correspondance_distance = 0.02f;
+  IcpBatchPointToPoint batch;
+  batch.setParameters(param_);
+  batch.setInputReference(reference);
+  std::vector<IcpResults> hypotheses;
+  IcpResults best = batch.runHypotheses(current, guesses, &hypotheses);
+  ASSERT_EQ(2u, hypotheses.size());
+  EXPECT_LT(hypotheses[0].rmse, hypotheses[1].rmse);
+  EXPECT_LT(hypotheses[0].inlier_ratio, hypotheses[1].inlier_ratio);
+  EXPECT_TRUE(best.transformation.isApprox(transformation, 1e-2))
+      << "Expected:\n" << transformation << "\nActual:\n" << best.transformation;
+}
+
+TEST_F(IcpBatchTest, InvalidInput) {
+  IcpBatchPointToPoint batch;
+  batch.setParameters(param_);
+  batch.setInputReference(reference_);
+  EXPECT_TRUE(batch.run(std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr>()).empty());
+  initial_guesses_.pop_back();
+  EXPECT_THROW(batch.run(currents_, initial_guesses_), std::invalid_argument);
+}
+
+}  // namespace test_icp
@@ -0,0 +1,71 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#ifndef ICP_TEST_CLOUDS_HPP
+#define ICP_TEST_CLOUDS_HPP
+
+#include <cstdlib>
+#include <pcl/common/transforms.h>
+#include <pcl/point_cloud.h>
+
+/**
+ * Clouds shared by the registration tests
+ */
+
+namespace test_icp {
+
+/**
+ * @brief Points drawn uniformly in the unit cube, the same ones for a given
+ * seed
+ */
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr randomCloud(unsigned int seed, unsigned int n = 500) {
+  srand(seed);
+  typename pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>());
+  for (unsigned int i = 0; i < n; ++i) {
+    const float x = static_cast<float>(rand()) / RAND_MAX;
+    const float y = static_cast<float>(rand()) / RAND_MAX;
+    const float z = static_cast<float>(rand()) / RAND_MAX;
+    cloud->push_back(PointT(x, y, z));
+  }
+  return cloud;
+}
+
+/**
+ * @brief Curved 10x10x10 grid of 1m, whose points all have different
+ * neighborhoods
+ */
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr gridCloud() {
+  typename pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>());
+  for (int i = 0; i < 10; ++i) {
+    for (int j = 0; j < 10; ++j) {
+      for (int k = 0; k < 10; ++k) {
+        cloud->push_back(PointT(0.1f * i, 0.1f * j + 0.01f * i * i, 0.1f * k + 0.02f * j * i));
+      }
+    }
+  }
+  return cloud;
+}
+
+/**
+ * @brief Current cloud that the registration onto the reference should find
+ * at the given transformation: the reference moved by its inverse
+ */
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr movedCloud(const pcl::PointCloud<PointT> &reference,
+    const Eigen::Matrix4f &transformation) {
+  typename pcl::PointCloud<PointT>::Ptr current(new pcl::PointCloud<PointT>());
+  pcl::transformPointCloud(reference, *current, Eigen::Matrix4f(transformation.inverse()));
+  return current;
+}
+
+}  // namespace test_icp
+
+#endif /* ICP_TEST_CLOUDS_HPP */
@@ -9,7 +9,10 @@
 
 #include <gtest/gtest.h>
 #include <pcl/common/transforms.h>
+#include <cstdlib>
 #include <icp/constraints.hpp>
+#include <icp/eigentools.hpp>
+#include <icp/icp.hpp>
 #include <icp/logging.hpp>
 
 namespace test_icp {
@@ -183,4 +186,98 @@ TEST_F(TestConstraints, TestProcessJacobianXYZ) {
   ASSERT_TRUE(Jexpected.isApprox(Jc_)) << "expected: " << Jexpected << "\nactual: " << J_;
 }
 
+TEST_F(TestConstraints, RotationAndScale) {
+  Constraints7 c;
+  c.setRotationConstraint(FixRotationConstraint(true, true, false));
+  c.setScaleFixed(true);
+  EXPECT_EQ(4u, c.numFreeParameters());
+  Eigen::Matrix<float, 4, 1> twist;
+  twist << 1, 2, 3, 6;
+  Eigen::Matrix<float, 7, 1> expected;
+  expected << 1, 2, 3, 0, 0, 6, 0;
+  EXPECT_EQ(expected, c.getTwist(twist));
+
+  // SO3 has no translation: the rotation comes first, the translation
+  // constraint is ignored
+  Constraints3 so3;
+  so3.setTranslationConstraint(FixTranslationConstraint(true, true, true));
+  EXPECT_FALSE(so3.hasConstraints());
+  so3.setRotationConstraint(FixRotationConstraint(false, false, true));
+  Eigen::Matrix<float, 2, 1> rotation;
+  rotation << 1, 2;
+  EXPECT_EQ(Eigen::Vector3f(1, 2, 0), so3.getTwist(rotation));
+}
+
+/**
+ * The constrained solve is the solve of the normal equations restricted to
+ * the free parameters
+ */
+TEST_F(TestConstraints, ReducedSolve) {
+  Eigen::Matrix<float, 6, 6> M = Eigen::Matrix<float, 6, 6>::Random();
+  const Eigen::Matrix<float, 6, 6> A = M * M.transpose() + Eigen::Matrix<float, 6, 6>::Identity();
+  const Eigen::Matrix<float, 6, 1> b = Eigen::Matrix<float, 6, 1>::Random();
+
+  EXPECT_TRUE(c_.solve(A, b).isApprox(A.ldlt().solve(b)));
+
+  c_.setTranslationConstraint(FixTranslationConstraint(false, true, false));
+  c_.setRotationConstraint(FixRotationConstraint(true, false, true));
+  const int free[] = {0, 2, 4};
+  Eigen::Matrix3f A_free;
+  Eigen::Vector3f b_free;
+  for (int i = 0; i < 3; ++i) {
+    b_free[i] = b[free[i]];
+    for (int j = 0; j < 3; ++j) {
+      A_free(i, j) = A(free[i], free[j]);
+    }
+  }
+  const Eigen::Vector3f x_free = A_free.ldlt().solve(b_free);
+  const Eigen::Matrix<float, 6, 1> x = c_.solve(A, b);
+  EXPECT_EQ(0.f, x[1]);
+  EXPECT_EQ(0.f, x[3]);
+  EXPECT_EQ(0.f, x[5]);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_FLOAT_EQ(x_free[i], x[free[i]]);
+  }
+}
+
+/**
+ * A registration whose motion obeys the constraints is recovered exactly,
+ * the fixed parameters are left untouched
+ */
+TEST_F(TestConstraints, ConstrainedRegistration) {
+  srand(17);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr reference(new pcl::PointCloud<pcl::PointXYZ>());
+  for (int i = 0; i < 500; ++i) {
+    reference->push_back(pcl::PointXYZ(rand() / float(RAND_MAX), rand() / float(RAND_MAX),
+                                       rand() / float(RAND_MAX)));
+  }
+  // Planar motion: translation in x and y, rotation around z
+  const Eigen::Matrix4f transformation = eigentools::createTransformationMatrix(0.05f, -0.04f, 0.f,
+                                         0.f, 0.f, 0.1f);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr current(new pcl::PointCloud<pcl::PointXYZ>());
+  pcl::transformPointCloud(*reference, *current, Eigen::Matrix4f(transformation.inverse()));
+
+  boost::shared_ptr<Constraints6> c(new Constraints6());
+  c->setTranslationConstraint(FixTranslationConstraint(false, false, true));
+  c->setRotationConstraint(FixRotationConstraint(true, true, false));
+  ErrorPointToPointXYZ err;
+  err.setConstraints(c);
+  IcpPointToPoint icp;
+  icp.setError(err);
+  IcpParameters param;
+  param.max_iter = 30;
+  icp.setParameters(param);
+  icp.setInputReference(reference);
+  icp.setInputCurrent(current);
+  icp.run();
+  const Eigen::Matrix4f T = icp.getResults().transformation;
+  EXPECT_TRUE(T.isApprox(transformation, 1e-4)) << "Expected:\n" << transformation << "\nActual:\n" << T;
+  EXPECT_EQ(0.f, T(2, 3));
+  EXPECT_EQ(0.f, T(0, 2));
+  EXPECT_EQ(0.f, T(1, 2));
+  EXPECT_EQ(0.f, T(2, 0));
+  EXPECT_EQ(0.f, T(2, 1));
+  EXPECT_EQ(1.f, T(2, 2));
+}
+
 }  // namespace test_icp
@@ -54,6 +54,16 @@ TEST_F(EigenToolsTest, CreateTransformationMatrix) {
   }
 }
 
+TEST_F(EigenToolsTest, RotationAngle) {
+  Eigen::Matrix4f transformation = eigentools::createTransformationMatrix(1.f, 2.f, 3.f, 0.f, 0.f, 0.3f);
+  EXPECT_NEAR(0.3f, eigentools::rotationAngle(transformation), 1e-5f);
+  EXPECT_NEAR(0.f, eigentools::rotationAngle(Eigen::Matrix4f(Eigen::Matrix4f::Identity())), 1e-5f);
+
+  // The scale of a similarity is ignored
+  transformation.topLeftCorner<3, 3>() *= 2.f;
+  EXPECT_NEAR(0.3f, eigentools::rotationAngle(transformation), 1e-5f);
+}
+
 TEST_F(EigenToolsTest, Sort) {
   LOG(WARNING) <<
                "This test only checks whether sorting works for VectorX, not matrices";
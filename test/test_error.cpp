@@ -170,6 +170,171 @@ TEST_F(TestErrorPointToPoint, JacobianUpdate) {
 
 }
 
+TEST_F(TestErrorPointToPoint, StreamedNormalEquations) {
+  err_.setInputReference(pc1_);
+  err_.setInputCurrent(pc2_);
+  err_.computeError();
+  err_.computeJacobian();
+  err_.computeNormalEquations();
+
+  Eigen::MatrixXf J = err_.getJacobian();
+  Eigen::MatrixXf e = err_.getErrorVector();
+  Eigen::MatrixXf JtJ_expected = J.transpose() * J;
+  Eigen::MatrixXf Jte_expected = J.transpose() * e;
+  Eigen::MatrixXf JtJ = err_.getJtWJ();
+  Eigen::MatrixXf Jte = err_.getJtWe();
+
+  EXPECT_TRUE(JtJ_expected.isApprox(JtJ, 10e-5))
+      << "Expected:\n" << JtJ_expected << "\nActual:\n" << JtJ;
+  EXPECT_TRUE(Jte_expected.isApprox(Jte, 10e-5))
+      << "Expected:\n" << Jte_expected << "\nActual:\n" << Jte;
+}
+
+/**
+ * The fused kernel reading through correspondences and transforming the
+ * current points on the fly must match the error computed on explicitly
+ * transformed and gathered clouds
+ */
+TEST_F(TestErrorPointToPoint, FusedKernelWithCorrespondences) {
+  Eigen::Matrix4f T = eigentools::createTransformationMatrix(0.1f, -0.2f, 0.3f,
+                      0.05f, 0.1f, -0.02f);
+  std::vector<int> indices_current, indices_reference;
+  for (int i = 0; i < 50; ++i) {
+    indices_current.push_back(2 * i);
+    indices_reference.push_back(99 - i);
+  }
+
+  auto pc2_transformed = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>());
+  auto current = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>());
+  auto reference = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>());
+  pcl::transformPointCloud(*pc2_, *pc2_transformed, T);
+  for (unsigned int i = 0; i < indices_current.size(); ++i) {
+    current->push_back((*pc2_transformed)[indices_current[i]]);
+    reference->push_back((*pc1_)[indices_reference[i]]);
+  }
+  ErrorPointToPointXYZ expected;
+  expected.setInputReference(reference);
+  expected.setInputCurrent(current);
+  expected.computeError();
+  expected.computeNormalEquations();
+
+  err_.setInputReference(pc1_);
+  err_.setInputCurrent(pc2_);
+  err_.setCorrespondences(indices_current, indices_reference);
+  err_.setTransformation(T);
+  err_.computeErrorAndNormalEquations();
+
+  Eigen::MatrixXf e_expected = expected.getErrorVector();
+  Eigen::MatrixXf e = err_.getErrorVector();
+  ASSERT_EQ(e_expected.rows(), e.rows());
+  EXPECT_TRUE(e_expected.isApprox(e, 10e-5))
+      << "Expected:\n" << e_expected << "\nActual:\n" << e;
+  Eigen::MatrixXf JtJ_expected = expected.getJtWJ();
+  Eigen::MatrixXf JtJ = err_.getJtWJ();
+  EXPECT_TRUE(JtJ_expected.isApprox(JtJ, 10e-5))
+      << "Expected:\n" << JtJ_expected << "\nActual:\n" << JtJ;
+  Eigen::MatrixXf Jte_expected = expected.getJtWe();
+  Eigen::MatrixXf Jte = err_.getJtWe();
+  EXPECT_TRUE(Jte_expected.isApprox(Jte, 10e-4))
+      << "Expected:\n" << Jte_expected << "\nActual:\n" << Jte;
+}
+
+/**
+ * Without damping, the Levenberg-Marquardt step is the Gauss-Newton one.
+ * Damping shortens the step, which still decreases the error.
+ */
+TEST_F(TestErrorPointToPoint, DampedUpdate) {
+  auto reference = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>());
+  auto current = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>());
+  for (int i = 0; i < 50; ++i) {
+    reference->push_back(pcl::PointXYZ(0.1f * (i % 5), 0.1f * (i / 5) + 0.01f * i, 0.02f * i * (i % 3)));
+  }
+  Eigen::Matrix4f T = eigentools::createTransformationMatrix(0.05f, -0.02f, 0.03f,
+                      0.1f, -0.05f, 0.08f);
+  pcl::transformPointCloud(*reference, *current, T);
+
+  err_.setInputReference(reference);
+  err_.setInputCurrent(current);
+  err_.computeErrorAndNormalEquations();
+  const float cost = err_.getCost();
+  EXPECT_FLOAT_EQ(err_.getErrorNorm() * err_.getErrorNorm(), cost);
+
+  const Eigen::Matrix4f gauss_newton = err_.update();
+  float predicted_decrease;
+  const Eigen::Matrix4f undamped = err_.update(0, predicted_decrease);
+  EXPECT_TRUE(gauss_newton.isApprox(undamped, 1e-5))
+      << "Expected:\n" << gauss_newton << "\nActual:\n" << undamped;
+  EXPECT_GT(predicted_decrease, 0);
+  EXPECT_LE(predicted_decrease, cost * (1 + 1e-4f));
+
+  float damped_decrease;
+  const Eigen::Matrix4f damped = err_.update(10, damped_decrease);
+  const float damped_norm = damped.topRightCorner<3, 1>().norm();
+  const float undamped_norm = undamped.topRightCorner<3, 1>().norm();
+  EXPECT_LT(damped_norm, undamped_norm);
+  EXPECT_GT(damped_decrease, 0);
+  EXPECT_LT(damped_decrease, predicted_decrease);
+
+  err_.setTransformation(damped);
+  err_.computeError();
+  EXPECT_LT(err_.getCost(), cost);
+}
+
+/**
+ * With exact correspondences, a single closed form update recovers the
+ * transformation, whatever its size. Weights reject the outliers.
+ */
+TEST_F(TestErrorPointToPoint, ClosedFormUpdate) {
+  auto reference = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>());
+  auto current = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>());
+  for (int i = 0; i < 50; ++i) {
+    reference->push_back(pcl::PointXYZ(0.1f * (i % 5), 0.1f * (i / 5) + 0.01f * i, 0.02f * i * (i % 3)));
+  }
+  Eigen::Matrix4f T = eigentools::createTransformationMatrix(0.5f, -0.2f, 0.3f, 1.f, -0.5f, 0.8f);
+  pcl::transformPointCloud(*reference, *current, Eigen::Matrix4f(T.inverse()));
+
+  err_.setInputReference(reference);
+  err_.setInputCurrent(current);
+  err_.computeErrorAndClosedForm();
+  Eigen::Matrix4f increment = err_.closedFormUpdate();
+  EXPECT_TRUE(increment.isApprox(T, 1e-4)) << "Expected:\n" << T << "\nActual:\n" << increment;
+  err_.setTransformation(increment);
+  err_.computeError();
+  EXPECT_NEAR(0.f, err_.getErrorNorm(), 1e-4f);
+
+  // A gross outlier, rejected by its weight
+  (*current)[10].x += 10.f;
+  err_.setTransformation(Eigen::Matrix4f::Identity());
+  err_.setInputCurrent(current);
+  err_.setMEstimator(MESTIMATOR_TUKEY, 0, SCALE_MEDIAN, 0);
+  err_.computeError();
+  err_.computeWeights();
+  err_.computeClosedForm();
+  increment = err_.closedFormUpdate();
+  EXPECT_TRUE(increment.isApprox(T, 1e-4)) << "Expected:\n" << T << "\nActual:\n" << increment;
+
+  // Rotation about the origin
+  ErrorPointToPointSO3XYZ err_so3;
+  const Eigen::Matrix4f R = eigentools::createTransformationMatrix(0.f, 0.f, 0.f, 1.f, -0.5f, 0.8f);
+  pcl::transformPointCloud(*reference, *current, Eigen::Matrix4f(R.inverse()));
+  err_so3.setInputReference(reference);
+  err_so3.setInputCurrent(current);
+  err_so3.computeErrorAndClosedForm();
+  increment = err_so3.closedFormUpdate();
+  EXPECT_TRUE(increment.isApprox(R, 1e-4)) << "Expected:\n" << R << "\nActual:\n" << increment;
+
+  // Similarity
+  ErrorPointToPointXYZSim3 err_sim3;
+  Eigen::Matrix4f S = T;
+  S.topLeftCorner<3, 3>() *= 1.5f;
+  pcl::transformPointCloud(*reference, *current, Eigen::Matrix4f(S.inverse()));
+  err_sim3.setInputReference(reference);
+  err_sim3.setInputCurrent(current);
+  err_sim3.computeErrorAndClosedForm();
+  increment = err_sim3.closedFormUpdate();
+  EXPECT_TRUE(increment.isApprox(S, 1e-4)) << "Expected:\n" << S << "\nActual:\n" << increment;
+}
+
 TEST_F(TestErrorPointToPoint, TranlationPartOfConstrainedJacobianUpdate) {
   boost::shared_ptr<Constraints6> c(new Constraints6());
   FixTranslationConstraint tc;
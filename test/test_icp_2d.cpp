@@ -0,0 +1,168 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <pcl/common/transforms.h>
+#include <icp/icp.hpp>
+#include <icp/linear_algebra.hpp>
+
+namespace test_icp {
+
+using namespace icp;
+
+/**
+ * Planar scan of a room with a pillar, as seen by a 2D range finder
+ */
+class Icp2DTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp() {
+      srand(3);
+      reference_.reset(new pcl::PointCloud<pcl::PointNormal>());
+      addWall(0.f, 0.f, 4.f, 0.f);
+      addWall(4.f, 0.f, 4.f, 3.f);
+      addWall(4.f, 3.f, 0.f, 3.f);
+      addWall(0.f, 3.f, 0.f, 0.f);
+      addWall(1.f, 1.f, 1.5f, 1.f);
+      addWall(1.5f, 1.f, 1.5f, 1.8f);
+
+      Eigen::Vector3f x(0.1f, -0.08f, 0.1f);
+      transformation_ = la::expSE2(x);
+      current_.reset(new pcl::PointCloud<pcl::PointNormal>());
+      pcl::transformPointCloudWithNormals(*reference_, *current_, Eigen::Matrix4f(transformation_.inverse()));
+    }
+
+    //! Points every 2cm along the segment, with its normal
+    void addWall(float x0, float y0, float x1, float y1) {
+      const Eigen::Vector2f d(x1 - x0, y1 - y0);
+      const int n = d.norm() / 0.02f;
+      for (int i = 0; i < n; ++i) {
+        pcl::PointNormal p;
+        p.getVector3fMap() << x0 + d.x() * i / n, y0 + d.y() * i / n, 0.f;
+        p.getNormalVector3fMap() << -d.y(), d.x(), 0.f;
+        p.getNormalVector3fMap().normalize();
+        reference_->push_back(p);
+      }
+    }
+
+    template<typename Icp>
+    IcpResults registration(Icp &icp, const typename Icp::Pr::Ptr &reference, const typename Icp::Pc::Ptr &current) {
+      IcpParameters param;
+      param.max_iter = 100;
+      param.min_variation = 0;
+      param.max_correspondance_distance = 0.5f;
+      icp.setParameters(param);
+      icp.setInputReference(reference);
+      icp.setInputCurrent(current);
+      icp.run();
+      return icp.getResults();
+    }
+
+    pcl::PointCloud<pcl::PointNormal>::Ptr reference_;
+    pcl::PointCloud<pcl::PointNormal>::Ptr current_;
+    Eigen::Matrix4f transformation_;
+};
+
+TEST(ExpSE2Test, Exponential) {
+  // A pure rotation about z
+  Eigen::Vector3f x(0.f, 0.f, 0.3f);
+  const Eigen::Matrix4f R = la::expSE2(x);
+  EXPECT_FLOAT_EQ(std::cos(0.3f), R(0, 0));
+  EXPECT_FLOAT_EQ(std::sin(0.3f), R(1, 0));
+  const Eigen::Vector3f t = R.topRightCorner<3, 1>();
+  EXPECT_TRUE(t.isZero());
+  // The planar twist is the 3D one restricted to (x, y, yaw)
+  x << 0.2f, -0.1f, 0.3f;
+  Eigen::Matrix<float, 6, 1> x3;
+  x3 << 0.2f, -0.1f, 0.f, 0.f, 0.f, 0.3f;
+  const Eigen::Matrix4f T = la::expSE2(x);
+  const Eigen::Matrix4f T3 = la::expSE3(x3);
+  EXPECT_TRUE(T.isApprox(T3, 1e-6)) << T << "\n" << T3;
+}
+
+/**
+ * Point to point matches would slide along the walls, register scattered
+ * points instead. The planar error finds the same registration as the 3D one
+ * on a planar scene.
+ */
+TEST_F(Icp2DTest, PointToPoint) {
+  pcl::PointCloud<pcl::PointXYZ>::Ptr reference(new pcl::PointCloud<pcl::PointXYZ>());
+  for (int i = 0; i < 500; ++i) {
+    reference->push_back(pcl::PointXYZ(rand() / float(RAND_MAX), rand() / float(RAND_MAX), 0.f));
+  }
+  pcl::PointCloud<pcl::PointXYZ>::Ptr current(new pcl::PointCloud<pcl::PointXYZ>());
+  pcl::transformPointCloud(*reference, *current, Eigen::Matrix4f(transformation_.inverse()));
+
+  IcpPointToPoint2D icp;
+  const IcpResults result = registration(icp, reference, current);
+  EXPECT_TRUE(result.transformation.isApprox(transformation_, 1e-3))
+      << "Expected:\n" << transformation_ << "\nActual:\n" << result.transformation;
+  IcpPointToPoint icp3d;
+  const IcpResults result3d = registration(icp3d, reference, current);
+  EXPECT_TRUE(result.transformation.isApprox(result3d.transformation, 1e-3))
+      << "3D:\n" << result3d.transformation << "\n2D:\n" << result.transformation;
+}
+
+/**
+ * With exact correspondences, a single closed form update recovers a large
+ * planar rotation, which the linearized step does not
+ */
+TEST_F(Icp2DTest, ClosedFormUpdate) {
+  pcl::PointCloud<pcl::PointXYZ>::Ptr reference(new pcl::PointCloud<pcl::PointXYZ>());
+  for (int i = 0; i < 100; ++i) {
+    reference->push_back(pcl::PointXYZ(rand() / float(RAND_MAX), rand() / float(RAND_MAX), 0.1f * (i % 3)));
+  }
+  const Eigen::Matrix4f T = la::expSE2(Eigen::Vector3f(0.5f, -1.f, 2.5f));
+  pcl::PointCloud<pcl::PointXYZ>::Ptr current(new pcl::PointCloud<pcl::PointXYZ>());
+  pcl::transformPointCloud(*reference, *current, Eigen::Matrix4f(T.inverse()));
+
+  ErrorPointToPoint2DXYZ err;
+  err.setInputReference(reference);
+  err.setInputCurrent(current);
+  err.computeErrorAndClosedForm();
+  const Eigen::Matrix4f increment = err.closedFormUpdate();
+  EXPECT_TRUE(increment.isApprox(T, 1e-4)) << "Expected:\n" << T << "\nActual:\n" << increment;
+  err.setTransformation(increment);
+  err.computeError();
+  EXPECT_NEAR(0.f, err.getErrorNorm(), 1e-3f);
+
+  err.setTransformation(Eigen::Matrix4f::Identity());
+  err.computeErrorAndNormalEquations();
+  const Eigen::Matrix4f gauss_newton = err.update();
+  EXPECT_FALSE(gauss_newton.isApprox(T, 1e-2));
+}
+
+TEST_F(Icp2DTest, PointToLine) {
+  IcpPointToLine2D icp;
+  const IcpResults result = registration(icp, reference_, current_);
+  EXPECT_TRUE(result.transformation.isApprox(transformation_, 1e-3))
+      << "Expected:\n" << transformation_ << "\nActual:\n" << result.transformation;
+}
+
+/**
+ * The planar error only moves the points in their plane, whatever their z
+ */
+TEST_F(Icp2DTest, PlanarMotion) {
+  for (unsigned int i = 0; i < current_->size(); ++i) {
+    (*current_)[i].z = 0.05f * (i % 7);
+    (*reference_)[i].z = 0.05f * (i % 5);
+  }
+  IcpPointToLine2D icp;
+  const IcpResults result = registration(icp, reference_, current_);
+  EXPECT_TRUE(result.transformation.isApprox(transformation_, 1e-3))
+      << "Expected:\n" << transformation_ << "\nActual:\n" << result.transformation;
+  const Eigen::Vector4f z(0.f, 0.f, 1.f, 0.f);
+  const Eigen::Vector4f z_transformed = result.transformation * z;
+  EXPECT_EQ(z, z_transformed);
+  EXPECT_EQ(0.f, result.transformation(2, 3));
+}
+
+}  // namespace test_icp
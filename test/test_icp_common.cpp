@@ -12,6 +12,7 @@
 #include <icp/eigentools.hpp>
 #include <icp/icp.hpp>
 #include <icp/constraints.hpp>
+#include "test_clouds.hpp"
 
 #define RAND_SCALE 10
 
@@ -70,6 +71,13 @@ class IcpCommonTest : public ::testing::Test {
     virtual void TearDown() {
     }
 
+    //! Registers onto the given reference a current cloud moved by the
+    //! inverse of the transformation
+    void setClouds(const PointCloudPtr &reference, const Eigen::Matrix4f &transformation) {
+      pc_m_ = reference;
+      pc_s_ = movedCloud(*reference, transformation);
+    }
+
     IcpMethod icp_;
     PointCloudPtr pc_m_;
     PointCloudPtr pc_s_;
@@ -318,6 +326,404 @@ TYPED_TEST(IcpCommonTest, Repeatability) {
   }
 }
 
+/**
+ * Runs the same registration with a serial and a multi-threaded
+ * correspondence search, the results should be identical
+ */
+TYPED_TEST(IcpCommonTest, MultiThreadedCorrespondences) {
+  DECLARE_TYPES(TypeParam);
+
+  Eigen::Matrix4f transformation
+    = eigentools::createTransformationMatrix(0.f,
+        0.05f,
+        0.f,
+        static_cast<float>(M_PI) / 200.f,
+        static_cast<float>(M_PI) / 200.f,
+        0.f);
+  PointCloudPtr pc_d (new PointCloud());
+  pcl::transformPointCloud(*this->pc_m_, *pc_d, transformation);
+
+  IcpParameters param;
+  IcpMethod icp_serial;
+  param.num_threads = 1;
+  icp_serial.setParameters(param);
+  icp_serial.setInputReference(this->pc_m_);
+  icp_serial.setInputCurrent(pc_d);
+  icp_serial.run();
+
+  IcpMethod icp_parallel;
+  param.num_threads = 3;
+  icp_parallel.setParameters(param);
+  icp_parallel.setInputReference(this->pc_m_);
+  icp_parallel.setInputCurrent(pc_d);
+  icp_parallel.run();
+
+  IcpResults r_serial = icp_serial.getResults();
+  IcpResults r_parallel = icp_parallel.getResults();
+  EXPECT_EQ(r_serial.transformation, r_parallel.transformation);
+  EXPECT_EQ(r_serial.registrationError, r_parallel.registrationError);
+}
+
+/**
+ * The initial guess can be given before or after the reference cloud, and
+ * changed between runs, without ever modifying the reference cloud
+ */
+TYPED_TEST(IcpCommonTest, InitialGuess) {
+  DECLARE_TYPES(TypeParam);
+
+  PointCloudPtr pc_m (new PointCloud());
+  for (int i = 0; i < 5; ++i) {
+    for (int j = 0; j < 5; ++j) {
+      for (int k = 0; k < 5; ++k) {
+        pc_m->push_back(PointType(0.1f * i, 0.1f * j + 0.02f * i, 0.1f * k + 0.03f * j));
+      }
+    }
+  }
+  const PointCloud pc_m_copy = *pc_m;
+  Eigen::Matrix4f transformation
+    = eigentools::createTransformationMatrix(0.5f, -1.f, 2.f, 0.1f, -0.2f, 0.3f);
+  PointCloudPtr pc_d (new PointCloud());
+  pcl::transformPointCloud(*pc_m, *pc_d, Eigen::Matrix4f(transformation.inverse()));
+
+  IcpParameters param;
+  param.max_iter = 50;
+  param.initial_guess
+    = eigentools::createTransformationMatrix(0.49f, -1.01f, 2.01f, 0.11f, -0.19f, 0.3f);
+
+  IcpMethod icp_before;
+  icp_before.setParameters(param);
+  icp_before.setInputReference(pc_m);
+  icp_before.setInputCurrent(pc_d);
+  icp_before.run();
+
+  IcpMethod icp_after;
+  icp_after.setInputReference(pc_m);
+  icp_after.setInputCurrent(pc_d);
+  icp_after.setParameters(param);
+  icp_after.run();
+
+  IcpResults r_before = icp_before.getResults();
+  IcpResults r_after = icp_after.getResults();
+  EXPECT_EQ(r_before.transformation, r_after.transformation);
+  EXPECT_TRUE(r_after.transformation.isApprox(transformation, 10e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << r_after.transformation;
+
+  // A new guess on the same instance gives the same result as a fresh
+  // instance starting from it, nothing is kept from the previous run
+  param.initial_guess
+    = eigentools::createTransformationMatrix(0.52f, -0.98f, 1.99f, 0.09f, -0.21f, 0.31f);
+  icp_after.setParameters(param);
+  icp_after.run();
+
+  IcpMethod icp_fresh;
+  icp_fresh.setParameters(param);
+  icp_fresh.setInputReference(pc_m);
+  icp_fresh.setInputCurrent(pc_d);
+  icp_fresh.run();
+
+  IcpResults r_changed = icp_after.getResults();
+  IcpResults r_fresh = icp_fresh.getResults();
+  EXPECT_EQ(r_fresh.transformation, r_changed.transformation);
+  EXPECT_EQ(r_fresh.registrationError, r_changed.registrationError);
+  EXPECT_TRUE(r_changed.transformation.isApprox(transformation, 10e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << r_changed.transformation;
+
+  for (unsigned int i = 0; i < pc_m->size(); ++i) {
+    EXPECT_EQ(pc_m_copy[i].getVector3fMap(), (*pc_m)[i].getVector3fMap())
+        << "The reference cloud was modified";
+  }
+}
+
+/**
+ * Coarse to fine registration should reach the same alignment as the full
+ * resolution one
+ */
+TYPED_TEST(IcpCommonTest, Pyramid) {
+  DECLARE_TYPES(TypeParam);
+
+  Eigen::Matrix4f transformation
+    = eigentools::createTransformationMatrix(0.02f, -0.03f, 0.01f, 0.03f, -0.02f, 0.02f);
+  this->setClouds(gridCloud<PointType>(), transformation);
+  const PointCloudPtr &pc_m = this->pc_m_, &pc_d = this->pc_s_;
+
+  IcpParameters param;
+  param.max_iter = 20;
+  param.pyramid.push_back(IcpPyramidLevel(0.4f, 5));
+  param.pyramid.push_back(IcpPyramidLevel(0.2f, 5));
+  this->icp_.setParameters(param);
+  this->icp_.setInputReference(pc_m);
+  this->icp_.setInputCurrent(pc_d);
+  this->icp_.run();
+
+  IcpResults r = this->icp_.getResults();
+  EXPECT_TRUE(r.has_converged);
+  EXPECT_TRUE(r.transformation.isApprox(transformation, 10e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << r.transformation;
+
+  // Runs again with the cached reference levels
+  this->icp_.run();
+  IcpResults r2 = this->icp_.getResults();
+  EXPECT_TRUE(r2.transformation.isApprox(transformation, 10e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << r2.transformation;
+
+  // A level without any correspondence stops the registration
+  param.pyramid[0].max_correspondance_distance = 1e-6f;
+  this->icp_.setParameters(param);
+  this->icp_.run();
+  IcpResults r3 = this->icp_.getResults();
+  EXPECT_EQ(STOP_FAILED, r3.stop_reason);
+  EXPECT_FALSE(r3.has_converged);
+  EXPECT_TRUE(r3.registrationError.empty()) << "The full resolution should not run";
+}
+
+/**
+ * Registration with a small random sample of the current points, drawn again
+ * at each iteration
+ */
+TYPED_TEST(IcpCommonTest, Subsampling) {
+  DECLARE_TYPES(TypeParam);
+
+  Eigen::Matrix4f transformation
+    = eigentools::createTransformationMatrix(0.02f, -0.01f, 0.01f, 0.02f, -0.01f, 0.01f);
+  this->setClouds(gridCloud<PointType>(), transformation);
+  const PointCloudPtr &pc_m = this->pc_m_, &pc_d = this->pc_s_;
+
+  IcpParameters param;
+  param.max_iter = 30;
+  param.min_variation = 0;
+  param.sampling = SAMPLING_RANDOM;
+  param.sample_size = 200;
+  this->icp_.setParameters(param);
+  this->icp_.setInputReference(pc_m);
+  this->icp_.setInputCurrent(pc_d);
+  this->icp_.run();
+
+  IcpResults r = this->icp_.getResults();
+  EXPECT_TRUE(r.transformation.isApprox(transformation, 10e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << r.transformation;
+
+  // Reproducible
+  IcpMethod icp;
+  icp.setParameters(param);
+  icp.setInputReference(pc_m);
+  icp.setInputCurrent(pc_d);
+  icp.run();
+  EXPECT_EQ(r.registrationError, icp.getResults().registrationError);
+}
+
+/**
+ * Each convergence criterion stops the iterations on its own, and the reason
+ * is reported in the results
+ */
+TYPED_TEST(IcpCommonTest, ConvergenceCriteria) {
+  DECLARE_TYPES(TypeParam);
+
+  Eigen::Matrix4f transformation
+    = eigentools::createTransformationMatrix(0.02f, -0.01f, 0.01f, 0.02f, -0.01f, 0.01f);
+  this->setClouds(gridCloud<PointType>(), transformation);
+  const PointCloudPtr &pc_m = this->pc_m_, &pc_d = this->pc_s_;
+
+  // Each run starts from scratch
+  auto run = [&](const IcpParameters &param) {
+    IcpMethod icp;
+    icp.setParameters(param);
+    icp.setInputReference(pc_m);
+    icp.setInputCurrent(pc_d);
+    icp.run();
+    return icp.getResults();
+  };
+
+  IcpParameters param;
+  param.min_variation = 0;
+
+  // Not enough iterations
+  param.max_iter = 1;
+  IcpResults r = run(param);
+  EXPECT_EQ(STOP_MAX_ITERATIONS, r.stop_reason);
+  EXPECT_FALSE(r.has_converged);
+  EXPECT_EQ(1u, r.registrationError.size());
+  param.max_iter = 50;
+
+  // Small pose increment
+  param.min_rotation_increment = 1e-3f;
+  param.min_translation_increment = 1e-3f;
+  r = run(param);
+  EXPECT_EQ(STOP_INCREMENT, r.stop_reason);
+  EXPECT_TRUE(r.has_converged);
+  EXPECT_TRUE(r.transformation.isApprox(transformation, 10e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << r.transformation;
+  const size_t increment_iterations = r.registrationError.size();
+
+  // A loose RMSE is met at the first iteration
+  param.min_rotation_increment = 0;
+  param.min_translation_increment = 0;
+  param.max_rmse = 1;
+  r = run(param);
+  EXPECT_EQ(STOP_RMSE, r.stop_reason);
+  EXPECT_EQ(1u, r.registrationError.size());
+  EXPECT_GT(1, r.rmse);
+
+  // Unless the increment has to be small as well
+  param.min_rotation_increment = 1e-3f;
+  param.min_translation_increment = 1e-3f;
+  param.convergence_policy = CONVERGENCE_ALL;
+  r = run(param);
+  EXPECT_EQ(STOP_ALL_CRITERIA, r.stop_reason);
+  EXPECT_EQ(increment_iterations, r.registrationError.size());
+
+  // An RMSE out of reach is never met, whether the error stops decreasing or
+  // not
+  param.max_rmse = 1e-20f;
+  r = run(param);
+  EXPECT_NE(STOP_ALL_CRITERIA, r.stop_reason);
+  EXPECT_FALSE(r.has_converged) << r;
+}
+
+/**
+ * Far initialization: the Levenberg-Marquardt solver reaches the alignment
+ */
+TYPED_TEST(IcpCommonTest, LevenbergMarquardt) {
+  DECLARE_TYPES(TypeParam);
+
+  Eigen::Matrix4f transformation
+    = eigentools::createTransformationMatrix(0.05f, -0.05f, 0.05f, 0.3f, -0.2f, 0.25f);
+  this->setClouds(randomCloud<PointType>(7), transformation);
+  const PointCloudPtr &pc_m = this->pc_m_, &pc_d = this->pc_s_;
+
+  IcpParameters param;
+  param.max_iter = 100;
+  param.min_variation = 0;
+  param.min_rotation_increment = 1e-5f;
+  param.min_translation_increment = 1e-5f;
+  param.solver = SOLVER_LEVENBERG_MARQUARDT;
+  this->icp_.setParameters(param);
+  this->icp_.setInputReference(pc_m);
+  this->icp_.setInputCurrent(pc_d);
+  this->icp_.run();
+
+  IcpResults r = this->icp_.getResults();
+  EXPECT_TRUE(r.has_converged) << r;
+  EXPECT_TRUE(r.transformation.isApprox(transformation, 10e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << r.transformation;
+}
+
+/**
+ * Tetrahedron far from the origin, rotated by 1.2 rad: the linearization of
+ * the rotation is so poor that the Gauss-Newton steps increase the error and
+ * stop away from the alignment. The damped steps are rejected until they
+ * decrease the error, and reach it.
+ */
+TEST(IcpLevenbergMarquardtTest, IncreasingGaussNewtonSteps) {
+  pcl::PointCloud<pcl::PointXYZ>::Ptr reference(new pcl::PointCloud<pcl::PointXYZ>());
+  reference->push_back(pcl::PointXYZ(4, 4, 4));
+  reference->push_back(pcl::PointXYZ(4, 2, 2));
+  reference->push_back(pcl::PointXYZ(2, 4, 2));
+  reference->push_back(pcl::PointXYZ(2, 2, 4));
+  const Eigen::Matrix4f transformation = eigentools::createTransformationMatrix(0.f, 0.f, 0.f, 1.2f, 0.f, 0.f);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr current = movedCloud(*reference, transformation);
+
+  IcpParameters param;
+  param.max_iter = 100;
+  param.min_variation = 0;
+  param.min_rotation_increment = 1e-6f;
+  param.min_translation_increment = 1e-6f;
+  IcpPointToPoint icp;
+  icp.setInputReference(reference);
+  icp.setInputCurrent(current);
+  icp.setParameters(param);
+  icp.run();
+  IcpResults r = icp.getResults();
+  EXPECT_EQ(STOP_NO_DECREASE, r.stop_reason);
+  EXPECT_FALSE(r.transformation.isApprox(transformation, 10e-3)) << r.transformation;
+
+  param.solver = SOLVER_LEVENBERG_MARQUARDT;
+  icp.setParameters(param);
+  icp.run();
+  r = icp.getResults();
+  EXPECT_TRUE(r.has_converged) << r;
+  EXPECT_TRUE(r.transformation.isApprox(transformation, 10e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << r.transformation;
+  for (unsigned int i = 1; i < r.registrationError.size(); ++i) {
+    EXPECT_LT(r.registrationError[i], r.registrationError[i - 1]);
+  }
+}
+
+/**
+ * The closed form solver reaches the same alignment as the Gauss-Newton one
+ */
+TYPED_TEST(IcpCommonTest, ClosedForm) {
+  DECLARE_TYPES(TypeParam);
+
+  Eigen::Matrix4f transformation
+    = eigentools::createTransformationMatrix(0.05f, -0.05f, 0.05f, 0.1f, -0.1f, 0.15f);
+  this->setClouds(randomCloud<PointType>(7), transformation);
+  const PointCloudPtr &pc_m = this->pc_m_, &pc_d = this->pc_s_;
+
+  IcpParameters param;
+  param.max_iter = 100;
+  param.min_variation = 0;
+  param.min_rotation_increment = 1e-5f;
+  param.min_translation_increment = 1e-5f;
+  this->icp_.setParameters(param);
+  this->icp_.setInputReference(pc_m);
+  this->icp_.setInputCurrent(pc_d);
+  this->icp_.run();
+  const IcpResults gauss_newton = this->icp_.getResults();
+
+  param.solver = SOLVER_CLOSED_FORM;
+  this->icp_.setParameters(param);
+  this->icp_.run();
+  IcpResults r = this->icp_.getResults();
+  EXPECT_TRUE(r.has_converged) << r;
+  EXPECT_TRUE(r.transformation.isApprox(transformation, 10e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << r.transformation;
+  EXPECT_TRUE(r.transformation.isApprox(gauss_newton.transformation, 10e-3))
+      << "Gauss-Newton:\n" << gauss_newton.transformation << "\nClosed form:\n" << r.transformation;
+}
+
+/**
+ * Reusing each correspondence set for several updates reaches the same
+ * alignment, with at most as many searches
+ */
+TYPED_TEST(IcpCommonTest, InnerIterations) {
+  DECLARE_TYPES(TypeParam);
+
+  Eigen::Matrix4f transformation
+    = eigentools::createTransformationMatrix(0.05f, -0.05f, 0.05f, 0.1f, -0.1f, 0.1f);
+  this->setClouds(randomCloud<PointType>(7), transformation);
+  const PointCloudPtr &pc_m = this->pc_m_, &pc_d = this->pc_s_;
+
+  auto run = [&](const IcpParameters &param) {
+    IcpMethod icp;
+    icp.setParameters(param);
+    icp.setInputReference(pc_m);
+    icp.setInputCurrent(pc_d);
+    icp.run();
+    return icp.getResults();
+  };
+
+  IcpParameters param;
+  param.max_iter = 50;
+  param.min_variation = 0;
+  param.min_rotation_increment = 1e-5f;
+  param.min_translation_increment = 1e-5f;
+  IcpResults r_single = run(param);
+
+  param.inner_iterations = 10;
+  param.inner_min_displacement = 1e-6f;
+  IcpResults r_inner = run(param);
+  EXPECT_TRUE(r_inner.has_converged) << r_inner;
+  EXPECT_TRUE(r_inner.transformation.isApprox(transformation, 10e-3))
+      << "Expected:\n" << transformation << "\nActual:\n" << r_inner.transformation;
+  // Each iteration runs one correspondence search
+  EXPECT_LE(r_inner.registrationError.size(), r_single.registrationError.size());
+
+  // Searching again as soon as the points move is the single update mode
+  param.inner_max_displacement = 0;
+  IcpResults r_moved = run(param);
+  EXPECT_EQ(r_single.registrationError, r_moved.registrationError);
+  EXPECT_EQ(r_single.transformation, r_moved.transformation);
+}
 
 //TYPED_TEST(IcpCommonTest, TranlationConstraintEnforcement) {
 //  DECLARE_TYPES(TypeParam);
@@ -0,0 +1,173 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <pcl/common/transforms.h>
+#include <icp/eigentools.hpp>
+#include <icp/icp.hpp>
+#include <icp/kdtree.hpp>
+
+namespace test_icp {
+
+using namespace icp;
+
+class KdTreeTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp() {
+      srand(42);
+      cloud_ = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>());
+      for (int i = 0; i < 2000; ++i) {
+        cloud_->push_back(pcl::PointXYZ(random(), random(), random()));
+      }
+      for (int i = 0; i < 200; ++i) {
+        queries_.push_back(Eigen::Vector3f(random(), random(), random()));
+      }
+      // Exact duplicates and points of the cloud itself
+      queries_.push_back((*cloud_)[0].getVector3fMap());
+      cloud_->push_back((*cloud_)[10]);
+      queries_.push_back((*cloud_)[10].getVector3fMap());
+    }
+
+    static float random() {
+      return static_cast<float>(rand()) / RAND_MAX;
+    }
+
+    /**
+     * Brute force reference
+     */
+    bool bruteForce(const Eigen::Vector3f &query, float max_sqr_distance, float &sqr_distance) const {
+      bool found = false;
+      sqr_distance = max_sqr_distance;
+      for (unsigned int i = 0; i < cloud_->size(); ++i) {
+        const float d = ((*cloud_)[i].getVector3fMap() - query).squaredNorm();
+        if (d <= sqr_distance) {
+          sqr_distance = d;
+          found = true;
+        }
+      }
+      return found;
+    }
+
+    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_;
+    std::vector<Eigen::Vector3f> queries_;
+};
+
+TEST_F(KdTreeTest, NearestMatchesBruteForce) {
+  for (unsigned int leaf_size = 1; leaf_size <= 16; leaf_size *= 4) {
+    ImplicitKdTree<pcl::PointXYZ> tree(leaf_size);
+    tree.setInputCloud(cloud_);
+    EXPECT_EQ(cloud_->size(), tree.size());
+    for (const Eigen::Vector3f &query : queries_) {
+      float expected;
+      ASSERT_TRUE(bruteForce(query, std::numeric_limits<float>::infinity(), expected));
+      int index;
+      float sqr_distance;
+      ASSERT_TRUE(tree.nearest(query, std::numeric_limits<float>::infinity(), index, sqr_distance));
+      EXPECT_FLOAT_EQ(expected, sqr_distance) << "Leaf size " << leaf_size;
+      EXPECT_FLOAT_EQ(sqr_distance, ((*cloud_)[index].getVector3fMap() - query).squaredNorm())
+          << "Returned index does not match the returned distance";
+    }
+  }
+}
+
+/**
+ * The 2D tree ignores z, in the cloud and in the queries
+ */
+TEST_F(KdTreeTest, NearestMatchesBruteForce2D) {
+  ImplicitKdTree2D<pcl::PointXYZ> tree;
+  tree.setInputCloud(cloud_);
+  for (const Eigen::Vector3f &query : queries_) {
+    float expected = std::numeric_limits<float>::infinity();
+    for (unsigned int i = 0; i < cloud_->size(); ++i) {
+      expected = std::min(expected, ((*cloud_)[i].getVector3fMap() - query).head<2>().squaredNorm());
+    }
+    int index;
+    float sqr_distance;
+    ASSERT_TRUE(tree.nearest(query, std::numeric_limits<float>::infinity(), index, sqr_distance));
+    EXPECT_FLOAT_EQ(expected, sqr_distance);
+    EXPECT_FLOAT_EQ(sqr_distance, ((*cloud_)[index].getVector3fMap() - query).head<2>().squaredNorm());
+  }
+}
+
+TEST_F(KdTreeTest, BoundedNearest) {
+  ImplicitKdTree<pcl::PointXYZ> tree;
+  tree.setInputCloud(cloud_);
+  const float max_sqr_distance = 0.0005f;
+  int found = 0;
+  for (const Eigen::Vector3f &query : queries_) {
+    float expected;
+    const bool expected_found = bruteForce(query, max_sqr_distance, expected);
+    int index;
+    float sqr_distance;
+    ASSERT_EQ(expected_found, tree.nearest(query, max_sqr_distance, index, sqr_distance));
+    if (expected_found) {
+      EXPECT_FLOAT_EQ(expected, sqr_distance);
+      ++found;
+    }
+  }
+  // Make sure both cases are exercised
+  EXPECT_GT(found, 0);
+  EXPECT_LT(found, static_cast<int>(queries_.size()));
+}
+
+TEST_F(KdTreeTest, EmptyAndInvalid) {
+  ImplicitKdTree<pcl::PointXYZ> tree;
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>());
+  tree.setInputCloud(cloud);
+  int index;
+  float sqr_distance;
+  EXPECT_FALSE(tree.nearest(Eigen::Vector3f::Zero(), 1.f, index, sqr_distance));
+
+  // Invalid points are never returned
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  cloud->push_back(pcl::PointXYZ(nan, nan, nan));
+  cloud->push_back(pcl::PointXYZ(1, 1, 1));
+  tree.setInputCloud(cloud);
+  EXPECT_EQ(1u, tree.size());
+  ASSERT_TRUE(tree.nearest(Eigen::Vector3f::Zero(), 10.f, index, sqr_distance));
+  EXPECT_EQ(1, index);
+  EXPECT_FLOAT_EQ(3.f, sqr_distance);
+}
+
+/**
+ * Both search policies must lead to the same registration
+ */
+TEST_F(KdTreeTest, IcpSearchPolicies) {
+  Eigen::Matrix4f transformation = eigentools::createTransformationMatrix(0.01f, 0.02f, 0.f,
+                                   0.02f, 0.f, 0.01f);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr current(new pcl::PointCloud<pcl::PointXYZ>());
+  pcl::transformPointCloud(*cloud_, *current, transformation);
+
+  IcpParametersf param;
+  param.max_iter = 20;
+
+  IcpPointToPoint icp_flann;
+  icp_flann.setParameters(param);
+  icp_flann.setInputReference(cloud_);
+  icp_flann.setInputCurrent(current);
+  icp_flann.run();
+
+  Icp_<float, pcl::PointXYZ, pcl::PointXYZ, ErrorPointToPointXYZ, ImplicitKdTree<pcl::PointXYZ>> icp_implicit;
+  icp_implicit.setParameters(param);
+  icp_implicit.setInputReference(cloud_);
+  icp_implicit.setInputCurrent(current);
+  icp_implicit.run();
+
+  IcpResults r_flann = icp_flann.getResults();
+  IcpResults r_implicit = icp_implicit.getResults();
+  EXPECT_EQ(r_flann.registrationError.size(), r_implicit.registrationError.size());
+  EXPECT_TRUE(r_flann.transformation.isApprox(r_implicit.transformation, 1e-5))
+      << "FLANN:\n" << r_flann.transformation << "\nImplicit:\n" << r_implicit.transformation;
+}
+
+}  // namespace test_icp
@@ -111,4 +111,39 @@ TEST_F(PclToolsTest, GetColumn) {
   EXPECT_TRUE(col2.isApprox(col2_expected));
 }
 
+TEST_F(PclToolsTest, VoxelDownsample) {
+  pcl::PointCloud<pcl::PointXYZ>::Ptr src(new pcl::PointCloud<pcl::PointXYZ>());
+  // Two voxels of size 1, the second one with 3 points
+  src->push_back(pcl::PointXYZ(0.5, 0.5, 0.5));
+  src->push_back(pcl::PointXYZ(1.1, 0.2, 0.2));
+  src->push_back(pcl::PointXYZ(1.5, 0.5, 0.5));
+  src->push_back(pcl::PointXYZ(1.9, 0.8, 0.8));
+  // Invalid points are dropped
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  src->push_back(pcl::PointXYZ(nan, nan, nan));
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr dst(new pcl::PointCloud<pcl::PointXYZ>());
+  pcltools::voxelDownsample<pcl::PointXYZ>(src, 1.f, dst);
+  ASSERT_EQ(2u, dst->size());
+  // Each voxel keeps the original point closest to its centroid
+  EXPECT_TRUE(pcltools::isApprox((*dst)[0], (*src)[0]));
+  EXPECT_TRUE(pcltools::isApprox((*dst)[1], (*src)[2]));
+
+  // Voxels smaller than the point spacing keep every point
+  pcltools::voxelDownsample<pcl::PointXYZ>(src, 0.01f, dst);
+  EXPECT_EQ(4u, dst->size());
+
+  // Voxels far apart, on both sides of 0, are not merged
+  src->clear();
+  src->push_back(pcl::PointXYZ(-0.5, 0.5, 0.5));
+  src->push_back(pcl::PointXYZ(0.5, 0.5, 0.5));
+  src->push_back(pcl::PointXYZ(0.5 + (1 << 21), 0.5, 0.5));
+  src->push_back(pcl::PointXYZ(0.5, 0.5 - (1 << 21), 0.5));
+  pcltools::voxelDownsample<pcl::PointXYZ>(src, 1.f, dst);
+  EXPECT_EQ(4u, dst->size());
+  // More voxels than fit in a single key
+  pcltools::voxelDownsample<pcl::PointXYZ>(src, 1e-6f, dst);
+  EXPECT_EQ(4u, dst->size());
+}
+
 }  // namespace test_icp
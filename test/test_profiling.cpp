@@ -0,0 +1,81 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <pcl/common/transforms.h>
+#include <icp/eigentools.hpp>
+#include <icp/icp.hpp>
+#include <icp/profiling.hpp>
+#include "test_clouds.hpp"
+
+namespace test_icp {
+
+using namespace icp;
+
+TEST(ProfilingTest, ScopedTimer) {
+  double milliseconds = 1;
+  {
+    ScopedTimer timer(milliseconds);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  EXPECT_GE(milliseconds, 3);
+}
+
+/**
+ * With ICP_PROFILING, every iteration is profiled, otherwise the profile
+ * stays empty
+ */
+TEST(ProfilingTest, Results) {
+  pcl::PointCloud<pcl::PointXYZ>::Ptr reference = randomCloud<pcl::PointXYZ>(17);
+  const Eigen::Matrix4f transformation = eigentools::createTransformationMatrix(0.05f, -0.05f, 0.02f,
+                                         0.1f, 0.05f, -0.05f);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr current = movedCloud(*reference, transformation);
+  // Too far from the reference to be matched
+  for (int i = 0; i < 20; ++i) {
+    current->push_back(pcl::PointXYZ(5.f + i, 5.f, 5.f));
+  }
+
+  IcpPointToPoint icp;
+  IcpParameters param;
+  param.max_iter = 20;
+  param.max_correspondance_distance = 1.f;
+  param.mestimator = true;
+  param.pyramid.push_back(IcpPyramidLevel(0.2f, 5, 1.f));
+  icp.setParameters(param);
+  icp.setInputReference(reference);
+  icp.setInputCurrent(current);
+  icp.run();
+  const IcpResults r = icp.getResults();
+
+#if ICP_PROFILING_ENABLED
+  ASSERT_EQ(r.registrationError.size(), r.profile.iterations.size());
+  EXPECT_GT(r.profile.index_build_time, 0);
+  EXPECT_GT(r.profile.pyramid_time, 0);
+  EXPECT_EQ(0, r.profile.iterations.front().level);
+  EXPECT_EQ(-1, r.profile.iterations.back().level);
+  for (const IcpIterationProfile &it : r.profile.iterations) {
+    EXPECT_GT(it.search_time, 0);
+    EXPECT_GT(it.error_time, 0);
+    EXPECT_GT(it.weights_time, 0);
+    EXPECT_GT(it.solve_time, 0);
+    EXPECT_EQ(it.num_queries, it.num_correspondences + it.num_rejected);
+  }
+  const IcpIterationProfile &last = r.profile.iterations.back();
+  EXPECT_EQ(current->size(), last.num_queries);
+  EXPECT_EQ(20u, last.num_rejected);
+#else
+  EXPECT_TRUE(r.profile.empty());
+  EXPECT_EQ(0, r.profile.index_build_time);
+#endif
+}
+
+}  // namespace test_icp
@@ -0,0 +1,109 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <thread>
+#include <pcl/common/transforms.h>
+#include <icp/icp.hpp>
+#include <icp/eigentools.hpp>
+
+namespace test_icp {
+
+using namespace icp;
+
+class ReferenceModelTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp() {
+      srand(5);
+      pcl::PointCloud<pcl::PointXYZ>::Ptr reference(new pcl::PointCloud<pcl::PointXYZ>());
+      for (int i = 0; i < 500; ++i) {
+        reference->push_back(pcl::PointXYZ(random(), random(), random()));
+      }
+      model_.reset(new IcpPointToPoint::ReferenceModel(reference));
+      for (int i = 0; i < 4; ++i) {
+        const float f = 0.02f * i;
+        transformations_.push_back(eigentools::createTransformationMatrix(0.05f + f, -0.05f, f,
+                                   0.1f, -f, 0.05f));
+        pcl::PointCloud<pcl::PointXYZ>::Ptr current(new pcl::PointCloud<pcl::PointXYZ>());
+        pcl::transformPointCloud(*reference, *current, Eigen::Matrix4f(transformations_[i].inverse()));
+        currents_.push_back(current);
+      }
+      param_.max_iter = 30;
+      param_.pyramid.push_back(IcpPyramidLevel(0.2f, 5));
+    }
+
+    static float random() {
+      return static_cast<float>(rand()) / RAND_MAX;
+    }
+
+    IcpResults registration(unsigned int i) {
+      IcpPointToPoint icp(model_);
+      icp.setParameters(param_);
+      icp.setInputCurrent(currents_[i]);
+      icp.run();
+      return icp.getResults();
+    }
+
+    IcpPointToPoint::ReferenceModelConstPtr model_;
+    std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> currents_;
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> transformations_;
+    IcpParameters param_;
+};
+
+TEST_F(ReferenceModelTest, Levels) {
+  IcpPointToPoint::ReferenceModel::LevelConstPtr level = model_->getLevel(0.2f);
+  EXPECT_LT(level->cloud->size(), model_->size());
+  EXPECT_GT(level->cloud->size(), 0u);
+  EXPECT_EQ(level, model_->getLevel(0.2f)) << "A level should only be built once";
+  EXPECT_NE(level, model_->getLevel(0.3f));
+}
+
+/**
+ * Instances registering concurrently against the same model give the same
+ * results as one after the other
+ */
+TEST_F(ReferenceModelTest, ConcurrentRegistrations) {
+  std::vector<IcpResults> expected;
+  for (unsigned int i = 0; i < currents_.size(); ++i) {
+    expected.push_back(registration(i));
+    EXPECT_TRUE(expected[i].transformation.isApprox(transformations_[i], 1e-3))
+        << "Expected:\n" << transformations_[i] << "\nActual:\n" << expected[i].transformation;
+  }
+
+  // A fresh model, so that its pyramid level is requested by all the threads
+  // at once
+  model_.reset(new IcpPointToPoint::ReferenceModel(model_->getCloud()));
+  std::vector<IcpResults> results(currents_.size());
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < currents_.size(); ++i) {
+    threads.push_back(std::thread([this, &results, i]() {
+      results[i] = registration(i);
+    }));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (unsigned int i = 0; i < currents_.size(); ++i) {
+    EXPECT_EQ(expected[i].transformation, results[i].transformation);
+    EXPECT_EQ(expected[i].registrationError, results[i].registrationError);
+  }
+}
+
+TEST_F(ReferenceModelTest, SharedBySetInputReference) {
+  IcpPointToPoint first, second;
+  pcl::PointCloud<pcl::PointXYZ>::Ptr reference(new pcl::PointCloud<pcl::PointXYZ>(*model_->getCloud()));
+  first.setInputReference(reference);
+  second.setReferenceModel(first.getReferenceModel());
+  EXPECT_EQ(first.getReferenceModel(), second.getReferenceModel());
+  EXPECT_EQ(reference, first.getReferenceModel()->getCloud()) << "The cloud should not be copied";
+}
+
+}  // namespace test_icp
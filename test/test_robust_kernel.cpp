@@ -0,0 +1,182 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <pcl/common/transforms.h>
+#include <icp/icp.hpp>
+#include <icp/mestimator.hpp>
+#include <icp/eigentools.hpp>
+
+namespace test_icp {
+
+using namespace icp;
+
+TEST(RobustKernelTest, HuberMatchesScalar) {
+  Eigen::VectorXf r(6);
+  r << 0.f, 0.5f, -1.f, 2.f, -3.f, 10.f;
+  Eigen::VectorXf w(r.size());
+  robustWeights<float>(MESTIMATOR_HUBER, 1.345f, r, 0.5f, w);
+  for (int i = 0; i < r.size(); ++i) {
+    EXPECT_FLOAT_EQ(hubert_weight(r[i] / 0.5f), w[i]);
+  }
+}
+
+TEST(RobustKernelTest, Kernels) {
+  const MEstimatorType types[] = {MESTIMATOR_HUBER, MESTIMATOR_TUKEY, MESTIMATOR_CAUCHY,
+                                  MESTIMATOR_GEMAN_MCCLURE, MESTIMATOR_WELSCH
+                                 };
+  Eigen::VectorXf r(8);
+  r << 0.f, 0.1f, 0.5f, 1.f, 2.f, 5.f, -0.5f, -5.f;
+  Eigen::VectorXf w(r.size());
+  for (MEstimatorType type : types) {
+    robustWeights<float>(type, 1.f, r, 1.f, w);
+    EXPECT_FLOAT_EQ(1.f, w[0]) << toString(type);
+    for (int i = 1; i < 6; ++i) {
+      EXPECT_LE(w[i], w[i - 1]) << toString(type) << ": weights should decrease with the residual";
+      EXPECT_GE(w[i], 0.f) << toString(type);
+    }
+    EXPECT_FLOAT_EQ(w[2], w[6]) << toString(type);
+    EXPECT_FLOAT_EQ(w[5], w[7]) << toString(type);
+  }
+
+  // Values at u = 0.5 and u = 2
+  robustWeights<float>(MESTIMATOR_TUKEY, 1.f, r, 1.f, w);
+  EXPECT_FLOAT_EQ(0.5625f, w[2]);
+  EXPECT_FLOAT_EQ(0.f, w[4]) << "Tukey should reject residuals beyond its tuning constant";
+  robustWeights<float>(MESTIMATOR_CAUCHY, 1.f, r, 1.f, w);
+  EXPECT_FLOAT_EQ(0.8f, w[2]);
+  EXPECT_FLOAT_EQ(0.2f, w[4]);
+  robustWeights<float>(MESTIMATOR_GEMAN_MCCLURE, 1.f, r, 1.f, w);
+  EXPECT_FLOAT_EQ(0.64f, w[2]);
+  EXPECT_FLOAT_EQ(0.04f, w[4]);
+  robustWeights<float>(MESTIMATOR_WELSCH, 1.f, r, 1.f, w);
+  EXPECT_FLOAT_EQ(std::exp(-0.25f), w[2]);
+  EXPECT_FLOAT_EQ(std::exp(-4.f), w[4]);
+
+  // Perfect fit
+  robustWeights<float>(MESTIMATOR_TUKEY, 4.6851f, r, 0.f, w);
+  EXPECT_EQ(Eigen::VectorXf::Ones(r.size()), w);
+}
+
+TEST(RobustKernelTest, Scale) {
+  Eigen::VectorXf v(7);
+  v << 1.f, 1.f, 2.f, 2.f, 4.f, 6.f, 9.f;
+  EXPECT_FLOAT_EQ(1.f / 0.6745f, robustScale<float>(SCALE_MAD, v, 0.f));
+  EXPECT_FLOAT_EQ(2.f / 0.6745f, robustScale<float>(SCALE_MEDIAN, -v, 0.f));
+  EXPECT_FLOAT_EQ(0.3f, robustScale<float>(SCALE_FIXED, v, 0.3f));
+}
+
+/**
+ * The exact scales match a full sort, the approximate ones stay within their
+ * tolerance
+ */
+TEST(RobustKernelTest, ScaleEstimation) {
+  srand(13);
+  RobustScale_<float> scale;
+  RobustScale_<double> scale_double;
+  // Only the largest sizes are counted in histograms, the others are selected
+  const unsigned int sizes[] = {50000, 1000, 1001, 10, 1};
+  for (unsigned int n : sizes) {
+    // Gaussian-like residuals around an offset, and a few gross outliers
+    Eigen::VectorXf r(n);
+    for (unsigned int i = 0; i < n; ++i) {
+      r[i] = 0.2f + (rand() + rand() + rand()) / float(RAND_MAX) - 1.5f;
+      if (i % 10 == 9) {
+        r[i] = 100.f * rand() / float(RAND_MAX);
+      }
+    }
+    std::vector<float> sorted(r.data(), r.data() + n);
+    std::sort(sorted.begin(), sorted.end());
+    const float median = (sorted[(n - 1) / 2] + sorted[n / 2]) / 2;
+    for (unsigned int i = 0; i < n; ++i) {
+      sorted[i] = std::abs(r[i]);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    const float median_abs = (sorted[(n - 1) / 2] + sorted[n / 2]) / 2;
+    for (unsigned int i = 0; i < n; ++i) {
+      sorted[i] = std::abs(r[i] - median);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    const float mad = (sorted[(n - 1) / 2] + sorted[n / 2]) / 2;
+
+    scale.setTolerance(0);
+    EXPECT_FLOAT_EQ(median_abs / 0.6745f, scale(SCALE_MEDIAN, r, 0.f)) << n;
+    EXPECT_FLOAT_EQ(mad / 0.6745f, scale(SCALE_MAD, r, 0.f)) << n;
+    EXPECT_FLOAT_EQ(median_absolute_deviation<float>(r) / 0.6745f, scale(SCALE_MAD, r, 0.f)) << n;
+
+    const float tolerances[] = {0.01f, 0.001f};
+    for (float tolerance : tolerances) {
+      scale.setTolerance(tolerance);
+      EXPECT_NEAR(median_abs / 0.6745f, scale(SCALE_MEDIAN, r, 0.f), tolerance * median_abs / 0.6745f)
+          << n << " elements, tolerance " << tolerance;
+      // The error on the center adds up to the one on the deviation
+      EXPECT_NEAR(mad / 0.6745f, scale(SCALE_MAD, r, 0.f), tolerance * (mad + 2 * std::abs(median)) / 0.6745f)
+          << n << " elements, tolerance " << tolerance;
+      // Keyed on the bits of doubles
+      scale_double.setTolerance(tolerance);
+      const Eigen::VectorXd r_double = r.cast<double>();
+      EXPECT_NEAR(median_abs / 0.6745, scale_double(SCALE_MEDIAN, r_double, 0.), tolerance * median_abs / 0.6745)
+          << n << " elements, tolerance " << tolerance;
+    }
+    // Finer than the histograms go
+    scale.setTolerance(1e-9f);
+    EXPECT_FLOAT_EQ(median_abs / 0.6745f, scale(SCALE_MEDIAN, r, 0.f)) << n;
+  }
+}
+
+/**
+ * Gross outliers in the current cloud bias the least squares registration,
+ * the robust kernels down-weight them
+ */
+TEST(RobustKernelTest, Outliers) {
+  srand(11);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr reference(new pcl::PointCloud<pcl::PointXYZ>());
+  for (int i = 0; i < 500; ++i) {
+    reference->push_back(pcl::PointXYZ(rand() / float(RAND_MAX), rand() / float(RAND_MAX),
+                                       rand() / float(RAND_MAX)));
+  }
+  const Eigen::Matrix4f transformation = eigentools::createTransformationMatrix(0.05f, -0.05f, 0.02f,
+                                         0.1f, 0.05f, -0.05f);
+  pcl::PointCloud<pcl::PointXYZ>::Ptr current(new pcl::PointCloud<pcl::PointXYZ>());
+  pcl::transformPointCloud(*reference, *current, Eigen::Matrix4f(transformation.inverse()));
+  for (int i = 0; i < 50; ++i) {
+    current->push_back(pcl::PointXYZ(1.5f + rand() / float(RAND_MAX), rand() / float(RAND_MAX),
+                                     rand() / float(RAND_MAX)));
+  }
+
+  auto registrationError = [&](bool mestimator, MEstimatorType type) {
+    IcpPointToPoint icp;
+    IcpParameters param;
+    param.max_iter = 50;
+    param.min_variation = 0;
+    param.mestimator = mestimator;
+    param.mestimator_type = type;
+    param.mestimator_scale = SCALE_MEDIAN;
+    icp.setParameters(param);
+    icp.setInputReference(reference);
+    icp.setInputCurrent(current);
+    icp.run();
+    const Eigen::Matrix4f T = icp.getResults().transformation;
+    return (T.topRightCorner<3, 1>() - transformation.topRightCorner<3, 1>()).norm();
+  };
+
+  const float least_squares = registrationError(false, MESTIMATOR_HUBER);
+  const MEstimatorType types[] = {MESTIMATOR_HUBER, MESTIMATOR_TUKEY, MESTIMATOR_CAUCHY,
+                                  MESTIMATOR_GEMAN_MCCLURE, MESTIMATOR_WELSCH
+                                 };
+  for (MEstimatorType type : types) {
+    const float robust = registrationError(true, type);
+    EXPECT_LT(robust, 0.5f * least_squares) << toString(type);
+  }
+}
+
+}  // namespace test_icp
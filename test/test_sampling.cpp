@@ -0,0 +1,160 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <limits>
+#include <icp/sampling.hpp>
+
+namespace test_icp {
+
+using namespace icp;
+
+class SamplingTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp() {
+      cloud_ = pcl::PointCloud<pcl::PointNormal>::Ptr(new pcl::PointCloud<pcl::PointNormal>());
+      // A large plane facing +z and a small one facing +x
+      for (int i = 0; i < 900; ++i) {
+        pcl::PointNormal p;
+        p.x = i % 30;
+        p.y = i / 30;
+        p.z = 0;
+        p.normal_x = 0;
+        p.normal_y = 0;
+        p.normal_z = 1;
+        cloud_->push_back(p);
+      }
+      for (int i = 0; i < 100; ++i) {
+        pcl::PointNormal p;
+        p.x = 0;
+        p.y = i % 10;
+        p.z = i / 10;
+        p.normal_x = 1;
+        p.normal_y = 0;
+        p.normal_z = 0;
+        cloud_->push_back(p);
+      }
+    }
+
+    /**
+     * Checks that the sample has the right size and contains distinct
+     * valid indices in increasing order
+     */
+    void checkSample(const std::vector<int> &indices, unsigned int size) {
+      ASSERT_EQ(size, indices.size());
+      for (unsigned int i = 0; i < indices.size(); ++i) {
+        ASSERT_GE(indices[i], 0);
+        ASSERT_LT(indices[i], static_cast<int>(cloud_->size()));
+        if (i > 0) {
+          ASSERT_LT(indices[i - 1], indices[i]);
+        }
+      }
+    }
+
+    int countSmallPlane(const std::vector<int> &indices) {
+      return std::count_if(indices.begin(), indices.end(), [](int i) {
+        return i >= 900;
+      });
+    }
+
+    pcl::PointCloud<pcl::PointNormal>::Ptr cloud_;
+};
+
+TEST_F(SamplingTest, Uniform) {
+  Sampler<pcl::PointNormal> sampler;
+  sampler.setInputCloud(cloud_);
+  std::vector<int> indices;
+  sampler.sample(SAMPLING_UNIFORM, 100, indices);
+  checkSample(indices, 100);
+  for (unsigned int i = 0; i < indices.size(); ++i) {
+    EXPECT_EQ(static_cast<int>(10 * i), indices[i]);
+  }
+
+  // Asking for more points than available keeps them all
+  sampler.sample(SAMPLING_UNIFORM, 2000, indices);
+  checkSample(indices, cloud_->size());
+}
+
+TEST_F(SamplingTest, Random) {
+  Sampler<pcl::PointNormal> sampler;
+  sampler.setInputCloud(cloud_);
+  std::vector<int> first, second, reseeded;
+  sampler.seed(3);
+  sampler.sample(SAMPLING_RANDOM, 100, first);
+  checkSample(first, 100);
+  sampler.sample(SAMPLING_RANDOM, 100, second);
+  checkSample(second, 100);
+  EXPECT_NE(first, second) << "Each sample should be drawn again";
+
+  sampler.setInputCloud(cloud_);
+  sampler.seed(3);
+  sampler.sample(SAMPLING_RANDOM, 100, reseeded);
+  EXPECT_EQ(first, reseeded) << "Samples should be reproducible";
+}
+
+TEST_F(SamplingTest, NormalSpace) {
+  Sampler<pcl::PointNormal> sampler;
+  sampler.setInputCloud(cloud_);
+  std::vector<int> indices;
+  sampler.sample(SAMPLING_NORMAL_SPACE, 100, indices);
+  checkSample(indices, 100);
+  // Both normal directions are equally represented, whereas a random sample
+  // would only pick about 10 points of the small plane
+  EXPECT_EQ(50, countSmallPlane(indices));
+
+  // Once the small plane is exhausted, the rest comes from the large one
+  sampler.sample(SAMPLING_NORMAL_SPACE, 500, indices);
+  checkSample(indices, 500);
+  EXPECT_EQ(100, countSmallPlane(indices));
+}
+
+/**
+ * Points without a valid normal are only drawn once the others are
+ * exhausted, even when the first point of the cloud has none
+ */
+TEST_F(SamplingTest, NormalSpaceInvalidNormals) {
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  (*cloud_)[0].normal_x = nan;
+  for (int i = 900; i < 1000; i += 2) {
+    (*cloud_)[i].normal_x = 0;
+  }
+  Sampler<pcl::PointNormal> sampler;
+  sampler.setInputCloud(cloud_);
+  std::vector<int> indices;
+  sampler.sample(SAMPLING_NORMAL_SPACE, 100, indices);
+  checkSample(indices, 100);
+  auto countInvalid = [](const std::vector<int> &indices) {
+    return std::count_if(indices.begin(), indices.end(), [](int i) {
+      return i == 0 || (i >= 900 && i % 2 == 0);
+    });
+  };
+  EXPECT_EQ(0, countInvalid(indices));
+  EXPECT_EQ(50, countSmallPlane(indices));
+
+  // The 949 valid points, then 11 of the invalid ones
+  sampler.sample(SAMPLING_NORMAL_SPACE, 960, indices);
+  checkSample(indices, 960);
+  EXPECT_EQ(11, countInvalid(indices));
+}
+
+TEST_F(SamplingTest, NormalSpaceWithoutNormals) {
+  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>());
+  for (int i = 0; i < 100; ++i) {
+    cloud->push_back(pcl::PointXYZ(i, 0, 0));
+  }
+  Sampler<pcl::PointXYZ> sampler;
+  sampler.setInputCloud(cloud);
+  std::vector<int> indices;
+  sampler.sample(SAMPLING_NORMAL_SPACE, 10, indices);
+  EXPECT_EQ(10u, indices.size());
+}
+
+}  // namespace test_icp
@@ -0,0 +1,123 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <icp/eigentools.hpp>
+#include <icp/icp.hpp>
+#include <icp/synthetic.hpp>
+
+namespace test_icp {
+
+using namespace icp;
+
+typedef pcl::PointCloud<pcl::PointNormal> PointCloudNormal;
+
+class SyntheticTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp() {
+      param_.num_points = 3000;
+      param_.transformation = eigentools::createTransformationMatrix(0.2f, -0.1f, 0.05f, 0.02f, -0.01f, 0.05f);
+      // A small box of points with normals, copied in the scene
+      model_.reset(new PointCloudNormal());
+      for (int i = 0; i < 100; ++i) {
+        pcl::PointNormal p;
+        p.getVector3fMap() << (i % 10) * 0.1f, (i / 10) * 0.1f, 0.f;
+        p.getNormalVector3fMap() << 0.f, 0.f, 1.f;
+        model_->push_back(p);
+        p.getVector3fMap() << 0.f, (i % 10) * 0.1f, (i / 10) * 0.1f;
+        p.getNormalVector3fMap() << 1.f, 0.f, 0.f;
+        model_->push_back(p);
+      }
+    }
+
+    SyntheticSceneParameters param_;
+    PointCloudNormal::Ptr model_;
+};
+
+TEST_F(SyntheticTest, Deterministic) {
+  PointCloudNormal reference1, current1, reference2, current2;
+  generateSyntheticScene(param_, model_, reference1, current1);
+  generateSyntheticScene(param_, model_, reference2, current2);
+  ASSERT_EQ(param_.num_points, reference1.size());
+  ASSERT_EQ(param_.num_points, current1.size());
+  ASSERT_EQ(reference1.size(), reference2.size());
+  ASSERT_EQ(current1.size(), current2.size());
+  for (unsigned int i = 0; i < reference1.size(); ++i) {
+    ASSERT_EQ(reference1[i].getVector3fMap(), reference2[i].getVector3fMap());
+    ASSERT_EQ(current1[i].getVector3fMap(), current2[i].getVector3fMap());
+  }
+
+  // Another seed, another scene
+  param_.seed = 1;
+  generateSyntheticScene(param_, model_, reference2, current2);
+  EXPECT_NE(reference1[0].getVector3fMap(), reference2[0].getVector3fMap());
+}
+
+TEST_F(SyntheticTest, Normals) {
+  PointCloudNormal reference, current;
+  generateSyntheticScene(param_, model_, reference, current);
+  for (const pcl::PointNormal &p : reference.points) {
+    ASSERT_NEAR(1.f, p.getNormalVector3fMap().norm(), 1e-5f);
+  }
+  for (const pcl::PointNormal &p : current.points) {
+    ASSERT_NEAR(1.f, p.getNormalVector3fMap().norm(), 1e-5f);
+  }
+}
+
+/**
+ * The current cloud only sees a part of the scene: once moved back by the
+ * ground truth, it lies on one side of a vertical plane
+ */
+TEST_F(SyntheticTest, PartialOverlap) {
+  param_.overlap = 0.5f;
+  PointCloudNormal reference, current;
+  generateSyntheticScene(param_, PointCloudNormal::ConstPtr(), reference, current);
+  ASSERT_EQ(param_.num_points, current.size());
+
+  Eigen::Vector3f min = Eigen::Vector3f::Constant(1e9f), max = -min;
+  for (const pcl::PointNormal &p : current.points) {
+    const Eigen::Vector3f x = param_.transformation.topLeftCorner<3, 3>() * p.getVector3fMap()
+                              + param_.transformation.topRightCorner<3, 1>();
+    min = min.cwiseMin(x);
+    max = max.cwiseMax(x);
+  }
+  // The floor spans 10m in x and y, the cut removes about half of it
+  const float area = (max - min).x() * (max - min).y();
+  EXPECT_LT(area, 0.8f * param_.size * param_.size);
+}
+
+/**
+ * Registering the current cloud onto the reference finds the ground truth,
+ * up to the noise of the samples
+ */
+TEST_F(SyntheticTest, GroundTruth) {
+  param_.noise = 0.005f;
+  param_.outlier_ratio = 0.01f;
+  PointCloudNormal::Ptr reference(new PointCloudNormal()), current(new PointCloudNormal());
+  generateSyntheticScene(param_, model_, *reference, *current);
+
+  IcpParameters param;
+  param.max_iter = 50;
+  param.max_correspondance_distance = 0.5f;
+  param.mestimator = true;
+  IcpPointToPlane icp;
+  icp.setParameters(param);
+  icp.setInputReference(reference);
+  icp.setInputCurrent(current);
+  icp.run();
+  const IcpResults r = icp.getResults();
+  const Eigen::Matrix4f error = r.transformation * param_.transformation.inverse();
+  const float translation_error = error.topRightCorner<3, 1>().norm();
+  EXPECT_LT(eigentools::rotationAngle(error), 0.01f);
+  EXPECT_LT(translation_error, 0.05f);
+}
+
+}  // namespace test_icp
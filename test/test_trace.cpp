@@ -0,0 +1,169 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <pcl/common/transforms.h>
+#include <icp/eigentools.hpp>
+#include <icp/icp.hpp>
+#include <icp/trace.hpp>
+#include "test_clouds.hpp"
+
+namespace test_icp {
+
+using namespace icp;
+
+typedef std::vector<IcpTraceRun, Eigen::aligned_allocator<IcpTraceRun>> TraceRuns;
+
+class TraceTest : public ::testing::Test
+{
+  protected:
+    virtual void SetUp() {
+      reference_ = randomCloud<pcl::PointXYZ>(5);
+      current_ = movedCloud(*reference_, eigentools::createTransformationMatrix(0.05f, -0.05f, 0.02f,
+                            0.1f, 0.05f, -0.05f));
+
+      param_.max_iter = 20;
+      param_.mestimator = true;
+      icp_.setParameters(param_);
+      icp_.setInputReference(reference_);
+      icp_.setInputCurrent(current_);
+    }
+
+    virtual void TearDown() {
+      std::remove(path_);
+    }
+
+    static const char *path_;
+    pcl::PointCloud<pcl::PointXYZ>::Ptr reference_, current_;
+    IcpParameters param_;
+    IcpPointToPoint icp_;
+};
+
+const char *TraceTest::path_ = "test_trace.icpt";
+
+/**
+ * Each iteration of each run is recorded as in the results
+ */
+TEST_F(TraceTest, Runs) {
+  std::vector<IcpResults> results;
+  {
+    icp_.setTrace(IcpTraceWriter::Ptr(new IcpTraceWriter(path_, 50)));
+    icp_.run();
+    results.push_back(icp_.getResults());
+    param_.pyramid.push_back(IcpPyramidLevel(0.2f, 5));
+    icp_.setParameters(param_);
+    icp_.run();
+    results.push_back(icp_.getResults());
+    icp_.setTrace(IcpTraceWriter::Ptr());
+  }
+  // Not recorded anymore
+  icp_.run();
+
+  TraceRuns runs;
+  ASSERT_TRUE(readTrace(path_, runs));
+  ASSERT_EQ(2u, runs.size());
+  for (unsigned int r = 0; r < runs.size(); ++r) {
+    const IcpTraceRun &run = runs[r];
+    const IcpResults &result = results[r];
+    EXPECT_TRUE(run.complete);
+    EXPECT_EQ(result.stop_reason, run.stop_reason);
+    EXPECT_EQ(current_->size(), run.num_current);
+    EXPECT_EQ(reference_->size(), run.num_reference);
+    EXPECT_TRUE(run.transformation.isApprox(result.transformation));
+    ASSERT_EQ(result.registrationError.size(), run.iterations.size());
+    for (unsigned int i = 0; i < run.iterations.size(); ++i) {
+      const IcpTraceIteration &it = run.iterations[i];
+      EXPECT_FLOAT_EQ(result.registrationError[i], it.error);
+      // The levels of the pyramid query the downsampled cloud
+      if (it.level < 0) {
+        EXPECT_EQ(current_->size(), it.num_queries);
+      }
+      EXPECT_LE(it.num_correspondences, it.num_queries);
+      EXPECT_LE(it.weight_min, it.weight_mean);
+      EXPECT_LE(it.weight_mean, it.weight_max);
+      EXPECT_LE(it.weight_max, 1.f);
+      EXPECT_GE(it.time, 0);
+      // At most 50 correspondences, evenly sampled
+      ASSERT_EQ(50u, it.correspondences.size());
+      EXPECT_LT(it.correspondences.back().first, static_cast<int>(current_->size()));
+      EXPECT_LT(it.correspondences.back().second, static_cast<int>(reference_->size()));
+    }
+    EXPECT_TRUE(run.iterations.back().transformation.isApprox(result.transformation));
+  }
+  // The first run is at full resolution, the second one starts with the level
+  // of the pyramid
+  EXPECT_EQ(-1, runs[0].iterations.front().level);
+  EXPECT_EQ(0, runs[1].iterations.front().level);
+  EXPECT_EQ(1u, runs[1].iterations.front().iteration);
+  EXPECT_EQ(-1, runs[1].iterations.back().level);
+}
+
+/**
+ * The iterations of a truncated log are kept up to the truncated record
+ */
+TEST_F(TraceTest, Truncated) {
+  {
+    icp_.setTrace(IcpTraceWriter::Ptr(new IcpTraceWriter(path_)));
+    icp_.run();
+    icp_.setTrace(IcpTraceWriter::Ptr());
+  }
+  const unsigned int num_iterations = icp_.getResults().registrationError.size();
+  ASSERT_GT(num_iterations, 1u);
+
+  // Cut in the middle of the last iteration
+  std::string data;
+  {
+    std::ifstream file(path_, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+  std::ofstream(path_, std::ios::binary | std::ios::trunc).write(data.data(), data.size() - 70);
+
+  TraceRuns runs;
+  EXPECT_FALSE(readTrace(path_, runs));
+  ASSERT_EQ(1u, runs.size());
+  EXPECT_FALSE(runs[0].complete);
+  EXPECT_EQ(num_iterations - 1, runs[0].iterations.size());
+}
+
+/**
+ * A corrupted number of correspondences stops the reading instead of
+ * allocating it
+ */
+TEST_F(TraceTest, Corrupted) {
+  {
+    icp_.setTrace(IcpTraceWriter::Ptr(new IcpTraceWriter(path_)));
+    icp_.run();
+    icp_.setTrace(IcpTraceWriter::Ptr());
+  }
+  // Number of correspondences of the first iteration, after the header (8
+  // bytes), the beginning of the run (61 bytes) and the iteration statistics
+  std::fstream file(path_, std::ios::binary | std::ios::in | std::ios::out);
+  const uint32_t num_pairs = 0xffffffff;
+  file.seekp(8 + 61 + 113);
+  file.write(reinterpret_cast<const char *>(&num_pairs), sizeof(num_pairs));
+  file.close();
+
+  TraceRuns runs;
+  EXPECT_FALSE(readTrace(path_, runs));
+  ASSERT_EQ(1u, runs.size());
+  EXPECT_FALSE(runs[0].complete);
+  EXPECT_TRUE(runs[0].iterations.empty());
+}
+
+TEST_F(TraceTest, NotATrace) {
+  std::ofstream(path_) << "ICP";
+  TraceRuns runs;
+  EXPECT_FALSE(readTrace(path_, runs));
+  EXPECT_TRUE(runs.empty());
+}
+
+}  // namespace test_icp
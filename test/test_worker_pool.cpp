@@ -0,0 +1,69 @@
+//  This file is part of the Icp Library,
+//
+//  Copyright (C) 2015 by Arnaud TANGUY <arn.tanguy@NOSPAM.gmail.com>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+#include <icp/worker_pool.hpp>
+
+namespace test_icp {
+
+using namespace icp;
+
+/**
+ * Every thread runs each job once, the same workers serve every job
+ */
+TEST(WorkerPoolTest, Jobs) {
+  WorkerPool pool;
+  EXPECT_EQ(1u, pool.size());
+  pool.resize(4);
+  ASSERT_EQ(4u, pool.size());
+  std::vector<int> counts(4, 0);
+  for (int job = 0; job < 1000; ++job) {
+    pool.run([&counts](unsigned int t) {
+      ++counts[t];
+    });
+  }
+  for (unsigned int t = 0; t < counts.size(); ++t) {
+    EXPECT_EQ(1000, counts[t]) << "Thread " << t;
+  }
+
+  // Back to the calling thread only
+  pool.resize(1);
+  std::atomic<int> calls(0);
+  pool.run([&calls](unsigned int t) {
+    EXPECT_EQ(0u, t);
+    ++calls;
+  });
+  EXPECT_EQ(1, calls);
+
+  // A copy starts its own workers
+  pool.resize(3);
+  WorkerPool copy(pool);
+  EXPECT_EQ(1u, copy.size());
+}
+
+TEST(WorkerPoolTest, Exceptions) {
+  WorkerPool pool;
+  pool.resize(3);
+  EXPECT_THROW(pool.run([](unsigned int t) {
+    if (t == 2) {
+      throw std::runtime_error("worker");
+    }
+  }), std::runtime_error);
+  // The pool is still usable
+  std::atomic<int> calls(0);
+  pool.run([&calls](unsigned int) {
+    ++calls;
+  });
+  EXPECT_EQ(3, calls);
+}
+
+}  // namespace test_icp